@@ -0,0 +1,253 @@
+#version 450 core
+
+// GPU mesher for full detail chunks, the input is a PaletteChunk (src/game_engine/palettechunk.h).
+// One dispatch per chunk, one invocation per voxel and one per border column for the skirts.
+// Mirrors ChunkMesher::addVoxelFaces, addSkirts and addQuad face for face.
+// chunkmesh_count_comp.spv only counts the faces of every mesh range. The CPU turns the counts
+// into range starts and creates the buffers, then chunkmesh_emit_comp.spv (EMIT) writes the faces
+// into them, the counters hand out the slots inside every range.
+
+layout(local_size_x = 64) in;
+
+const int CHUNK_SIZE_X = 16;
+const int CHUNK_SIZE_Y = 64;
+const int CHUNK_SIZE_Z = 16;
+const int PADDED_SIZE_Z = CHUNK_SIZE_Z + 2;
+const int SECTION_HEIGHT = 16;
+const int SECTION_COUNT = CHUNK_SIZE_Y / SECTION_HEIGHT;
+const int MESH_RANGE_COUNT = 2 * 6 + SECTION_COUNT;
+const int SKIRT_DEPTH = 8;
+const int VOXEL_INVOCATIONS = CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z;
+const int BORDER_CELLS = 16; // Along x and along z
+const int SKIRT_INVOCATIONS = 4 * BORDER_CELLS;
+
+// PaletteChunk layout (uints)
+const uint FLAGS_OFFSET = 0;
+const uint SKIRT_FLAGS_SHIFT = 9;
+const uint PALETTE_OFFSET = 2;
+const uint IDS_OFFSET = PALETTE_OFFSET + 256 * 2;
+const uint LIGHT_OFFSET = IDS_OFFSET + (CHUNK_SIZE_X + 2) * CHUNK_SIZE_Y * PADDED_SIZE_Z / 4;
+
+const uint LAYER_TRANSLUCENT = 2;
+const uint VERTEX_SIZE = 12; // uints of a Vertex
+
+layout(set = 0, binding = 0) readonly buffer ChunkInput {
+	uint data[];
+} chunkInput;
+
+layout(set = 0, binding = 1) buffer Counters {
+	uint counters[];
+};
+
+#ifdef EMIT
+layout(set = 0, binding = 2) writeonly buffer Vertices {
+	uint vertices[];
+};
+
+layout(set = 0, binding = 3) writeonly buffer Indices {
+	uint indices[];
+};
+#endif
+
+layout(push_constant) uniform PushConstants {
+	uint inputOffset; // First uint of the chunk's PaletteChunk
+	uint counterOffset; // First of its MESH_RANGE_COUNT counters
+	uint rangeStarts[MESH_RANGE_COUNT]; // First quad of every range (EMIT)
+} job;
+
+// Indexed by Chunk::FaceDirection: FRONT, BACK, LEFT, RIGHT, TOP, BOTTOM
+const ivec3 NORMALS[6] = ivec3[](
+	ivec3(0, 0, 1), ivec3(0, 0, -1), ivec3(-1, 0, 0), ivec3(1, 0, 0), ivec3(0, 1, 0), ivec3(0, -1, 0));
+
+// Four corners around every face
+const ivec3 CORNERS[24] = ivec3[](
+	ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(0, 1, 1),
+	ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 1, 0), ivec3(0, 1, 0),
+	ivec3(0, 0, 0), ivec3(0, 0, 1), ivec3(0, 1, 1), ivec3(0, 1, 0),
+	ivec3(1, 0, 0), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(1, 1, 0),
+	ivec3(0, 1, 0), ivec3(1, 1, 0), ivec3(1, 1, 1), ivec3(0, 1, 1),
+	ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 0, 1), ivec3(0, 0, 1));
+
+const vec2 TEXCOORDS[4] = vec2[](vec2(0.0, 1.0), vec2(1.0, 1.0), vec2(1.0, 0.0), vec2(0.0, 0.0));
+
+uint readByte(uint offset, uint index) {
+	return (chunkInput.data[job.inputOffset + offset + index / 4] >> ((index % 4) * 8)) & 0xFF;
+}
+
+// Chunk local coordinates, x and z from -1 to CHUNK_SIZE like PaddedChunk
+uint voxelIndex(ivec3 voxel) {
+	return uint(((voxel.x + 1) * CHUNK_SIZE_Y + voxel.y) * PADDED_SIZE_Z + voxel.z + 1);
+}
+
+// x: type, top, side and bottom texture, y: render layer | opaque << 2
+uvec2 getBlock(ivec3 voxel) {
+	uint entry = job.inputOffset + PALETTE_OFFSET + readByte(IDS_OFFSET, voxelIndex(voxel)) * 2;
+	return uvec2(chunkInput.data[entry], chunkInput.data[entry + 1]);
+}
+
+bool isAir(uvec2 block) {
+	return (block.x & 0xFF) == 0;
+}
+
+bool isOpaqueBlock(uvec2 block) {
+	return (block.y & 4) != 0;
+}
+
+uint renderLayer(uvec2 block) {
+	return block.y & 3;
+}
+
+bool isOpaque(ivec3 voxel) {
+	return voxel.y >= 0 && voxel.y < CHUNK_SIZE_Y && isOpaqueBlock(getBlock(voxel));
+}
+
+bool isLoaded(int x, int z) {
+	int dx = x < 0 ? 0 : (x < CHUNK_SIZE_X ? 1 : 2);
+	int dz = z < 0 ? 0 : (z < CHUNK_SIZE_Z ? 1 : 2);
+	return (chunkInput.data[job.inputOffset + FLAGS_OFFSET] & (1u << (dx * 3 + dz))) != 0;
+}
+
+bool hidesFace(ivec3 voxel) {
+	return isOpaque(voxel) || !isLoaded(voxel.x, voxel.z);
+}
+
+vec2 getFaceLight(ivec3 voxel) {
+	if (voxel.y < 0 || voxel.y >= CHUNK_SIZE_Y) {
+		return vec2(1.0, 0.0);
+	}
+	uint level = readByte(LIGHT_OFFSET, voxelIndex(voxel));
+	return vec2(level >> 4, level & 0x0F) / 15.0;
+}
+
+uint faceTexture(uvec2 block, int direction) {
+	uint shift = direction == 4 ? 8u : (direction == 5 ? 24u : 16u);
+	return (block.x >> shift) & 0xFF;
+}
+
+void addQuad(uvec2 block, int direction, ivec3 origin, ivec3 size, vec2 light, ivec4 ao) {
+	uint range = renderLayer(block) == LAYER_TRANSLUCENT
+		? uint(2 * 6 + min(origin.y / SECTION_HEIGHT, SECTION_COUNT - 1))
+		: renderLayer(block) * 6 + uint(direction);
+
+#ifndef EMIT
+	atomicAdd(counters[job.counterOffset + range], 1u);
+#else
+	uint quad = job.rangeStarts[range] + atomicAdd(counters[job.counterOffset + range], 1u);
+
+	// Texture u runs along x (z on the x faces), v along y (z on the y faces)
+	ivec3 normal = NORMALS[direction];
+	int normalAxis = normal.x != 0 ? 0 : (normal.y != 0 ? 1 : 2);
+	vec2 texScale = normalAxis == 0 ? vec2(size.z, size.y) : (normalAxis == 1 ? vec2(size.x, size.z) : vec2(size.x, size.y));
+	uint texIndex = faceTexture(block, direction);
+
+	for (int i = 0; i < 4; i++) {
+		vec3 position = vec3(origin + CORNERS[direction * 4 + i] * size);
+		vec2 texCoord = TEXCOORDS[i] * texScale;
+		uint vertex = (quad * 4 + i) * VERTEX_SIZE;
+		vertices[vertex + 0] = floatBitsToUint(position.x);
+		vertices[vertex + 1] = floatBitsToUint(position.y);
+		vertices[vertex + 2] = floatBitsToUint(position.z);
+		vertices[vertex + 3] = floatBitsToUint(float(normal.x));
+		vertices[vertex + 4] = floatBitsToUint(float(normal.y));
+		vertices[vertex + 5] = floatBitsToUint(float(normal.z));
+		vertices[vertex + 6] = floatBitsToUint(texCoord.x);
+		vertices[vertex + 7] = floatBitsToUint(texCoord.y);
+		vertices[vertex + 8] = texIndex;
+		vertices[vertex + 9] = floatBitsToUint(light.x);
+		vertices[vertex + 10] = floatBitsToUint(light.y);
+		vertices[vertex + 11] = floatBitsToUint(float(ao[i]) / 3.0);
+	}
+
+	// Split along the darker diagonal like the CPU mesher
+	uint start = quad * 4;
+	uint first = ao[0] + ao[2] > ao[1] + ao[3] ? 1u : 0u;
+	uint index = quad * 6;
+	indices[index + 0] = start + first;
+	indices[index + 1] = start + first + 1;
+	indices[index + 2] = start + first + 2;
+	indices[index + 3] = start + first + 2;
+	indices[index + 4] = start + (first + 3u) % 4u;
+	indices[index + 5] = start + first;
+#endif
+}
+
+void addVoxelFaces(ivec3 voxel) {
+	uvec2 block = getBlock(voxel);
+	if (isAir(block)) {
+		return;
+	}
+	bool translucent = renderLayer(block) == LAYER_TRANSLUCENT;
+
+	for (int direction = 0; direction < 6; direction++) {
+		ivec3 normal = NORMALS[direction];
+		ivec3 front = voxel + normal;
+
+		// Bottom faces are never seen from below the world
+		if (front.y < 0 || hidesFace(front)) {
+			continue;
+		}
+		// No walls inside a body of the same translucent block
+		if (translucent && front.y < CHUNK_SIZE_Y && (getBlock(front).x & 0xFF) == (block.x & 0xFF)) {
+			continue;
+		}
+
+		// Corner occlusion from the two side voxels and the diagonal voxel in front of the face
+		int normalAxis = normal.x != 0 ? 0 : (normal.y != 0 ? 1 : 2);
+		int axisU = (normalAxis + 1) % 3;
+		int axisV = (normalAxis + 2) % 3;
+		ivec4 ao;
+		for (int i = 0; i < 4; i++) {
+			ivec3 corner = CORNERS[direction * 4 + i];
+			ivec3 stepU = ivec3(0);
+			ivec3 stepV = ivec3(0);
+			stepU[axisU] = corner[axisU] != 0 ? 1 : -1;
+			stepV[axisV] = corner[axisV] != 0 ? 1 : -1;
+			bool solidU = isOpaque(front + stepU);
+			bool solidV = isOpaque(front + stepV);
+			bool solidDiagonal = isOpaque(front + stepU + stepV);
+			ao[i] = (solidU && solidV) ? 0 : 3 - (int(solidU) + int(solidV) + int(solidDiagonal));
+		}
+
+		addQuad(block, direction, voxel, ivec3(1), getFaceLight(front), ao);
+	}
+}
+
+// Skirts hang down from the surface towards neighbors at a coarser level (sides FRONT, BACK, LEFT, RIGHT)
+void addSkirt(int side, int cell) {
+	if ((chunkInput.data[job.inputOffset + FLAGS_OFFSET] & (1u << (SKIRT_FLAGS_SHIFT + side))) == 0) {
+		return;
+	}
+	ivec3 normal = NORMALS[side];
+	bool alongX = normal.x == 0;
+	if (cell >= (alongX ? CHUNK_SIZE_X : CHUNK_SIZE_Z)) {
+		return;
+	}
+	int x = alongX ? cell : (normal.x > 0 ? CHUNK_SIZE_X - 1 : 0);
+	int z = alongX ? (normal.z > 0 ? CHUNK_SIZE_Z - 1 : 0) : cell;
+
+	int y = CHUNK_SIZE_Y - 1;
+	while (y >= 0 && isAir(getBlock(ivec3(x, y, z)))) {
+		y--;
+	}
+	// Open neighbor voxels already got a regular face
+	if (y < 0 || !isOpaqueBlock(getBlock(ivec3(x + normal.x, y, z + normal.z)))) {
+		return;
+	}
+
+	int surfaceY = y + 1;
+	int depth = min(SKIRT_DEPTH, surfaceY);
+	ivec3 origin = ivec3(x, surfaceY - depth, z);
+	addQuad(getBlock(ivec3(x, y, z)), side, origin, ivec3(1, depth, 1), getFaceLight(ivec3(x, surfaceY, z)), ivec4(3));
+}
+
+void main() {
+	int invocation = int(gl_GlobalInvocationID.x);
+	if (invocation < VOXEL_INVOCATIONS) {
+		// Same order as the padded layout, x, then y, then z
+		addVoxelFaces(ivec3(invocation / (CHUNK_SIZE_Y * CHUNK_SIZE_Z), (invocation / CHUNK_SIZE_Z) % CHUNK_SIZE_Y, invocation % CHUNK_SIZE_Z));
+	}
+	else if (invocation < VOXEL_INVOCATIONS + SKIRT_INVOCATIONS) {
+		int skirt = invocation - VOXEL_INVOCATIONS;
+		addSkirt(skirt / BORDER_CELLS, skirt % BORDER_CELLS);
+	}
+}
@@ -1,2 +0,0 @@
-glslc.exe -fshader-stage=vert texture_vert.glsl -o texture_vert.spv
-glslc.exe -fshader-stage=frag texture_frag.glsl -o texture_frag.spv
\ No newline at end of file
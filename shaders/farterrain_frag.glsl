@@ -0,0 +1,16 @@
+#version 450 core
+
+layout(location = 0) in vec3 in_normal;
+layout(location = 1) in vec3 in_color;
+layout(location = 2) in float in_fog;
+
+layout(location = 0) out vec4 out_color;
+
+// Same as the clear color
+const vec3 skyColor = vec3(135.0, 206.0, 235.0) / 255.0;
+
+void main() {
+	// Slopes a little darker so the shape reads without textures
+	float shade = mix(0.6, 1.0, max(normalize(in_normal).y, 0.0));
+	out_color = vec4(mix(in_color * shade, skyColor, in_fog), 1.0);
+}
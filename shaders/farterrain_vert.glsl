@@ -0,0 +1,24 @@
+#version 450 core
+
+layout(push_constant) uniform PushConstants {
+	mat4 viewProj;
+	vec4 cameraPosition;
+	vec4 fog; // Start and end distance
+} constants;
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec3 in_color;
+
+layout(location = 0) out vec3 out_normal;
+layout(location = 1) out vec3 out_color;
+layout(location = 2) out float out_fog;
+
+void main() {
+	gl_Position = constants.viewProj * vec4(in_position, 1.0);
+	out_normal = in_normal;
+	out_color = in_color;
+
+	float distance = length(in_position.xz - constants.cameraPosition.xz);
+	out_fog = clamp((distance - constants.fog.x) / (constants.fog.y - constants.fog.x), 0.0, 1.0);
+}
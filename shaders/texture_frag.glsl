@@ -1,23 +1,49 @@
 #version 450 core
 #extension GL_KHR_vulkan_glsl : enable
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec3 in_normal;
 layout(location = 1) in vec2 in_texcoord;
 layout(location = 2) in vec3 in_position;
 layout(location = 3) in flat int in_texIndex;
+layout(location = 4) in vec2 in_light; // Sky, block light (0 - 1)
+layout(location = 5) in float in_ao;
 
-//layout(set = 0, binding = 1) uniform sampler2DArray textureArray;
-layout(set = 0, binding = 1) uniform sampler2D textures[6];
+#ifdef BINDLESS
+// Texture table (texture_bindless_frag.spv): every texture is its own entry
+layout(set = 1, binding = 0) uniform sampler2DArray textures[];
+#else
+layout(set = 0, binding = 1) uniform sampler2DArray textureArray;
+#endif
 
 layout(location = 0) out vec4 out_color;
 
+// Every light level is 20% darker than the one above it
+float lightBrightness(float level) {
+	return pow(0.8, (1.0 - level) * 15.0);
+}
+
 
 void main() {
 	//vec3 view = normalize(-in_position);
 
-	//vec4 texSample = texture(textureArray, vec3(in_texcoord, 2));
-	vec4 texSample = texture(textures[in_texIndex - 1], in_texcoord);
-	out_color = texSample;
+	// Texture indices start at 1, layers and table entries at 0
+#ifdef BINDLESS
+	vec4 texSample = texture(textures[nonuniformEXT(in_texIndex - 1)], vec3(in_texcoord, 0));
+#else
+	vec4 texSample = texture(textureArray, vec3(in_texcoord, in_texIndex - 1));
+#endif
+#ifdef ALPHA_TEST
+	// Cutout layer (texture_cutout_frag.spv): holes instead of blending
+	if (texSample.a < 0.5) {
+		discard;
+	}
+#endif
+	float brightness = max(max(lightBrightness(in_light.x), lightBrightness(in_light.y)), 0.05);
+	brightness *= mix(0.4, 1.0, in_ao);
+	out_color = vec4(texSample.rgb * brightness, texSample.a);
 
 	//vec3 normal = normalize(in_normal);
 
@@ -10,11 +10,15 @@ layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_texcoord;
 layout(location = 3) in int in_texIndex;
+layout(location = 4) in vec2 in_light;
+layout(location = 5) in float in_ao;
 
 layout(location = 0) out vec3 out_normal;
 layout(location = 1) out vec2 out_texcoord;
 layout(location = 2) out vec3 out_position;
 layout(location = 3) out flat int out_texIndex;
+layout(location = 4) out vec2 out_light;
+layout(location = 5) out float out_ao;
 
 void main() {
 	
@@ -35,4 +39,6 @@ gl_Position = vec4(
 	out_normal = mat3(transpose(inverse(ubo.modelView))) * in_normal;
 	out_position = (ubo.modelView * vec4(in_position, 1.0)).xyz;
 	out_texIndex = in_texIndex;
+	out_light = in_light;
+	out_ao = in_ao;
 }
\ No newline at end of file
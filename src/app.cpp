@@ -1,11 +1,16 @@
 #include "app.h"
 
-void App::run() {
+int App::run(int argc, char** argv) {
 	initLogger();
+	parseArguments(argc, argv);
+	if (vulkanSettings.headless) {
+		return runHeadless();
+	}
 	initWindow();
 	initVulkan();
 	mainLoop();
 	cleanup();
+	return 0;
 }
 
 void App::initLogger() {
@@ -13,13 +18,86 @@ void App::initLogger() {
 	LOG_INFO("Logger successfully loaded!");
 }
 
+void App::parseArguments(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (argument == "--present-mode" && hasValue) {
+			if (!Vulkan::parsePresentMode(argv[++i], &vulkanSettings.presentMode)) {
+				LOG_WARNING("Unknown present mode ", argv[i], ", expected fifo, fifo-relaxed, mailbox or immediate");
+			}
+		}
+		else if (argument == "--frames-in-flight" && hasValue) {
+			int frames = atoi(argv[++i]);
+			if (frames < 1 || frames > MAX_FRAMES_IN_FLIGHT) {
+				LOG_WARNING("Frames in flight must be between 1 and ", MAX_FRAMES_IN_FLIGHT);
+				continue;
+			}
+			vulkanSettings.framesInFlight = uint32_t(frames);
+		}
+		else if (argument == "--fps-limit" && hasValue) {
+			fpsLimit = uint32_t(std::max(atoi(argv[++i]), 0));
+		}
+		else if (argument == "--log-latency") {
+			vulkanSettings.logLatency = true;
+		}
+		else if (argument == "--headless") {
+			vulkanSettings.headless = true;
+		}
+		else if (argument == "--frames" && hasValue) {
+			headlessFrames = uint32_t(std::max(atoi(argv[++i]), 1));
+		}
+		else if (argument == "--size" && hasValue) {
+			unsigned int width = 0, height = 0;
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+				LOG_WARNING("Invalid size ", argv[i], ", expected WIDTHxHEIGHT");
+				continue;
+			}
+			vulkanSettings.width = width;
+			vulkanSettings.height = height;
+		}
+		else if (argument == "--no-validation") {
+			vulkanSettings.validation = false;
+		}
+		else if (argument == "--no-bindless") {
+			vulkanSettings.bindless = false;
+		}
+		else if (argument == "--gpu-mesher") {
+			vulkanSettings.gpuMesher = true;
+		}
+		else if (argument == "--validate-gpu-mesher") {
+			vulkanSettings.gpuMesher = true;
+			vulkanSettings.validateGpuMesher = true;
+		}
+		else if (argument == "--capture-every" && hasValue) {
+			captureEvery = uint32_t(std::max(atoi(argv[++i]), 0));
+		}
+		else if (argument == "--capture-dir" && hasValue) {
+			captureDirectory = argv[++i];
+		}
+		else if (argument == "--golden-dir" && hasValue) {
+			goldenDirectory = argv[++i];
+		}
+		else if (argument == "--golden-tolerance" && hasValue) {
+			goldenTolerance = std::max(atoi(argv[++i]), 0);
+		}
+		else if (argument == "--register-texture" && hasValue) {
+			registerTexturePath = argv[++i];
+		}
+		else {
+			LOG_WARNING("Unknown argument ", argument);
+		}
+	}
+}
+
 void App::initWindow() {
 	window = new Window("Minecraft Clone", 1240, 720);
 	window->initSDL();
 }
 
 void App::initVulkan() {
-	vulkan = new Vulkan(window->getSDLWindow());
+	vulkan = new Vulkan(window->getSDLWindow(), vulkanSettings);
 	vulkan->initVulkan();
 }
 
@@ -28,10 +106,25 @@ void App::mainLoop() {
 	float delta = 0.0f;
 	uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
 	uint64_t lastCounter = SDL_GetPerformanceCounter();
+	uint64_t frameCounters = fpsLimit > 0 ? perfCounterFrequency / fpsLimit : 0;
+	uint64_t nextFrameCounter = lastCounter;
+
+	while (true) {
+		// The limiter waits before the input is read, so the wait does not add to the latency of the frame
+		if (frameCounters > 0) {
+			waitUntil(nextFrameCounter);
+			// Late frames do not make the following ones faster
+			nextFrameCounter = std::max(nextFrameCounter + frameCounters, SDL_GetPerformanceCounter());
+		}
+
+		if (!window->handleEvents()) {
+			break;
+		}
+		uint64_t inputCounter = SDL_GetPerformanceCounter();
 
-	while (window->handleEvents()) {
 		vulkan->updateVulkan(delta);
-		vulkan->renderVulkan();
+		vulkan->renderVulkan(inputCounter);
+		registerPendingTexture();
 
 		uint64_t endCounter = SDL_GetPerformanceCounter();
 		uint64_t counterElapsed = endCounter - lastCounter;
@@ -40,6 +133,77 @@ void App::mainLoop() {
 	}
 }
 
+void App::waitUntil(uint64_t counter) {
+	uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
+	uint64_t now = SDL_GetPerformanceCounter();
+	// Sleep while more than 2 ms are left, SDL_Delay can oversleep by about a millisecond, spin the rest
+	while (now < counter && (counter - now) * 1000 / perfCounterFrequency > 2) {
+		SDL_Delay(1);
+		now = SDL_GetPerformanceCounter();
+	}
+	while (now < counter) {
+		now = SDL_GetPerformanceCounter();
+	}
+}
+
+void App::registerPendingTexture() {
+	if (registerTexturePath.empty()) {
+		return;
+	}
+	// The submitted frame still has the texture table bound, so this is an update after bind
+	vulkan->registerTexture(registerTexturePath.c_str());
+	registerTexturePath.clear();
+}
+
+int App::runHeadless() {
+	// No window, the frames go into offscreen images
+	vulkan = new Vulkan(nullptr, vulkanSettings);
+	if (!vulkan->initVulkan()) {
+		LOG_ERROR("Headless rendering is not available");
+		return 1;
+	}
+	if (goldenTolerance >= 0) {
+		vulkan->frameWriter.setTolerance(uint32_t(goldenTolerance));
+	}
+
+	// A fixed time step, so every run simulates the same frames
+	const float delta = 1.0f / 60.0f;
+	uint64_t perfCounterFrequency = SDL_GetPerformanceFrequency();
+	uint64_t startCounter = SDL_GetPerformanceCounter();
+	for (uint32_t frame = 0; frame < headlessFrames; frame++) {
+		uint64_t inputCounter = SDL_GetPerformanceCounter();
+		vulkan->updateVulkan(delta);
+		if (captureEvery > 0 && (frame + 1) % captureEvery == 0) {
+			char name[32];
+			snprintf(name, sizeof(name), "frame_%05u.png", frame + 1);
+			vulkan->requestCapture(captureDirectory + "/" + name, goldenDirectory.empty() ? "" : goldenDirectory + "/" + name);
+		}
+		vulkan->renderVulkan(inputCounter);
+		registerPendingTexture();
+	}
+	vulkan->finishFrames();
+	uint64_t endCounter = SDL_GetPerformanceCounter();
+
+	double milliseconds = (endCounter - startCounter) * 1000.0 / perfCounterFrequency;
+	LOG_INFO("Headless: ", headlessFrames, " frames of ", vulkanSettings.width, "x", vulkanSettings.height, " in ", milliseconds, " ms, ",
+		milliseconds / headlessFrames, " ms per frame, ", headlessFrames * 1000.0 / milliseconds, " fps");
+	vulkan->logFrameTimings();
+
+	// Waits for the frame writer, all comparisons are done after it
+	vulkan->cleanup();
+	uint32_t failedComparisons = vulkan->frameWriter.getFailedComparisons();
+	uint32_t failedGpuMeshes = vulkan->getFailedGpuMeshComparisons();
+	delete vulkan;
+	if (failedComparisons > 0) {
+		LOG_ERROR(failedComparisons, " captures differ from their golden images");
+		return 1;
+	}
+	if (failedGpuMeshes > 0) {
+		return 1;
+	}
+	return 0;
+}
+
 void App::cleanup() {
 	vulkan->cleanup();
 	window->cleanup();
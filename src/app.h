@@ -2,23 +2,43 @@
 #define APP_H
 
 #include "logger.h"
+#include <string>
 #include "game_engine/window.h"
 #include "vulkan_base.h"
 
 class App {
 
 public:
-	void run();
+	int run(int argc, char** argv);
 private:
 	void initLogger();
+	// --present-mode fifo|fifo-relaxed|mailbox|immediate, --frames-in-flight 1-3, --fps-limit N, --log-latency,
+	// --headless, --frames N, --size WIDTHxHEIGHT, --no-validation, --no-bindless, --gpu-mesher, --validate-gpu-mesher,
+	// --capture-every N, --capture-dir DIR, --golden-dir DIR, --golden-tolerance N (headless only), --register-texture PATH
+	void parseArguments(int argc, char** argv);
+	// Renders a fixed number of frames without a window and logs the timings
+	int runHeadless();
 	void initWindow();
 	void initVulkan();
 	void mainLoop();
+	// Frame limiter
+	void waitUntil(uint64_t counter);
+	// Registers the texture of --register-texture once, after the first frame
+	void registerPendingTexture();
 	void cleanup();
 
 	Window* window;
 	Vulkan* vulkan;
 
+	Vulkan::Settings vulkanSettings;
+	uint32_t fpsLimit = 0; // 0 is unlimited
+	uint32_t headlessFrames = 1000;
+	uint32_t captureEvery = 0; // 0 captures nothing
+	std::string captureDirectory = "../captures";
+	std::string goldenDirectory; // Captures are compared against the images of the same name in here
+	int goldenTolerance = -1; // -1 keeps the frame writer's default
+	std::string registerTexturePath; // Added to the bindless texture table while the table is bound
+
 };
 
 #endif // APP_H
\ No newline at end of file
@@ -5,6 +5,13 @@ bool Block::isAir() const {
     return type == 0;
 }
 
+uint8_t Block::getLightEmission() const {
+    // Block light level (0 - 15) per block type, none of the current blocks glow
+    switch (type) {
+    default: return 0;
+    }
+}
+
 const Block AIR = Block(0, 0, 0, 0);
 const Block DIRT_BLOCK = Block(2, 2, 2, 2);
 const Block GRASS_BLOCK = Block(1, 4 , 3, 2);
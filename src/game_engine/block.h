@@ -6,6 +6,15 @@
 class Block {
 
 public:
+	// How the faces of a block are drawn: opaque without blending, cutout with alpha testing
+	// (holes, but no blending) and translucent blended back to front after everything else
+	enum RenderLayer {
+		LAYER_OPAQUE = 0,
+		LAYER_CUTOUT = 1,
+		LAYER_TRANSLUCENT = 2,
+		LAYER_COUNT = 3
+	};
+
 	uint8_t type;
 	uint8_t topTexture;
 	uint8_t sideTexture;
@@ -15,6 +24,23 @@ public:
 		: type(blockType), topTexture(topTex), sideTexture(sideTex), bottomTexture(bottomTex) {}
 
 	bool isAir() const;
+
+	// Per block type, all of the current blocks are opaque
+	RenderLayer getRenderLayer() const {
+		switch (type) {
+		default: return LAYER_OPAQUE;
+		}
+	}
+
+	// LIGHTING
+	// Only opaque blocks hide their neighbors' faces and stop light
+	bool isOpaque() const { return type != 0 && getRenderLayer() == LAYER_OPAQUE; }
+	uint8_t getLightEmission() const;
+
+	bool operator==(const Block& other) const {
+		return type == other.type && topTexture == other.topTexture && sideTexture == other.sideTexture && bottomTexture == other.bottomTexture;
+	}
+	bool operator!=(const Block& other) const { return !(*this == other); }
 };
 
 extern const Block AIR;
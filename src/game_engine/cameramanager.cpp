@@ -1,6 +1,18 @@
 #include "cameramanager.h"
+#include "collision.h"
+#include <algorithm>
 #include "../logger.h"
 
+// Player box around the camera, in blocks
+const float PLAYER_WIDTH = 0.6f;
+const float PLAYER_HEIGHT = 1.8f;
+const float PLAYER_EYE_HEIGHT = 1.62f;
+const float WALK_SPEED = 4.3f;
+const float SPRINT_SPEED = 5.6f;
+const float JUMP_SPEED = 8.5f;
+const float GRAVITY = 28.0f;
+const float MAX_FALL_SPEED = 60.0f;
+
 // INIT CAMERA
 void CameraManager::initCamera() {
 	camera.cameraPosition = glm::vec3(0.0f, 45.0f, 0.0f);
@@ -8,6 +20,12 @@ void CameraManager::initCamera() {
 	camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
 	camera.yaw = 0.0f;
 	camera.pitch = 0.0f;
+
+	walkingMode = false;
+	collision = nullptr;
+	velocity = glm::vec3(0.0f);
+	onGround = false;
+	toggleKeyDown = false;
 }
 
 // GET PROJECTION INVERSE Z
@@ -45,23 +63,35 @@ void CameraManager::updateCamera(float delta, float width, float height) {
 			cameraSpeed = normalCameraSpeed;
 		}
 
-		if (keys[SDL_SCANCODE_W]) {
-			camera.cameraPosition += glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f) * camera.cameraDirection) * delta * cameraSpeed;
-		}
-		if (keys[SDL_SCANCODE_S]) {
-			camera.cameraPosition -= glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f) * camera.cameraDirection) * delta * cameraSpeed;
-		}
-		if (keys[SDL_SCANCODE_A]) {
-			camera.cameraPosition += glm::normalize(glm::cross(camera.cameraDirection, camera.up)) * delta * cameraSpeed;
-		}
-		if (keys[SDL_SCANCODE_D]) {
-			camera.cameraPosition -= glm::normalize(glm::cross(camera.cameraDirection, camera.up)) * delta * cameraSpeed;
+		if (keys[SDL_SCANCODE_F] && !toggleKeyDown && collision) {
+			walkingMode = !walkingMode;
+			velocity = glm::vec3(0.0f);
+			LOG_INFO(walkingMode ? "Walking mode" : "Flying mode");
 		}
-		if (keys[SDL_SCANCODE_SPACE]) {
-			camera.cameraPosition += glm::normalize(camera.up) * delta * cameraSpeed;
+		toggleKeyDown = keys[SDL_SCANCODE_F];
+
+		if (walkingMode && collision) {
+			updateWalking(delta, keys);
 		}
-		if (keys[SDL_SCANCODE_R]) {
-			camera.cameraPosition -= glm::normalize(camera.up) * delta * cameraSpeed;
+		else {
+			if (keys[SDL_SCANCODE_W]) {
+				camera.cameraPosition += glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f) * camera.cameraDirection) * delta * cameraSpeed;
+			}
+			if (keys[SDL_SCANCODE_S]) {
+				camera.cameraPosition -= glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f) * camera.cameraDirection) * delta * cameraSpeed;
+			}
+			if (keys[SDL_SCANCODE_A]) {
+				camera.cameraPosition += glm::normalize(glm::cross(camera.cameraDirection, camera.up)) * delta * cameraSpeed;
+			}
+			if (keys[SDL_SCANCODE_D]) {
+				camera.cameraPosition -= glm::normalize(glm::cross(camera.cameraDirection, camera.up)) * delta * cameraSpeed;
+			}
+			if (keys[SDL_SCANCODE_SPACE]) {
+				camera.cameraPosition += glm::normalize(camera.up) * delta * cameraSpeed;
+			}
+			if (keys[SDL_SCANCODE_R]) {
+				camera.cameraPosition -= glm::normalize(camera.up) * delta * cameraSpeed;
+			}
 		}
 		if (keys[SDL_SCANCODE_C]) {
 			fov = 30.0f;
@@ -83,6 +113,54 @@ void CameraManager::updateCamera(float delta, float width, float height) {
 	camera.viewProj = camera.proj * camera.view;
 }
 
+// UPDATE WALKING
+void CameraManager::updateWalking(float delta, const uint8_t* keys) {
+	// Long frames would let the player tunnel through the ground
+	delta = std::min(delta, 0.05f);
+
+	glm::vec3 forward = glm::vec3(camera.cameraDirection.x, 0.0f, camera.cameraDirection.z);
+	if (glm::length(forward) > 0.0f) {
+		forward = glm::normalize(forward);
+	}
+	glm::vec3 left = glm::cross(forward, camera.up);
+
+	glm::vec3 wishDirection(0.0f);
+	if (keys[SDL_SCANCODE_W]) wishDirection += forward;
+	if (keys[SDL_SCANCODE_S]) wishDirection -= forward;
+	if (keys[SDL_SCANCODE_A]) wishDirection += left;
+	if (keys[SDL_SCANCODE_D]) wishDirection -= left;
+	if (glm::length(wishDirection) > 0.0f) {
+		wishDirection = glm::normalize(wishDirection);
+	}
+
+	float speed = keys[SDL_SCANCODE_LSHIFT] ? SPRINT_SPEED : WALK_SPEED;
+	velocity.x = wishDirection.x * speed;
+	velocity.z = wishDirection.z * speed;
+
+	// Hold still until the chunk below the player is loaded
+	if (!collision->isChunkLoaded(camera.cameraPosition)) {
+		velocity = glm::vec3(0.0f);
+		return;
+	}
+
+	if (keys[SDL_SCANCODE_SPACE] && onGround) {
+		velocity.y = JUMP_SPEED;
+	}
+	velocity.y = std::max(velocity.y - GRAVITY * delta, -MAX_FALL_SPEED);
+
+	glm::vec3 feet = camera.cameraPosition - glm::vec3(0.0f, PLAYER_EYE_HEIGHT, 0.0f);
+	AABB box;
+	box.min = feet - glm::vec3(PLAYER_WIDTH / 2.0f, 0.0f, PLAYER_WIDTH / 2.0f);
+	box.max = feet + glm::vec3(PLAYER_WIDTH / 2.0f, PLAYER_HEIGHT, PLAYER_WIDTH / 2.0f);
+
+	Collision::MoveResult result = collision->moveBox(box, velocity * delta);
+	camera.cameraPosition += result.movement;
+	onGround = result.onGround;
+	if (result.blocked.y) {
+		velocity.y = 0.0f;
+	}
+}
+
 // EXTRACT FRUSTUM
 void CameraManager::extractFrustum(const glm::mat4& viewProjectionMatrix) {
 	// Left plane
@@ -6,6 +6,8 @@
 #include <SDL.h>
 #include <SDL_vulkan.h>
 
+class Collision;
+
 class CameraManager {
 public:
 
@@ -31,6 +33,10 @@ public:
 
 	void initCamera();
 
+	// Walking mode (toggled with F) moves a player box with gravity through the collision world
+	void setCollision(Collision* collision) { this->collision = collision; }
+	bool walkingMode;
+
 	// https://nlguillemot.wordpress.com/2016/12/07/reversed-z-in-opengl/
 	glm::mat4 getProjectionInverseZ(float fovy, float width, float height, float zNear);
 
@@ -41,6 +47,13 @@ public:
 
 	Frustum frustum;
 
+private:
+	Collision* collision;
+	glm::vec3 velocity;
+	bool onGround;
+	bool toggleKeyDown;
+
+	void updateWalking(float delta, const uint8_t* keys);
 };
 
 #endif // !CAMERA_H
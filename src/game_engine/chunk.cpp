@@ -1,6 +1,8 @@
 #include "chunk.h"
 #include "vertex.h"
+#include <memory>
 #include "../logger.h"
+#include <cstring>
 
 Chunk::Chunk(glm::vec3 position): position(position) {
 	translationMatrix = glm::translate(glm::mat4(1.0f), position);
@@ -12,145 +14,159 @@ Chunk::Chunk(glm::vec3 position): position(position) {
 	chunkRadius = glm::sqrt((CHUNK_SIZE_X * CHUNK_SIZE_X) + (CHUNK_SIZE_Y * CHUNK_SIZE_Y) + (CHUNK_SIZE_Z * CHUNK_SIZE_Z)) / 2.0f;
 
 	vertexAndIndexBufferUploaded = false;
+	modified = false;
+	dirtySections = 0;
+	lodLevel = 0;
+	meshVersion = 0;
+	gpuMeshed = false;
+	for (int section = 0; section < CHUNK_SECTION_COUNT; section++) {
+		sectionBlockCounts[section] = 0;
+	}
+	for (int x = 0; x < CHUNK_SIZE_X; x++) {
+		for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+			solidColumns[x][z] = 0;
+		}
+	}
+	for (int range = 0; range <= MESH_RANGE_COUNT; range++) {
+		meshRangeStart[range] = 0;
+	}
+	translucentSorted = false;
+	clearLight();
 
 	vertexBuffer = VK_NULL_HANDLE;
-	vertexBufferMemory = VK_NULL_HANDLE;
+	vertexBufferAllocation = {};
 	indexBuffer = VK_NULL_HANDLE;
-	indexBufferMemory = VK_NULL_HANDLE;
+	indexBufferAllocation = {};
 }
 
 void Chunk::setBlock(int x, int y, int z, Block block) {
+	bool wasAir = blocks[x][y][z].isAir();
+	if (wasAir != block.isAir()) {
+		if (wasAir) {
+			sectionBlockCounts[y / CHUNK_SECTION_HEIGHT]++;
+			solidColumns[x][z] |= uint64_t(1) << y;
+		}
+		else {
+			sectionBlockCounts[y / CHUNK_SECTION_HEIGHT]--;
+			solidColumns[x][z] &= ~(uint64_t(1) << y);
+		}
+	}
 	blocks[x][y][z] = block;
 }
 
-std::optional<Block> Chunk::getBlock(int x, int y, int z) const {
-	if (x < 0 || x >= CHUNK_SIZE_X || y < 0 || y >= CHUNK_SIZE_Y || z < 0 || z >= CHUNK_SIZE_Z) {
-		return std::nullopt;  // Not in chunk
-	}
-	return blocks[x][y][z];
+void Chunk::clearLight() {
+	memset(light, 0, sizeof(light));
 }
 
-void Chunk::generateChunkMesh() {
-	vertices.clear();
-	indices.clear();
-	vertices.reserve(CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z * 24); // 24 vertices per block
-	indices.reserve(CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z * 36);  // 36 indices per block
-
+void Chunk::updateOccupancy() {
+	for (int section = 0; section < CHUNK_SECTION_COUNT; section++) {
+		sectionBlockCounts[section] = 0;
+	}
 	for (int x = 0; x < CHUNK_SIZE_X; x++) {
-		for (int y = 0; y < CHUNK_SIZE_Y; y++) {
-			for (int z = 0; z < CHUNK_SIZE_Z; z++) {
-
-				if (blocks[x][y][z].type != TYPE_AIR) {
-					
-					loadFacesToMesh(x, y, z);
+		for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+			uint64_t column = 0;
+			for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+				if (!blocks[x][y][z].isAir()) {
+					sectionBlockCounts[y / CHUNK_SECTION_HEIGHT]++;
+					column |= uint64_t(1) << y;
 				}
-
 			}
+			solidColumns[x][z] = column;
 		}
 	}
-
 }
 
-void Chunk::loadFacesToMesh(int x, int y, int z) {
-	Block& block = blocks[x][y][z];
-
-	glm::vec3 blockPos = glm::vec3(x, y, z);
-
-	// FRONT face (positive Z)
-	if (z == CHUNK_SIZE_Z - 1 || (z + 1 < CHUNK_SIZE_Z && blocks[x][y][z + 1].type == TYPE_AIR))
-		addFaceToMesh(blockPos, FaceDirection::FRONT, block.sideTexture);
+std::optional<Block> Chunk::getBlock(int x, int y, int z) const {
+	if (x < 0 || x >= CHUNK_SIZE_X || y < 0 || y >= CHUNK_SIZE_Y || z < 0 || z >= CHUNK_SIZE_Z) {
+		return std::nullopt;  // Not in chunk
+	}
+	return blocks[x][y][z];
+}
 
-	// BACK face (negative Z)
-	if (z == 0 || (z - 1 >= 0 && blocks[x][y][z - 1].type == TYPE_AIR))
-		addFaceToMesh(blockPos, FaceDirection::BACK, block.sideTexture);
+void Chunk::setMesh(std::vector<Vertex>&& meshVertices, std::vector<uint32_t>&& meshIndices, const uint32_t meshRanges[MESH_RANGE_COUNT + 1]) {
+	vertices = std::move(meshVertices);
+	indices = std::move(meshIndices);
+	for (int range = 0; range <= MESH_RANGE_COUNT; range++) {
+		meshRangeStart[range] = meshRanges[range];
+	}
+	translucentSorted = false;
+	gpuMeshed = false;
+}
 
-	// RIGHT face (positive X)
-	if (x == CHUNK_SIZE_X - 1 || (x + 1 < CHUNK_SIZE_X && blocks[x + 1][y][z].type == TYPE_AIR))
-		addFaceToMesh(blockPos, FaceDirection::RIGHT, block.sideTexture);
+void Chunk::setGpuMesh(const uint32_t meshRanges[MESH_RANGE_COUNT + 1]) {
+	vertices.clear();
+	indices.clear();
+	for (int range = 0; range <= MESH_RANGE_COUNT; range++) {
+		meshRangeStart[range] = meshRanges[range];
+	}
+	translucentSorted = false;
+	gpuMeshed = true;
+}
 
-	// LEFT face (negative X)
-	if (x == 0 || (x - 1 >= 0 && blocks[x - 1][y][z].type == TYPE_AIR))
-		addFaceToMesh(blockPos, FaceDirection::LEFT, block.sideTexture);
+bool Chunk::needsTranslucentSort(glm::vec3 cameraPosition, float resortDistance) const {
+	if (!hasTranslucentFaces()) {
+		return false;
+	}
+	glm::vec3 moved = cameraPosition - translucentSortPosition;
+	return !translucentSorted || glm::dot(moved, moved) > resortDistance * resortDistance;
+}
 
-	// TOP face (positive Y)
-	if (y == CHUNK_SIZE_Y - 1 || (y + 1 < CHUNK_SIZE_Y && blocks[x][y + 1][z].type == TYPE_AIR))
-		addFaceToMesh(blockPos, FaceDirection::TOP, block.topTexture);
+void Chunk::sortTranslucentFaces(glm::vec3 cameraPosition) {
+	struct SortQuad {
+		float distance;
+		uint32_t indices[6];
+	};
+	thread_local std::vector<SortQuad> quads;
+
+	glm::vec3 localCamera = cameraPosition - position;
+	for (int section = 0; section < CHUNK_SECTION_COUNT; section++) {
+		uint32_t first = meshRangeStart[translucentRange(section)];
+		uint32_t end = meshRangeStart[translucentRange(section) + 1];
+
+		quads.resize((end - first) / 6);
+		for (size_t quad = 0; quad < quads.size(); quad++) {
+			SortQuad& sortQuad = quads[quad];
+			memcpy(sortQuad.indices, &indices[first + quad * 6], sizeof(sortQuad.indices));
+
+			// The first triangle holds three of the four corners, the middle of its long edge is the quad center
+			glm::vec3 center = (vertices[sortQuad.indices[0]].position + vertices[sortQuad.indices[2]].position) * 0.5f;
+			glm::vec3 toCamera = localCamera - center;
+			sortQuad.distance = glm::dot(toCamera, toCamera);
+		}
 
-	// BOTTOM face (negative Y)
-	if (y == 0 || (y - 1 >= 0 && blocks[x][y - 1][z].type == TYPE_AIR))
-		addFaceToMesh(blockPos, FaceDirection::BOTTOM, block.bottomTexture);
-}
+		// Insertion sort, farthest first
+		for (size_t i = 1; i < quads.size(); i++) {
+			SortQuad quad = quads[i];
+			size_t j = i;
+			while (j > 0 && quads[j - 1].distance < quad.distance) {
+				quads[j] = quads[j - 1];
+				j--;
+			}
+			quads[j] = quad;
+		}
 
-void Chunk::addFaceToMesh(glm::vec3 position, FaceDirection faceDirection, int texIndex) {
-	std::vector<Vertex> faceVertices;
-
-	switch (faceDirection) {
-	case FaceDirection::TOP:
-		faceVertices = {
-			{position + glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec2(0.0f, 1.0f), texIndex},  // Top-left
-			{position + glm::vec3(1, 1, 0), glm::vec3(0, 1, 0), glm::vec2(1.0f, 1.0f), texIndex},  // Top-right
-			{position + glm::vec3(1, 1, 1), glm::vec3(0, 1, 0), glm::vec2(1.0f, 0.0f), texIndex},  // Bottom-right
-			{position + glm::vec3(0, 1, 1), glm::vec3(0, 1, 0), glm::vec2(0.0f, 0.0f), texIndex}   // Bottom-left
-		};
-		break;
-
-	case FaceDirection::BOTTOM:
-		faceVertices = {
-			{position + glm::vec3(0, 0, 0), glm::vec3(0, -1, 0), glm::vec2(0.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 0, 0), glm::vec3(0, -1, 0), glm::vec2(1.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 0, 1), glm::vec3(0, -1, 0), glm::vec2(1.0f, 0.0f), texIndex},
-			{position + glm::vec3(0, 0, 1), glm::vec3(0, -1, 0), glm::vec2(0.0f, 0.0f), texIndex}
-		};
-		break;
-
-	case FaceDirection::FRONT:
-		faceVertices = {
-			{position + glm::vec3(0, 0, 1), glm::vec3(0, 0, 1), glm::vec2(0.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 0, 1), glm::vec3(0, 0, 1), glm::vec2(1.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 1, 1), glm::vec3(0, 0, 1), glm::vec2(1.0f, 0.0f), texIndex},
-			{position + glm::vec3(0, 1, 1), glm::vec3(0, 0, 1), glm::vec2(0.0f, 0.0f), texIndex}
-		};
-		break;
-
-	case FaceDirection::BACK:
-		faceVertices = {
-			{position + glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec2(0.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec2(1.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 1, 0), glm::vec3(0, 0, -1), glm::vec2(1.0f, 0.0f), texIndex},
-			{position + glm::vec3(0, 1, 0), glm::vec3(0, 0, -1), glm::vec2(0.0f, 0.0f), texIndex}
-		};
-		break;
-
-	case FaceDirection::LEFT:
-		faceVertices = {
-			{position + glm::vec3(0, 0, 0), glm::vec3(-1, 0, 0), glm::vec2(0.0f, 1.0f), texIndex},
-			{position + glm::vec3(0, 0, 1), glm::vec3(-1, 0, 0), glm::vec2(1.0f, 1.0f), texIndex},
-			{position + glm::vec3(0, 1, 1), glm::vec3(-1, 0, 0), glm::vec2(1.0f, 0.0f), texIndex},
-			{position + glm::vec3(0, 1, 0), glm::vec3(-1, 0, 0), glm::vec2(0.0f, 0.0f), texIndex}
-		};
-		break;
-
-	case FaceDirection::RIGHT:
-		faceVertices = {
-			{position + glm::vec3(1, 0, 0), glm::vec3(1, 0, 0), glm::vec2(0.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 0, 1), glm::vec3(1, 0, 0), glm::vec2(1.0f, 1.0f), texIndex},
-			{position + glm::vec3(1, 1, 1), glm::vec3(1, 0, 0), glm::vec2(1.0f, 0.0f), texIndex},
-			{position + glm::vec3(1, 1, 0), glm::vec3(1, 0, 0), glm::vec2(0.0f, 0.0f), texIndex}
-		};
-		break;
+		for (size_t quad = 0; quad < quads.size(); quad++) {
+			memcpy(&indices[first + quad * 6], quads[quad].indices, sizeof(quads[quad].indices));
+		}
 	}
 
-	for (const auto& vertex : faceVertices) {
-		vertices.push_back(vertex);
-	}
+	translucentSorted = true;
+	translucentSortPosition = cameraPosition;
+}
 
-	int startIndex = vertices.size() - 4;
-	indices.push_back(startIndex + 0);
-	indices.push_back(startIndex + 1);
-	indices.push_back(startIndex + 2);
-	indices.push_back(startIndex + 2);
-	indices.push_back(startIndex + 3);
-	indices.push_back(startIndex + 0);
+uint8_t Chunk::getVisibleFaceMask(glm::vec3 cameraPosition) const {
+	// A face is seen from the side its normal points to, so a direction is only needed
+	// if the camera is past the plane of the chunk's first face of that direction
+	glm::vec3 minCorner = position;
+	glm::vec3 maxCorner = position + glm::vec3(CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z);
+	uint8_t mask = 0;
+	if (cameraPosition.z > minCorner.z) mask |= 1 << FRONT;
+	if (cameraPosition.z < maxCorner.z) mask |= 1 << BACK;
+	if (cameraPosition.x < maxCorner.x) mask |= 1 << LEFT;
+	if (cameraPosition.x > minCorner.x) mask |= 1 << RIGHT;
+	if (cameraPosition.y > minCorner.y) mask |= 1 << TOP;
+	if (cameraPosition.y < maxCorner.y) mask |= 1 << BOTTOM;
+	return mask;
 }
 
 void Chunk::cleanup() {
@@ -3,12 +3,38 @@
 
 #include "vertex.h"
 #include "block.h"
+#include "../vulkan_allocator.h"
 #include <optional>
+#include <utility>
+#include <functional>
 
 // const chunk constants
 const int CHUNK_SIZE_X = 16;
 const int CHUNK_SIZE_Y = 64;
 const int CHUNK_SIZE_Z = 16;
+const int CHUNK_BLOCK_COUNT = CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z;
+
+// Chunks are split vertically into sections for edit tracking
+const int CHUNK_SECTION_HEIGHT = 16;
+const int CHUNK_SECTION_COUNT = CHUNK_SIZE_Y / CHUNK_SECTION_HEIGHT;
+static_assert(CHUNK_SECTION_COUNT <= 8, "dirtySections is a uint8_t mask");
+static_assert(CHUNK_SIZE_Y <= 64, "solid columns are uint64_t masks");
+
+const uint8_t MAX_LIGHT_LEVEL = 15;
+
+// Division rounding towards negative infinity, maps world to chunk coordinates
+inline int floorDiv(int value, int divisor) {
+	return value >= 0 ? value / divisor : (value + 1) / divisor - 1;
+}
+
+struct pair_hash {
+	template <class T1, class T2>
+	std::size_t operator () (const std::pair<T1, T2>& pair) const {
+		auto hash1 = std::hash<T1>{}(pair.first);
+		auto hash2 = std::hash<T2>{}(pair.second);
+		return hash1 ^ hash2;
+	}
+};
 
 class Chunk {
 public:
@@ -41,12 +67,13 @@ public:
 		TOP = 4,
 		BOTTOM = 5,
 	};
+	static const int FACE_DIRECTION_COUNT = 6;
 
-	struct DeferredFace {
-		glm::vec3 position;
-		FaceDirection direction;
-		int textureIndex;
-	};
+	// The mesh is split into index ranges, range r uses the indices from getMeshRangeStart(r) to getMeshRangeStart(r + 1).
+	// Opaque and cutout faces are grouped by direction, translucent faces by section so they can be sorted back to front.
+	static const int MESH_RANGE_COUNT = 2 * FACE_DIRECTION_COUNT + CHUNK_SECTION_COUNT;
+	static int faceRange(Block::RenderLayer layer, int direction) { return layer * FACE_DIRECTION_COUNT + direction; }
+	static int translucentRange(int section) { return 2 * FACE_DIRECTION_COUNT + section; }
 
 	glm::vec3 position;
 	glm::mat4 translationMatrix;
@@ -55,37 +82,84 @@ public:
 	glm::mat4 modelMatrix;
 
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	VulkanAllocation vertexBufferAllocation;
 
 	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	VulkanAllocation indexBufferAllocation;
 
 	bool vertexAndIndexBufferUploaded;
 
+	// Edited since it was generated or last saved
+	bool modified;
+
+	// Sections whose mesh is out of date (bit per section)
+	uint8_t dirtySections;
+
+	// Level of detail the chunk is meshed at, 0 is full resolution, every level halves it
+	uint8_t lodLevel;
+
+	// Changes with every remesh, a GPU mesh that finishes for an older version is dropped
+	uint32_t meshVersion;
+	// The mesh only exists in the vertex and index buffers, written by the GPU mesher
+	bool gpuMeshed;
+
 	glm::vec3 chunkCenter;
 	float chunkRadius;
 
-	void generateChunkMesh();
-
 	void setBlock(int x, int y, int z, Block block);
 	std::optional<Block> getBlock(int x, int y, int z) const;
 
+	// Non-air blocks per section and solid bits per column (bit y), kept up to date by setBlock.
+	// Call updateOccupancy after writing through getBlockData.
+	void updateOccupancy();
+	bool isSectionEmpty(int section) const { return sectionBlockCounts[section] == 0; }
+	uint64_t getSolidColumn(int x, int z) const { return solidColumns[x][z]; }
+
+	// LIGHT (4 bit skylight in the high nibble, 4 bit block light in the low nibble)
+	uint8_t getSkyLight(int x, int y, int z) const { return light[x][y][z] >> 4; }
+	uint8_t getBlockLight(int x, int y, int z) const { return light[x][y][z] & 0x0F; }
+	void setSkyLight(int x, int y, int z, uint8_t level) { light[x][y][z] = uint8_t((light[x][y][z] & 0x0F) | (level << 4)); }
+	void setBlockLight(int x, int y, int z, uint8_t level) { light[x][y][z] = uint8_t((light[x][y][z] & 0xF0) | level); }
+	void clearLight();
+	// Raw access to the light array, same layout as the blocks
+	const uint8_t* getLightData() const { return &light[0][0][0]; }
+
+	// Raw access to the block array, laid out as [x][y][z]
+	static int blockIndex(int x, int y, int z) { return (x * CHUNK_SIZE_Y + y) * CHUNK_SIZE_Z + z; }
+	Block* getBlockData() { return &blocks[0][0][0]; }
+	const Block* getBlockData() const { return &blocks[0][0][0]; }
+
 	const std::vector<Vertex>& getVertices() const { return vertices; }
 	const std::vector<uint32_t>& getIndices() const { return indices; }
+	uint32_t getMeshRangeStart(int range) const { return meshRangeStart[range]; }
+	// Takes over a mesh built by the ChunkMesher
+	void setMesh(std::vector<Vertex>&& meshVertices, std::vector<uint32_t>&& meshIndices, const uint32_t meshRanges[MESH_RANGE_COUNT + 1]);
+	// Mesh written into the buffers by the GPU mesher, only the ranges are kept
+	void setGpuMesh(const uint32_t meshRanges[MESH_RANGE_COUNT + 1]);
 
-	void cleanup();
+	// Directions whose faces can point towards the camera (bit per FaceDirection)
+	uint8_t getVisibleFaceMask(glm::vec3 cameraPosition) const;
 
-	void addFaceToMesh(glm::vec3 position, FaceDirection faceDirection, int texIndex);
+	// Translucent faces are sorted back to front for the camera position they were last sorted for.
+	// Sorting starts from the previous order, so small camera moves are close to linear.
+	bool hasTranslucentFaces() const { return meshRangeStart[MESH_RANGE_COUNT] > meshRangeStart[translucentRange(0)]; }
+	bool needsTranslucentSort(glm::vec3 cameraPosition, float resortDistance) const;
+	void sortTranslucentFaces(glm::vec3 cameraPosition);
 
-	std::vector<DeferredFace> deferredFaces;
+	void cleanup();
 
 private:
 	Block blocks[CHUNK_SIZE_X][CHUNK_SIZE_Y][CHUNK_SIZE_Z];
+	uint16_t sectionBlockCounts[CHUNK_SECTION_COUNT];
+	uint64_t solidColumns[CHUNK_SIZE_X][CHUNK_SIZE_Z];
+	uint8_t light[CHUNK_SIZE_X][CHUNK_SIZE_Y][CHUNK_SIZE_Z];
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
-	
-	void loadFacesToMesh(int x, int y, int z);
+	uint32_t meshRangeStart[MESH_RANGE_COUNT + 1];
+
+	bool translucentSorted;
+	glm::vec3 translucentSortPosition;
 };
 
 #endif // CHUNK_H
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "chunkcache.h"
+#include "chunkcodec.h"
+
+ChunkCache::ChunkCache(size_t memoryBudget) : memoryBudget(memoryBudget), memoryUsage(0) {}
+
+void ChunkCache::setMemoryBudget(size_t bytes) {
+	memoryBudget = bytes;
+	evict();
+}
+
+void ChunkCache::store(int chunkX, int chunkZ, const Chunk& chunk) {
+	std::pair<int, int> coords = { chunkX, chunkZ };
+	auto found = lookup.find(coords);
+	if (found != lookup.end()) {
+		erase(found->second);
+	}
+
+	Entry entry;
+	entry.coords = coords;
+	ChunkCodec::encode(chunk.getBlockData(), entry.data);
+	entry.data.shrink_to_fit();
+
+	size_t size = entrySize(entry);
+	if (size > memoryBudget) {
+		return;
+	}
+
+	entries.push_front(std::move(entry));
+	lookup[coords] = entries.begin();
+	memoryUsage += size;
+	evict();
+}
+
+bool ChunkCache::take(int chunkX, int chunkZ, Chunk& chunk) {
+	auto found = lookup.find({ chunkX, chunkZ });
+	if (found == lookup.end()) {
+		return false;
+	}
+
+	const Entry& entry = *found->second;
+	bool decoded = ChunkCodec::decode(entry.data.data(), entry.data.size(), chunk.getBlockData());
+	erase(found->second);
+	return decoded;
+}
+
+void ChunkCache::clear() {
+	entries.clear();
+	lookup.clear();
+	memoryUsage = 0;
+}
+
+void ChunkCache::erase(std::list<Entry>::iterator it) {
+	memoryUsage -= entrySize(*it);
+	lookup.erase(it->coords);
+	entries.erase(it);
+}
+
+void ChunkCache::evict() {
+	while (memoryUsage > memoryBudget && !entries.empty()) {
+		erase(std::prev(entries.end()));
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "chunk.h"
+
+// LRU cache of compressed voxel data for chunks that were unloaded.
+// Entries are evicted oldest first once the memory budget is exceeded.
+class ChunkCache {
+public:
+	ChunkCache(size_t memoryBudget = 32 * 1024 * 1024);
+
+	void setMemoryBudget(size_t bytes);
+	size_t getMemoryBudget() const { return memoryBudget; }
+	size_t getMemoryUsage() const { return memoryUsage; }
+	size_t getEntryCount() const { return lookup.size(); }
+
+	void store(int chunkX, int chunkZ, const Chunk& chunk);
+
+	// Decodes a cached chunk into chunk and removes it from the cache
+	bool take(int chunkX, int chunkZ, Chunk& chunk);
+
+	void clear();
+
+private:
+	struct Entry {
+		std::pair<int, int> coords;
+		std::vector<uint8_t> data;
+	};
+
+	size_t entrySize(const Entry& entry) const { return sizeof(Entry) + entry.data.capacity(); }
+	void erase(std::list<Entry>::iterator it);
+	void evict();
+
+	size_t memoryBudget;
+	size_t memoryUsage;
+
+	// Front is the most recently stored chunk
+	std::list<Entry> entries;
+	std::unordered_map<std::pair<int, int>, std::list<Entry>::iterator, pair_hash> lookup;
+};
+
+#endif // !CHUNKCACHE_H
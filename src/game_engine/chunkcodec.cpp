@@ -0,0 +1,110 @@
+#include "chunkcodec.h"
+
+static uint32_t packBlock(const Block& block) {
+	return block.type | (block.topTexture << 8) | (block.sideTexture << 16) | (uint32_t(block.bottomTexture) << 24);
+}
+
+void ChunkCodec::writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+	while (value >= 0x80) {
+		out.push_back(uint8_t(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+bool ChunkCodec::readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 32 && data < end; shift += 7) {
+		uint8_t byte = *data++;
+		value |= uint32_t(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ChunkCodec::encode(const Block* blocks, std::vector<uint8_t>& out) {
+	// Build the palette and remap every block to its palette index (y outermost)
+	std::vector<uint32_t> palette;
+	std::vector<uint16_t> indices(CHUNK_BLOCK_COUNT);
+	int cursor = 0;
+	uint32_t lastKey = 0;
+	uint16_t lastIndex = 0;
+	for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+		for (int x = 0; x < CHUNK_SIZE_X; x++) {
+			for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+				uint32_t key = packBlock(blocks[Chunk::blockIndex(x, y, z)]);
+				if (palette.empty() || key != lastKey) {
+					size_t i = 0;
+					while (i < palette.size() && palette[i] != key) i++;
+					if (i == palette.size()) palette.push_back(key);
+					lastKey = key;
+					lastIndex = uint16_t(i);
+				}
+				indices[cursor++] = lastIndex;
+			}
+		}
+	}
+
+	out.clear();
+	out.push_back(uint8_t(palette.size()));
+	out.push_back(uint8_t(palette.size() >> 8));
+	for (uint32_t key : palette) {
+		out.push_back(uint8_t(key));
+		out.push_back(uint8_t(key >> 8));
+		out.push_back(uint8_t(key >> 16));
+		out.push_back(uint8_t(key >> 24));
+	}
+
+	bool wideIndices = palette.size() > 256;
+	int i = 0;
+	while (i < CHUNK_BLOCK_COUNT) {
+		int runStart = i;
+		while (i < CHUNK_BLOCK_COUNT && indices[i] == indices[runStart]) i++;
+		writeVarint(out, uint32_t(i - runStart));
+		out.push_back(uint8_t(indices[runStart]));
+		if (wideIndices) out.push_back(uint8_t(indices[runStart] >> 8));
+	}
+}
+
+bool ChunkCodec::decode(const uint8_t* data, size_t size, Block* blocks) {
+	const uint8_t* end = data + size;
+	if (size < 2) return false;
+
+	uint32_t paletteCount = data[0] | (data[1] << 8);
+	data += 2;
+	if (paletteCount == 0 || size_t(end - data) < paletteCount * 4) return false;
+
+	std::vector<Block> palette(paletteCount);
+	for (uint32_t i = 0; i < paletteCount; i++) {
+		palette[i] = Block(data[0], data[1], data[2], data[3]);
+		data += 4;
+	}
+
+	bool wideIndices = paletteCount > 256;
+	int x = 0, y = 0, z = 0;
+	int remaining = CHUNK_BLOCK_COUNT;
+	while (remaining > 0) {
+		uint32_t runLength;
+		if (!readVarint(data, end, runLength) || runLength == 0 || runLength > uint32_t(remaining)) return false;
+		if (end - data < (wideIndices ? 2 : 1)) return false;
+		uint32_t index = *data++;
+		if (wideIndices) index |= *data++ << 8;
+		if (index >= paletteCount) return false;
+
+		const Block& block = palette[index];
+		remaining -= runLength;
+		while (runLength--) {
+			blocks[Chunk::blockIndex(x, y, z)] = block;
+			if (++z == CHUNK_SIZE_Z) {
+				z = 0;
+				if (++x == CHUNK_SIZE_X) {
+					x = 0;
+					y++;
+				}
+			}
+		}
+	}
+	return data == end;
+}
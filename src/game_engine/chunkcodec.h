@@ -0,0 +1,27 @@
+#ifndef CHUNKCODEC_H
+#define CHUNKCODEC_H
+
+#include <cstdint>
+#include <vector>
+#include "chunk.h"
+
+// Compresses the voxel data of a chunk with a block palette followed by
+// run-length encoded palette indices. Blocks are walked layer by layer (y outermost),
+// so the layered terrain collapses into a handful of long runs.
+//
+// Layout:
+//   uint16 paletteCount
+//   paletteCount * 4 bytes (type, topTexture, sideTexture, bottomTexture)
+//   runs until CHUNK_BLOCK_COUNT blocks are covered:
+//     varint runLength, palette index (1 byte, 2 bytes if paletteCount > 256)
+class ChunkCodec {
+public:
+	static void encode(const Block* blocks, std::vector<uint8_t>& out);
+	static bool decode(const uint8_t* data, size_t size, Block* blocks);
+
+	// LEB128 helpers, shared with the save formats
+	static void writeVarint(std::vector<uint8_t>& out, uint32_t value);
+	static bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value);
+};
+
+#endif // !CHUNKCODEC_H
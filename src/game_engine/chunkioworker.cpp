@@ -0,0 +1,124 @@
+#include "chunkioworker.h"
+#include "../logger.h"
+#include <algorithm>
+#include <cstring>
+
+ChunkIOWorker::ChunkIOWorker(const std::string& worldDirectory, WorldStorage::SaveMode saveMode, const WorldStorage::Terrain& terrain)
+	: storage(worldDirectory, saveMode, terrain), stopping(false) {
+	thread = std::thread(&ChunkIOWorker::run, this);
+}
+
+ChunkIOWorker::~ChunkIOWorker() {
+	shutdown();
+}
+
+void ChunkIOWorker::requestLoad(int chunkX, int chunkZ) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingLoads.push_back({ chunkX, chunkZ });
+	}
+	wakeUp.notify_one();
+}
+
+void ChunkIOWorker::requestStore(int chunkX, int chunkZ, const Chunk& chunk) {
+	const Block* blocks = chunk.getBlockData();
+	std::vector<Block> snapshot(blocks, blocks + CHUNK_BLOCK_COUNT);
+	{
+		// A newer snapshot of the same chunk simply replaces the queued one
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingStores[{ chunkX, chunkZ }] = std::move(snapshot);
+	}
+	wakeUp.notify_one();
+}
+
+bool ChunkIOWorker::takeLoaded(std::vector<LoadResult>& results) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (finishedLoads.empty()) {
+		return false;
+	}
+	for (LoadResult& result : finishedLoads) {
+		results.push_back(std::move(result));
+	}
+	finishedLoads.clear();
+	return true;
+}
+
+void ChunkIOWorker::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_one();
+	if (thread.joinable()) {
+		thread.join();
+	}
+	storage.close();
+}
+
+void ChunkIOWorker::run() {
+	std::deque<std::pair<int, int>> loads;
+	std::unordered_map<std::pair<int, int>, std::vector<Block>, pair_hash> stores;
+	std::vector<LoadResult> loaded;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] { return stopping || !pendingLoads.empty() || !pendingStores.empty(); });
+			if (pendingLoads.empty() && pendingStores.empty()) {
+				return; // Stopping and nothing left to write
+			}
+			loads.swap(pendingLoads);
+			stores.swap(pendingStores);
+		}
+
+		// LOADS FIRST, THE RENDER THREAD IS WAITING FOR THEM
+		for (const std::pair<int, int>& coords : loads) {
+			LoadResult result = { coords.first, coords.second, nullptr };
+			std::unique_ptr<Chunk> chunk = std::make_unique<Chunk>(glm::vec3(coords.first * CHUNK_SIZE_X, 0, coords.second * CHUNK_SIZE_Z));
+
+			// A store of this chunk that is not written yet is newer than the file
+			auto store = stores.find(coords);
+			if (store != stores.end()) {
+				memcpy(chunk->getBlockData(), store->second.data(), sizeof(Block) * CHUNK_BLOCK_COUNT);
+				result.chunk = std::move(chunk);
+			}
+			else if (storage.loadChunk(coords.first, coords.second, chunk->getBlockData())) {
+				result.chunk = std::move(chunk);
+			}
+			loaded.push_back(std::move(result));
+		}
+		loads.clear();
+
+		if (!loaded.empty()) {
+			std::lock_guard<std::mutex> lock(mutex);
+			for (LoadResult& result : loaded) {
+				finishedLoads.push_back(std::move(result));
+			}
+		}
+		loaded.clear();
+
+		// STORES, GROUPED BY REGION FILE
+		if (!stores.empty()) {
+			std::vector<std::pair<int, int>> order;
+			order.reserve(stores.size());
+			for (auto& store : stores) {
+				order.push_back(store.first);
+			}
+			std::sort(order.begin(), order.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+				int regionAX = RegionFile::toRegionCoord(a.first), regionBX = RegionFile::toRegionCoord(b.first);
+				if (regionAX != regionBX) return regionAX < regionBX;
+				int regionAZ = RegionFile::toRegionCoord(a.second), regionBZ = RegionFile::toRegionCoord(b.second);
+				if (regionAZ != regionBZ) return regionAZ < regionBZ;
+				return a < b;
+			});
+
+			for (const std::pair<int, int>& coords : order) {
+				if (!storage.saveChunk(coords.first, coords.second, stores[coords].data())) {
+					LOG_ERROR("Could not save chunk ", coords.first, ", ", coords.second);
+				}
+			}
+			storage.flush();
+			stores.clear();
+		}
+	}
+}
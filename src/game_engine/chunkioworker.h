@@ -0,0 +1,52 @@
+#ifndef CHUNKIOWORKER_H
+#define CHUNKIOWORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "chunk.h"
+#include "worldstorage.h"
+
+// Runs all region file reads and writes on its own thread.
+// Repeated stores of the same chunk are coalesced so only the newest data is written,
+// and every batch of stores is written region by region.
+class ChunkIOWorker {
+public:
+	struct LoadResult {
+		int chunkX, chunkZ;
+		std::unique_ptr<Chunk> chunk; // nullptr if the chunk was never saved
+	};
+
+	ChunkIOWorker(const std::string& worldDirectory, WorldStorage::SaveMode saveMode, const WorldStorage::Terrain& terrain);
+	~ChunkIOWorker();
+
+	void requestLoad(int chunkX, int chunkZ);
+	void requestStore(int chunkX, int chunkZ, const Chunk& chunk);
+
+	// Moves finished loads into results, returns false if there were none
+	bool takeLoaded(std::vector<LoadResult>& results);
+
+	// Writes everything still queued and stops the thread
+	void shutdown();
+
+private:
+	void run();
+
+	WorldStorage storage; // Only touched by the worker thread
+
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stopping;
+
+	std::deque<std::pair<int, int>> pendingLoads;
+	std::unordered_map<std::pair<int, int>, std::vector<Block>, pair_hash> pendingStores;
+	std::vector<LoadResult> finishedLoads;
+
+	std::thread thread;
+};
+
+#endif // !CHUNKIOWORKER_H
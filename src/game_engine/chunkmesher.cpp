@@ -0,0 +1,425 @@
+#include "chunkmesher.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace {
+
+struct FaceCorner {
+	int position[3];
+	float texCoord[2];
+	// Side and diagonal voxels in front of the face that darken this corner
+	int sideU[3];
+	int sideV[3];
+	int diagonal[3];
+};
+
+struct FaceTable {
+	int normal[3];
+	FaceCorner corners[4]; // Around the quad
+};
+
+constexpr FaceTable makeFace(int nx, int ny, int nz, const int (&positions)[4][3]) {
+	FaceTable face = {};
+	int normal[3] = { nx, ny, nz };
+	int normalAxis = nx != 0 ? 0 : (ny != 0 ? 1 : 2);
+	int axisU = (normalAxis + 1) % 3;
+	int axisV = (normalAxis + 2) % 3;
+	const float texCoords[4][2] = { { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f }, { 0.0f, 0.0f } };
+
+	for (int axis = 0; axis < 3; axis++) {
+		face.normal[axis] = normal[axis];
+	}
+	for (int i = 0; i < 4; i++) {
+		FaceCorner& corner = face.corners[i];
+		int stepU = positions[i][axisU] ? 1 : -1;
+		int stepV = positions[i][axisV] ? 1 : -1;
+		for (int axis = 0; axis < 3; axis++) {
+			corner.position[axis] = positions[i][axis];
+			corner.sideU[axis] = normal[axis] + (axis == axisU ? stepU : 0);
+			corner.sideV[axis] = normal[axis] + (axis == axisV ? stepV : 0);
+			corner.diagonal[axis] = normal[axis] + (axis == axisU ? stepU : 0) + (axis == axisV ? stepV : 0);
+		}
+		corner.texCoord[0] = texCoords[i][0];
+		corner.texCoord[1] = texCoords[i][1];
+	}
+	return face;
+}
+
+// Indexed by Chunk::FaceDirection
+constexpr FaceTable FACES[6] = {
+	makeFace(0, 0, 1, { { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } }),   // FRONT
+	makeFace(0, 0, -1, { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 } }),  // BACK
+	makeFace(-1, 0, 0, { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 } }),  // LEFT
+	makeFace(1, 0, 0, { { 1, 0, 0 }, { 1, 0, 1 }, { 1, 1, 1 }, { 1, 1, 0 } }),   // RIGHT
+	makeFace(0, 1, 0, { { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 } }),   // TOP
+	makeFace(0, -1, 0, { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 } })   // BOTTOM
+};
+
+static_assert(Chunk::FRONT == 0 && Chunk::BACK == 1 && Chunk::LEFT == 2 && Chunk::RIGHT == 3 && Chunk::TOP == 4 && Chunk::BOTTOM == 5,
+	"FACES is indexed by FaceDirection");
+
+const int MAX_CELL_SIZE = 1 << (ChunkMesher::LOD_LEVEL_COUNT - 1);
+static_assert(CHUNK_SIZE_X % MAX_CELL_SIZE == 0 && CHUNK_SIZE_Y % MAX_CELL_SIZE == 0 && CHUNK_SIZE_Z % MAX_CELL_SIZE == 0,
+	"Every level of detail has to split the chunk into whole cells");
+
+// Covers the largest step between the surfaces of two levels
+const int SKIRT_DEPTH = MAX_CELL_SIZE;
+
+// Enough for typical terrain, grows (and stays grown) for anything busier
+const size_t INITIAL_SCRATCH_FACES = 16384;
+
+const int OPEN_AO[4] = { 3, 3, 3, 3 };
+
+int faceTexture(const Block& block, int direction) {
+	return direction == Chunk::TOP ? block.topTexture : (direction == Chunk::BOTTOM ? block.bottomTexture : block.sideTexture);
+}
+
+// Corner positions are whole numbers, they order the quads of a range
+bool quadLess(const Vertex* a, const Vertex* b) {
+	for (int i = 0; i < 4; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			if (a[i].position[axis] != b[i].position[axis]) {
+				return a[i].position[axis] < b[i].position[axis];
+			}
+		}
+	}
+	return false;
+}
+
+bool sameVertex(const Vertex& a, const Vertex& b) {
+	const float epsilon = 1e-4f;
+	return a.position == b.position && a.normal == b.normal && a.texCoord == b.texCoord && a.texIndex == b.texIndex
+		&& fabs(a.light.x - b.light.x) < epsilon && fabs(a.light.y - b.light.y) < epsilon && fabs(a.ao - b.ao) < epsilon;
+}
+
+}
+
+ChunkMesher::Scratch& ChunkMesher::getScratch() {
+	thread_local Scratch scratch = {
+		std::vector<Vertex>(INITIAL_SCRATCH_FACES * 4),
+		std::vector<uint32_t>(INITIAL_SCRATCH_FACES * 6),
+		std::vector<uint8_t>(INITIAL_SCRATCH_FACES),
+		0, 0, {}
+	};
+	return scratch;
+}
+
+PaddedChunk& ChunkMesher::getScratchPadding() {
+	thread_local std::unique_ptr<PaddedChunk> padded = std::make_unique<PaddedChunk>();
+	return *padded;
+}
+
+void ChunkMesher::reserveQuads(Scratch& scratch, size_t quadCount) {
+	while (scratch.vertexCount + quadCount * 4 > scratch.vertices.size()) {
+		scratch.vertices.resize(scratch.vertices.size() * 2);
+		scratch.indices.resize(scratch.indices.size() * 2);
+		scratch.quadRanges.resize(scratch.quadRanges.size() * 2);
+	}
+}
+
+void ChunkMesher::buildMesh(const PaddedChunk& padded, int lodLevel, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	uint32_t meshRanges[Chunk::MESH_RANGE_COUNT + 1]) {
+	Scratch& scratch = getScratch();
+	scratch.vertexCount = 0;
+	scratch.indexCount = 0;
+
+	CellGrid grid;
+	if (lodLevel == 0) {
+		addVoxelFaces(padded, scratch);
+		grid = { padded.getBlockData(), 1, CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z };
+	}
+	else {
+		grid = downsample(padded, 1 << lodLevel, scratch);
+		addCellFaces(padded, grid, scratch);
+	}
+	addSkirts(padded, grid, lodLevel, scratch);
+
+	// One copy into exactly sized storage, sorted into the mesh ranges on the way
+	size_t quadCount = scratch.vertexCount / 4;
+	uint32_t nextQuad[Chunk::MESH_RANGE_COUNT] = {};
+	for (size_t quad = 0; quad < quadCount; quad++) {
+		nextQuad[scratch.quadRanges[quad]]++;
+	}
+	meshRanges[0] = 0;
+	for (int range = 0; range < Chunk::MESH_RANGE_COUNT; range++) {
+		uint32_t count = nextQuad[range];
+		nextQuad[range] = meshRanges[range] / 6;
+		meshRanges[range + 1] = meshRanges[range] + count * 6;
+	}
+
+	vertices.clear();
+	vertices.resize(scratch.vertexCount);
+	indices.clear();
+	indices.resize(scratch.indexCount);
+	for (size_t quad = 0; quad < quadCount; quad++) {
+		uint32_t target = nextQuad[scratch.quadRanges[quad]]++;
+		std::copy_n(&scratch.vertices[quad * 4], 4, &vertices[target * 4]);
+		uint32_t offset = target * 4 - uint32_t(quad * 4);
+		for (int i = 0; i < 6; i++) {
+			indices[target * 6 + i] = scratch.indices[quad * 6 + i] + offset;
+		}
+	}
+}
+
+void ChunkMesher::addVoxelFaces(const PaddedChunk& padded, Scratch& scratch) {
+	for (int x = 0; x < CHUNK_SIZE_X; x++) {
+		for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+			for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+				const Block& block = padded.getBlock(x, y, z);
+				if (block.isAir()) {
+					continue;
+				}
+				reserveQuads(scratch, 6);
+
+				bool translucent = block.getRenderLayer() == Block::LAYER_TRANSLUCENT;
+				glm::ivec3 position(x, y, z);
+				for (int direction = 0; direction < 6; direction++) {
+					const int* normal = FACES[direction].normal;
+					int frontX = x + normal[0], frontY = y + normal[1], frontZ = z + normal[2];
+
+					// Bottom faces are never seen from below the world
+					if (frontY < 0 || padded.hidesFace(frontX, frontY, frontZ)) {
+						continue;
+					}
+					// No walls inside a body of the same translucent block
+					if (translucent && frontY < CHUNK_SIZE_Y && padded.getBlock(frontX, frontY, frontZ).type == block.type) {
+						continue;
+					}
+
+					addFace(padded, position, block, Chunk::FaceDirection(direction), padded.getFaceLight(frontX, frontY, frontZ), scratch);
+				}
+			}
+		}
+	}
+}
+
+ChunkMesher::CellGrid ChunkMesher::downsample(const PaddedChunk& padded, int cellSize, Scratch& scratch) {
+	CellGrid grid = { nullptr, cellSize, CHUNK_SIZE_X / cellSize, CHUNK_SIZE_Y / cellSize, CHUNK_SIZE_Z / cellSize };
+	scratch.cells.assign(size_t(grid.countX + 2) * grid.countY * (grid.countZ + 2), AIR);
+
+	for (int cellX = -1; cellX <= grid.countX; cellX++) {
+		for (int cellZ = -1; cellZ <= grid.countZ; cellZ++) {
+			bool borderX = cellX < 0 || cellX == grid.countX;
+			bool borderZ = cellZ < 0 || cellZ == grid.countZ;
+			if (borderX && borderZ) {
+				continue; // Corners are never looked at
+			}
+
+			// Border cells only have the one block thick slice of the neighbor
+			int fromX = borderX ? (cellX < 0 ? -1 : CHUNK_SIZE_X) : cellX * cellSize;
+			int toX = borderX ? fromX : fromX + cellSize - 1;
+			int fromZ = borderZ ? (cellZ < 0 ? -1 : CHUNK_SIZE_Z) : cellZ * cellSize;
+			int toZ = borderZ ? fromZ : fromZ + cellSize - 1;
+
+			for (int cellY = 0; cellY < grid.countY; cellY++) {
+				int solidCount = 0;
+				int totalCount = 0;
+				const Block* top = nullptr;
+				for (int y = cellY * cellSize + cellSize - 1; y >= cellY * cellSize; y--) {
+					for (int x = fromX; x <= toX; x++) {
+						for (int z = fromZ; z <= toZ; z++) {
+							const Block& block = padded.getBlock(x, y, z);
+							totalCount++;
+							if (!block.isAir()) {
+								solidCount++;
+								if (!top) {
+									top = &block;
+								}
+							}
+						}
+					}
+				}
+
+				if (solidCount * 2 >= totalCount) {
+					scratch.cells[((cellX + 1) * grid.countY + cellY) * (grid.countZ + 2) + cellZ + 1] = *top;
+				}
+			}
+		}
+	}
+
+	grid.cells = scratch.cells.data();
+	return grid;
+}
+
+void ChunkMesher::addCellFaces(const PaddedChunk& padded, const CellGrid& grid, Scratch& scratch) {
+	int size = grid.cellSize;
+	for (int x = 0; x < grid.countX; x++) {
+		for (int y = 0; y < grid.countY; y++) {
+			for (int z = 0; z < grid.countZ; z++) {
+				const Block& block = grid.get(x, y, z);
+				if (block.isAir()) {
+					continue;
+				}
+				reserveQuads(scratch, 6);
+
+				glm::ivec3 origin = glm::ivec3(x, y, z) * size;
+				for (int direction = 0; direction < 6; direction++) {
+					const int* normal = FACES[direction].normal;
+					int frontX = x + normal[0], frontY = y + normal[1], frontZ = z + normal[2];
+
+					if (frontY < 0) {
+						continue;
+					}
+					if (frontY < grid.countY && (grid.get(frontX, frontY, frontZ).isOpaque() || !padded.isLoaded(frontX * size, frontZ * size))) {
+						continue;
+					}
+
+					// Light of the block just outside the middle of the face
+					glm::ivec3 lightVoxel;
+					for (int axis = 0; axis < 3; axis++) {
+						lightVoxel[axis] = normal[axis] > 0 ? origin[axis] + size : (normal[axis] < 0 ? origin[axis] - 1 : origin[axis] + size / 2);
+					}
+
+					addQuad(scratch, block, Chunk::FaceDirection(direction), origin, glm::ivec3(size),
+						padded.getFaceLight(lightVoxel.x, lightVoxel.y, lightVoxel.z), OPEN_AO);
+				}
+			}
+		}
+	}
+}
+
+void ChunkMesher::addSkirts(const PaddedChunk& padded, const CellGrid& grid, int lodLevel, Scratch& scratch) {
+	int size = grid.cellSize;
+	const Chunk::FaceDirection sides[4] = { Chunk::FRONT, Chunk::BACK, Chunk::LEFT, Chunk::RIGHT };
+
+	for (Chunk::FaceDirection side : sides) {
+		const int* normal = FACES[side].normal;
+		int neighborLod = padded.getNeighborLod(normal[0], normal[2]);
+		if (neighborLod < 0 || (lodLevel == 0 && neighborLod == 0)) {
+			continue;
+		}
+
+		// Cells along this border
+		bool alongX = normal[0] == 0;
+		int count = alongX ? grid.countX : grid.countZ;
+		reserveQuads(scratch, count);
+
+		for (int i = 0; i < count; i++) {
+			int x = alongX ? i : (normal[0] > 0 ? grid.countX - 1 : 0);
+			int z = alongX ? (normal[2] > 0 ? grid.countZ - 1 : 0) : i;
+
+			int y = grid.countY - 1;
+			while (y >= 0 && grid.get(x, y, z).isAir()) {
+				y--;
+			}
+			// Open neighbor cells already got a regular face
+			if (y < 0 || !grid.get(x + normal[0], y, z + normal[2]).isOpaque()) {
+				continue;
+			}
+
+			int surfaceY = (y + 1) * size;
+			int depth = std::min(SKIRT_DEPTH, surfaceY);
+			glm::ivec3 origin(x * size, surfaceY - depth, z * size);
+			addQuad(scratch, grid.get(x, y, z), side, origin, glm::ivec3(size, depth, size),
+				padded.getFaceLight(origin.x, surfaceY, origin.z), OPEN_AO);
+		}
+	}
+}
+
+void ChunkMesher::addFace(const PaddedChunk& padded, glm::ivec3 block, const Block& blockType, Chunk::FaceDirection faceDirection, glm::vec2 light, Scratch& scratch) {
+	const FaceTable& face = FACES[faceDirection];
+
+	// AMBIENT OCCLUSION
+	// Every corner looks at the two side voxels and the diagonal voxel in front of the face:
+	// 3 is fully open, 0 means both sides are solid
+	int ao[4];
+	for (int i = 0; i < 4; i++) {
+		const FaceCorner& corner = face.corners[i];
+		bool solidU = padded.isOpaque(block.x + corner.sideU[0], block.y + corner.sideU[1], block.z + corner.sideU[2]);
+		bool solidV = padded.isOpaque(block.x + corner.sideV[0], block.y + corner.sideV[1], block.z + corner.sideV[2]);
+		bool solidDiagonal = padded.isOpaque(block.x + corner.diagonal[0], block.y + corner.diagonal[1], block.z + corner.diagonal[2]);
+		ao[i] = (solidU && solidV) ? 0 : 3 - (solidU + solidV + solidDiagonal);
+	}
+
+	addQuad(scratch, blockType, faceDirection, block, glm::ivec3(1), light, ao);
+}
+
+void ChunkMesher::addQuad(Scratch& scratch, const Block& block, Chunk::FaceDirection faceDirection, glm::ivec3 origin, glm::ivec3 size, glm::vec2 light, const int ao[4]) {
+	const FaceTable& face = FACES[faceDirection];
+	int texIndex = faceTexture(block, faceDirection);
+	glm::vec3 normal(face.normal[0], face.normal[1], face.normal[2]);
+
+	// Texture u runs along x (z on the x faces), v along y (z on the y faces)
+	int normalAxis = face.normal[0] != 0 ? 0 : (face.normal[1] != 0 ? 1 : 2);
+	glm::vec2 texScale = normalAxis == 0 ? glm::vec2(size.z, size.y) : (normalAxis == 1 ? glm::vec2(size.x, size.z) : glm::vec2(size.x, size.y));
+
+	Block::RenderLayer layer = block.getRenderLayer();
+	scratch.quadRanges[scratch.vertexCount / 4] = uint8_t(layer == Block::LAYER_TRANSLUCENT
+		? Chunk::translucentRange(std::min(origin.y / CHUNK_SECTION_HEIGHT, CHUNK_SECTION_COUNT - 1))
+		: Chunk::faceRange(layer, faceDirection));
+	uint32_t startIndex = uint32_t(scratch.vertexCount);
+	Vertex* vertex = &scratch.vertices[scratch.vertexCount];
+	for (int i = 0; i < 4; i++, vertex++) {
+		const FaceCorner& corner = face.corners[i];
+		vertex->position = glm::vec3(origin.x + corner.position[0] * size.x, origin.y + corner.position[1] * size.y, origin.z + corner.position[2] * size.z);
+		vertex->normal = normal;
+		vertex->texCoord = glm::vec2(corner.texCoord[0], corner.texCoord[1]) * texScale;
+		vertex->texIndex = texIndex;
+		vertex->light = light;
+		vertex->ao = ao[i] / 3.0f;
+	}
+	scratch.vertexCount += 4;
+
+	// Split the quad along the darker diagonal, otherwise the occlusion gradient
+	// depends on the triangle orientation
+	uint32_t first = ao[0] + ao[2] > ao[1] + ao[3] ? 1 : 0;
+	uint32_t* index = &scratch.indices[scratch.indexCount];
+	index[0] = startIndex + first;
+	index[1] = startIndex + first + 1;
+	index[2] = startIndex + first + 2;
+	index[3] = startIndex + first + 2;
+	index[4] = startIndex + (first + 3) % 4;
+	index[5] = startIndex + first;
+	scratch.indexCount += 6;
+}
+
+bool ChunkMesher::compareMeshes(const std::vector<Vertex>& expectedVertices, const std::vector<uint32_t>& expectedIndices,
+	const uint32_t expectedRanges[Chunk::MESH_RANGE_COUNT + 1], const Vertex* vertices, const uint32_t* indices,
+	const uint32_t meshRanges[Chunk::MESH_RANGE_COUNT + 1], std::string& difference) {
+	for (int range = 0; range <= Chunk::MESH_RANGE_COUNT; range++) {
+		if (expectedRanges[range] != meshRanges[range]) {
+			difference = "range " + std::to_string(range) + " starts at index " + std::to_string(meshRanges[range]) +
+				" instead of " + std::to_string(expectedRanges[range]);
+			return false;
+		}
+	}
+
+	// Quad q owns the vertices 4q to 4q + 3 and the indices 6q to 6q + 5 in both meshes
+	std::vector<uint32_t> expectedQuads;
+	std::vector<uint32_t> quads;
+	for (int range = 0; range < Chunk::MESH_RANGE_COUNT; range++) {
+		uint32_t first = meshRanges[range] / 6;
+		uint32_t end = meshRanges[range + 1] / 6;
+		expectedQuads.resize(end - first);
+		quads.resize(end - first);
+		for (uint32_t i = 0; i < end - first; i++) {
+			expectedQuads[i] = first + i;
+			quads[i] = first + i;
+		}
+		std::sort(expectedQuads.begin(), expectedQuads.end(), [&](uint32_t a, uint32_t b) {
+			return quadLess(&expectedVertices[a * 4], &expectedVertices[b * 4]);
+		});
+		std::sort(quads.begin(), quads.end(), [&](uint32_t a, uint32_t b) { return quadLess(&vertices[a * 4], &vertices[b * 4]); });
+
+		for (size_t i = 0; i < quads.size(); i++) {
+			uint32_t expectedQuad = expectedQuads[i];
+			uint32_t quad = quads[i];
+			bool same = true;
+			for (int corner = 0; corner < 4; corner++) {
+				same = same && sameVertex(expectedVertices[expectedQuad * 4 + corner], vertices[quad * 4 + corner]);
+			}
+			// Same triangles, relative to the quad's first vertex
+			for (int index = 0; index < 6; index++) {
+				same = same && expectedIndices[expectedQuad * 6 + index] - expectedQuad * 4 == indices[quad * 6 + index] - quad * 4;
+			}
+			if (!same) {
+				const glm::vec3& position = expectedVertices[expectedQuad * 4].position;
+				difference = "face at (" + std::to_string(int(position.x)) + ", " + std::to_string(int(position.y)) + ", " +
+					std::to_string(int(position.z)) + ") of range " + std::to_string(range) + " differs";
+				return false;
+			}
+		}
+	}
+	return true;
+}
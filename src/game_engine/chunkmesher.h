@@ -0,0 +1,73 @@
+#ifndef CHUNKMESHER_H
+#define CHUNKMESHER_H
+
+#include <string>
+#include <vector>
+#include "chunk.h"
+#include "paddedchunk.h"
+
+// Builds the mesh of one chunk. Reads nothing but the padded copy, so chunks can be
+// meshed on worker threads while the world stays untouched.
+// Faces are written into scratch buffers owned by the calling thread and copied once
+// into exactly sized vectors, no allocations per face. The copy groups the faces into the
+// chunk's mesh ranges: by layer and direction so the renderer can skip the directions that
+// face away from the camera, translucent faces by section for sorting.
+//
+// Level of detail n merges 2^n blocks along every axis into one cell. A cell is solid if
+// most of its blocks are, and looks like its highest block so grass stays on top.
+// Skirts hang down from the surface along the borders to neighbors at another level,
+// covering the cracks between the different surfaces.
+class ChunkMesher {
+public:
+	static const int LOD_LEVEL_COUNT = 4;
+
+	// meshRanges receives the start of every range, see Chunk::getMeshRangeStart
+	static void buildMesh(const PaddedChunk& padded, int lodLevel, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+		uint32_t meshRanges[Chunk::MESH_RANGE_COUNT + 1]);
+
+	// Padded copy owned by the calling thread, reused for every chunk it meshes
+	static PaddedChunk& getScratchPadding();
+
+	// Compares a mesh face for face with the expected one, for the GPU mesher. The faces of a range may be in
+	// any order (the GPU places them with atomics), light and occlusion may differ by rounding.
+	// Returns false and describes the first difference.
+	static bool compareMeshes(const std::vector<Vertex>& expectedVertices, const std::vector<uint32_t>& expectedIndices,
+		const uint32_t expectedRanges[Chunk::MESH_RANGE_COUNT + 1], const Vertex* vertices, const uint32_t* indices,
+		const uint32_t meshRanges[Chunk::MESH_RANGE_COUNT + 1], std::string& difference);
+
+private:
+	struct Scratch {
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<uint8_t> quadRanges;
+		size_t vertexCount;
+		size_t indexCount;
+		std::vector<Block> cells; // Downsampled blocks for level of detail meshes
+	};
+
+	// Blocks or downsampled cells of a chunk, one border cell on each horizontal side.
+	// Laid out as [x + 1][y][z + 1] like the padded chunk, which is the grid of level 0.
+	struct CellGrid {
+		const Block* cells;
+		int cellSize;
+		int countX, countY, countZ;
+
+		const Block& get(int x, int y, int z) const { return cells[((x + 1) * countY + y) * (countZ + 2) + z + 1]; }
+	};
+
+	static Scratch& getScratch();
+	static void reserveQuads(Scratch& scratch, size_t quadCount);
+
+	static void addVoxelFaces(const PaddedChunk& padded, Scratch& scratch);
+	static CellGrid downsample(const PaddedChunk& padded, int cellSize, Scratch& scratch);
+	static void addCellFaces(const PaddedChunk& padded, const CellGrid& grid, Scratch& scratch);
+	static void addSkirts(const PaddedChunk& padded, const CellGrid& grid, int lodLevel, Scratch& scratch);
+
+	// light is the sky and block light of the voxel in front of the face, 0 - 1.
+	// Corner ambient occlusion is read from the padded copy.
+	static void addFace(const PaddedChunk& padded, glm::ivec3 block, const Block& blockType, Chunk::FaceDirection faceDirection, glm::vec2 light, Scratch& scratch);
+	// Face of the box origin to origin + size, the texture repeats once per block
+	static void addQuad(Scratch& scratch, const Block& block, Chunk::FaceDirection faceDirection, glm::ivec3 origin, glm::ivec3 size, glm::vec2 light, const int ao[4]);
+};
+
+#endif // !CHUNKMESHER_H
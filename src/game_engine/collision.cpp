@@ -0,0 +1,177 @@
+#include "collision.h"
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Keeps boxes that rest exactly on a block face out of that block
+static const float COLLISION_EPSILON = 1e-4f;
+
+static int lowestBit(uint64_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return int(index);
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+static int highestBit(uint64_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, mask);
+	return int(index);
+#else
+	return 63 - __builtin_clzll(mask);
+#endif
+}
+
+// Bits minY..maxY, clipped to the chunk height
+static uint64_t rangeMask(int minY, int maxY) {
+	minY = std::max(minY, 0);
+	maxY = std::min(maxY, CHUNK_SIZE_Y - 1);
+	if (minY > maxY) {
+		return 0;
+	}
+	uint64_t upper = maxY == 63 ? ~uint64_t(0) : (uint64_t(1) << (maxY + 1)) - 1;
+	return upper & ~((uint64_t(1) << minY) - 1);
+}
+
+Collision::Collision(WorldManager& world) : world(world) {
+	cachedChunkX = 0;
+	cachedChunkZ = 0;
+	cachedChunk = nullptr;
+	cacheValid = false;
+}
+
+uint64_t Collision::getSolidColumn(int x, int z) {
+	int chunkX = floorDiv(x, CHUNK_SIZE_X);
+	int chunkZ = floorDiv(z, CHUNK_SIZE_Z);
+	if (!cacheValid || chunkX != cachedChunkX || chunkZ != cachedChunkZ) {
+		cachedChunkX = chunkX;
+		cachedChunkZ = chunkZ;
+		cachedChunk = world.findChunk(chunkX, chunkZ);
+		cacheValid = true;
+	}
+	if (!cachedChunk) {
+		return 0;
+	}
+	return cachedChunk->getSolidColumn(x - chunkX * CHUNK_SIZE_X, z - chunkZ * CHUNK_SIZE_Z);
+}
+
+bool Collision::isSolid(int x, int y, int z) {
+	cacheValid = false;
+	return (getSolidColumn(x, z) & rangeMask(y, y)) != 0;
+}
+
+bool Collision::overlapsSolid(const AABB& box) {
+	cacheValid = false;
+	glm::ivec3 minCell = glm::ivec3(glm::floor(box.min + COLLISION_EPSILON));
+	glm::ivec3 maxCell = glm::ivec3(glm::floor(box.max - COLLISION_EPSILON));
+	uint64_t yMask = rangeMask(minCell.y, maxCell.y);
+	for (int x = minCell.x; x <= maxCell.x; x++) {
+		for (int z = minCell.z; z <= maxCell.z; z++) {
+			if (getSolidColumn(x, z) & yMask) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool Collision::isChunkLoaded(glm::vec3 position) {
+	int x = int(std::floor(position.x));
+	int z = int(std::floor(position.z));
+	return world.findChunk(floorDiv(x, CHUNK_SIZE_X), floorDiv(z, CHUNK_SIZE_Z)) != nullptr;
+}
+
+Collision::MoveResult Collision::moveBox(AABB& box, glm::vec3 movement) {
+	// Chunks may have been unloaded since the last call
+	cacheValid = false;
+
+	MoveResult result = {};
+	static const int axisOrder[3] = { 1, 0, 2 };
+	for (int axis : axisOrder) {
+		if (movement[axis] == 0.0f) {
+			continue;
+		}
+
+		float allowed = sweepAxis(box, axis, movement[axis]);
+		result.blocked[axis] = allowed != movement[axis];
+		result.movement[axis] = allowed;
+		box.min[axis] += allowed;
+		box.max[axis] += allowed;
+	}
+	result.onGround = result.blocked.y && movement.y < 0.0f;
+	return result;
+}
+
+// Returns how far the box can move along axis before touching a solid block
+float Collision::sweepAxis(const AABB& box, int axis, float distance) {
+	// Cells covered by the box on the other two axes
+	glm::ivec3 minCell = glm::ivec3(glm::floor(box.min + COLLISION_EPSILON));
+	glm::ivec3 maxCell = glm::ivec3(glm::floor(box.max - COLLISION_EPSILON));
+
+	// Layers of cells the leading face passes through
+	float leading = distance > 0.0f ? box.max[axis] : box.min[axis];
+	int first, last;
+	if (distance > 0.0f) {
+		first = int(std::ceil(leading - COLLISION_EPSILON));
+		last = int(std::ceil(leading + distance)) - 1;
+	}
+	else {
+		first = int(std::floor(leading + COLLISION_EPSILON)) - 1;
+		last = int(std::floor(leading + distance));
+	}
+
+	auto clampToLayer = [&](int layer) {
+		float allowed = distance > 0.0f ? layer - leading : layer + 1 - leading;
+		return distance > 0.0f ? std::max(allowed, 0.0f) : std::min(allowed, 0.0f);
+	};
+
+	if (axis == 1) {
+		// Vertical: nearest set bit of every column inside the swept range
+		uint64_t sweptMask = distance > 0.0f ? rangeMask(first, last) : rangeMask(last, first);
+		if (!sweptMask) {
+			return distance;
+		}
+
+		int nearest = distance > 0.0f ? CHUNK_SIZE_Y : -1;
+		for (int x = minCell.x; x <= maxCell.x; x++) {
+			for (int z = minCell.z; z <= maxCell.z; z++) {
+				uint64_t hits = getSolidColumn(x, z) & sweptMask;
+				if (!hits) continue;
+				if (distance > 0.0f) nearest = std::min(nearest, lowestBit(hits));
+				else nearest = std::max(nearest, highestBit(hits));
+			}
+		}
+
+		if (nearest == CHUNK_SIZE_Y || nearest == -1) {
+			return distance;
+		}
+		return clampToLayer(nearest);
+	}
+
+	// Horizontal: walk the layers front to back, one mask test per column
+	uint64_t yMask = rangeMask(minCell.y, maxCell.y);
+	if (!yMask) {
+		return distance;
+	}
+
+	int direction = distance > 0.0f ? 1 : -1;
+	for (int layer = first; layer * direction <= last * direction; layer += direction) {
+		if (axis == 0) {
+			for (int z = minCell.z; z <= maxCell.z; z++) {
+				if (getSolidColumn(layer, z) & yMask) return clampToLayer(layer);
+			}
+		}
+		else {
+			for (int x = minCell.x; x <= maxCell.x; x++) {
+				if (getSolidColumn(x, layer) & yMask) return clampToLayer(layer);
+			}
+		}
+	}
+	return distance;
+}
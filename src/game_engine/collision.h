@@ -0,0 +1,44 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <cstdint>
+#include "worldmanager.h"
+
+// Axis aligned box in world coordinates
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Sweeps boxes through the voxel grid. Movement is resolved one axis at a time
+// (y, then x, then z), so a box slides along walls instead of sticking to them.
+// Solidity comes from the per-column bitmasks of the chunks, unloaded chunks are empty.
+class Collision {
+public:
+	struct MoveResult {
+		glm::vec3 movement; // Movement that was actually applied
+		glm::bvec3 blocked; // Axes that hit a block
+		bool onGround;
+	};
+
+	Collision(WorldManager& world);
+
+	MoveResult moveBox(AABB& box, glm::vec3 movement);
+
+	bool isSolid(int x, int y, int z);
+	bool overlapsSolid(const AABB& box);
+	bool isChunkLoaded(glm::vec3 position);
+
+private:
+	WorldManager& world;
+
+	// Chunk of the last lookup, only valid during a single call
+	int cachedChunkX, cachedChunkZ;
+	Chunk* cachedChunk;
+	bool cacheValid;
+
+	uint64_t getSolidColumn(int x, int z);
+	float sweepAxis(const AABB& box, int axis, float distance);
+};
+
+#endif // !COLLISION_H
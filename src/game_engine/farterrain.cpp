@@ -0,0 +1,166 @@
+#include "farterrain.h"
+#include <algorithm>
+
+FarTerrain::FarTerrain(WorldManager& world) : world(world), holeMinX(0), holeMinZ(0), holeMaxX(0), holeMaxZ(0) {
+	for (int i = 0; i < LEVEL_COUNT; i++) {
+		Level& level = levels[i];
+		level.spacing = BASE_SPACING << i;
+		level.originX = 0;
+		level.originZ = 0;
+		level.version = 0;
+	}
+}
+
+void FarTerrain::setTextureColors(const std::vector<glm::vec3>& colors) {
+	textureColors = colors;
+
+	// Colors are baked into the vertices, sample everything again
+	for (Level& level : levels) {
+		level.heights.clear();
+		level.colors.clear();
+	}
+}
+
+void FarTerrain::update(glm::vec3 cameraPos, int viewDistance) {
+	int cameraX = int(floor(cameraPos.x));
+	int cameraZ = int(floor(cameraPos.z));
+
+	// The voxel chunks cover the square of chunks within viewDistance of the camera chunk
+	int cameraChunkX = floorDiv(cameraX, CHUNK_SIZE_X);
+	int cameraChunkZ = floorDiv(cameraZ, CHUNK_SIZE_Z);
+	int newHoleMinX = (cameraChunkX - viewDistance) * CHUNK_SIZE_X;
+	int newHoleMinZ = (cameraChunkZ - viewDistance) * CHUNK_SIZE_Z;
+	int newHoleMaxX = (cameraChunkX + viewDistance + 1) * CHUNK_SIZE_X;
+	int newHoleMaxZ = (cameraChunkZ + viewDistance + 1) * CHUNK_SIZE_Z;
+	bool holeMoved = newHoleMinX != holeMinX || newHoleMinZ != holeMinZ || newHoleMaxX != holeMaxX || newHoleMaxZ != holeMaxZ;
+	holeMinX = newHoleMinX;
+	holeMinZ = newHoleMinZ;
+	holeMaxX = newHoleMaxX;
+	holeMaxZ = newHoleMaxZ;
+
+	bool innerMoved = false;
+	for (int i = 0; i < LEVEL_COUNT; i++) {
+		Level& level = levels[i];
+
+		// Snapped to twice the spacing, so the finer level always ends on vertices of this one
+		int snap = level.spacing * 2;
+		int originX = floorDiv(cameraX, snap) * snap - GRID_CELLS / 2 * level.spacing;
+		int originZ = floorDiv(cameraZ, snap) * snap - GRID_CELLS / 2 * level.spacing;
+
+		bool moved = level.heights.empty() || originX != level.originX || originZ != level.originZ;
+		if (moved) {
+			scrollLevel(level, originX, originZ);
+			buildVertices(level, i + 1 < LEVEL_COUNT);
+		}
+
+		if (moved || innerMoved || (i == 0 && holeMoved)) {
+			if (i == 0) {
+				buildIndices(level, holeMinX, holeMinZ, holeMaxX, holeMaxZ);
+			}
+			else {
+				const Level& inner = levels[i - 1];
+				int innerSize = GRID_CELLS * inner.spacing;
+				buildIndices(level, inner.originX, inner.originZ, inner.originX + innerSize, inner.originZ + innerSize);
+			}
+			level.version++;
+		}
+		innerMoved = moved;
+	}
+}
+
+void FarTerrain::scrollLevel(Level& level, int originX, int originZ) {
+	std::vector<float> heights(GRID_VERTICES * GRID_VERTICES);
+	std::vector<glm::vec3> colors(GRID_VERTICES * GRID_VERTICES);
+	bool reuse = !level.heights.empty();
+
+	for (int i = 0; i < GRID_VERTICES; i++) {
+		for (int j = 0; j < GRID_VERTICES; j++) {
+			int x = originX + i * level.spacing;
+			int z = originZ + j * level.spacing;
+			int index = i * GRID_VERTICES + j;
+
+			// Samples that stay inside the level are moved, only new ones run the noise
+			int oldI = (x - level.originX) / level.spacing;
+			int oldJ = (z - level.originZ) / level.spacing;
+			if (reuse && oldI >= 0 && oldI < GRID_VERTICES && oldJ >= 0 && oldJ < GRID_VERTICES) {
+				heights[index] = level.heights[oldI * GRID_VERTICES + oldJ];
+				colors[index] = level.colors[oldI * GRID_VERTICES + oldJ];
+			}
+			else {
+				heights[index] = world.getSurfaceHeight(float(x), float(z));
+				colors[index] = getSurfaceColor(x, z);
+			}
+		}
+	}
+
+	level.heights = std::move(heights);
+	level.colors = std::move(colors);
+	level.originX = originX;
+	level.originZ = originZ;
+}
+
+void FarTerrain::buildVertices(Level& level, bool stitchBorder) {
+	level.vertices.resize(GRID_VERTICES * GRID_VERTICES);
+	auto height = [&](int i, int j) {
+		i = std::clamp(i, 0, GRID_VERTICES - 1);
+		j = std::clamp(j, 0, GRID_VERTICES - 1);
+		return level.heights[i * GRID_VERTICES + j];
+	};
+
+	for (int i = 0; i < GRID_VERTICES; i++) {
+		for (int j = 0; j < GRID_VERTICES; j++) {
+			float y = height(i, j);
+
+			// The next level only has every second border vertex, in between we follow its edge
+			// or the two levels would crack apart
+			if (stitchBorder) {
+				bool borderI = i == 0 || i == GRID_VERTICES - 1;
+				bool borderJ = j == 0 || j == GRID_VERTICES - 1;
+				if (borderI && (j & 1)) {
+					y = (height(i, j - 1) + height(i, j + 1)) * 0.5f;
+				}
+				else if (borderJ && (i & 1)) {
+					y = (height(i - 1, j) + height(i + 1, j)) * 0.5f;
+				}
+			}
+
+			FarVertex& vertex = level.vertices[i * GRID_VERTICES + j];
+			vertex.position = glm::vec3(level.originX + i * level.spacing, y, level.originZ + j * level.spacing);
+			vertex.normal = glm::normalize(glm::vec3(height(i - 1, j) - height(i + 1, j), 2.0f * level.spacing, height(i, j - 1) - height(i, j + 1)));
+			vertex.color = level.colors[i * GRID_VERTICES + j];
+		}
+	}
+}
+
+void FarTerrain::buildIndices(Level& level, int minX, int minZ, int maxX, int maxZ) {
+	level.indices.clear();
+	level.indices.reserve(GRID_CELLS * GRID_CELLS * 6);
+
+	for (int i = 0; i < GRID_CELLS; i++) {
+		for (int j = 0; j < GRID_CELLS; j++) {
+			// Cells completely inside the hole are drawn by the finer level
+			int cellMinX = level.originX + i * level.spacing;
+			int cellMinZ = level.originZ + j * level.spacing;
+			if (cellMinX >= minX && cellMinX + level.spacing <= maxX && cellMinZ >= minZ && cellMinZ + level.spacing <= maxZ) {
+				continue;
+			}
+
+			uint32_t corner = i * GRID_VERTICES + j;
+			level.indices.push_back(corner);
+			level.indices.push_back(corner + GRID_VERTICES);
+			level.indices.push_back(corner + GRID_VERTICES + 1);
+			level.indices.push_back(corner + GRID_VERTICES + 1);
+			level.indices.push_back(corner + 1);
+			level.indices.push_back(corner);
+		}
+	}
+}
+
+glm::vec3 FarTerrain::getSurfaceColor(int x, int z) const {
+	Block surface = world.getSurfaceBlock(x, z);
+	int texture = surface.topTexture;
+	if (texture <= 0 || texture > int(textureColors.size())) {
+		return glm::vec3(0.5f);
+	}
+	return textureColors[texture - 1];
+}
@@ -0,0 +1,62 @@
+#ifndef FARTERRAIN_H
+#define FARTERRAIN_H
+
+#include <cstdint>
+#include <vector>
+#include "worldmanager.h"
+
+// Terrain beyond the voxel view distance, drawn from the heightmap of the terrain
+// generator instead of generated and meshed chunks.
+//
+// Nested square grids (clipmap levels) around the camera, every level has twice the
+// spacing of the one inside it and leaves a hole where the finer level (or, for the
+// first level, the voxel chunks) is drawn. When the camera moves, a level only samples
+// the heights and surface colors that scrolled in.
+class FarTerrain {
+public:
+	static const int LEVEL_COUNT = 4;
+	static const int GRID_CELLS = 64; // Cells per side of every level
+	static const int GRID_VERTICES = GRID_CELLS + 1;
+	static const int BASE_SPACING = 8; // Blocks between the vertices of the first level
+
+	struct FarVertex {
+		glm::vec3 position; // World coordinates
+		glm::vec3 normal;
+		glm::vec3 color;
+	};
+
+	struct Level {
+		int spacing;
+		int originX, originZ; // World position of the first vertex
+		std::vector<float> heights;
+		std::vector<glm::vec3> colors;
+		std::vector<FarVertex> vertices;
+		std::vector<uint32_t> indices;
+		uint32_t version; // Increased whenever vertices or indices change
+	};
+
+	FarTerrain(WorldManager& world);
+
+	// Average color of every texture (index + 1 is the texture index of the blocks)
+	void setTextureColors(const std::vector<glm::vec3>& colors);
+
+	// Scrolls the levels with the camera, viewDistance is the radius of the voxel chunks in chunks
+	void update(glm::vec3 cameraPos, int viewDistance);
+
+	const Level& getLevel(int level) const { return levels[level]; }
+	// Distance from the camera to the edge of the outermost level
+	float getRange() const { return GRID_CELLS / 2 * (BASE_SPACING << (LEVEL_COUNT - 1)); }
+
+private:
+	WorldManager& world;
+	Level levels[LEVEL_COUNT];
+	std::vector<glm::vec3> textureColors;
+	int holeMinX, holeMinZ, holeMaxX, holeMaxZ; // Voxel area inside the first level
+
+	void scrollLevel(Level& level, int originX, int originZ);
+	void buildVertices(Level& level, bool stitchBorder);
+	void buildIndices(Level& level, int minX, int minZ, int maxX, int maxZ);
+	glm::vec3 getSurfaceColor(int x, int z) const;
+};
+
+#endif // !FARTERRAIN_H
@@ -0,0 +1,158 @@
+#include "framewriter.h"
+#include "../logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <stb/stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+FrameWriter::FrameWriter() : stopping(false), tolerance(2), maxDifferentShare(0.001), failedComparisons(0) {
+	thread = std::thread(&FrameWriter::run, this);
+}
+
+FrameWriter::~FrameWriter() {
+	shutdown();
+}
+
+void FrameWriter::write(Frame&& frame) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingFrames.push_back(std::move(frame));
+	}
+	wakeUp.notify_one();
+}
+
+void FrameWriter::setTolerance(uint32_t tolerance) {
+	std::lock_guard<std::mutex> lock(mutex);
+	this->tolerance = tolerance;
+}
+
+void FrameWriter::setMaxDifferentShare(double share) {
+	std::lock_guard<std::mutex> lock(mutex);
+	maxDifferentShare = share;
+}
+
+uint32_t FrameWriter::getFailedComparisons() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return failedComparisons;
+}
+
+void FrameWriter::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_one();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void FrameWriter::run() {
+	std::deque<Frame> frames;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this] { return stopping || !pendingFrames.empty(); });
+			if (pendingFrames.empty()) {
+				return; // Stopping and nothing left to write
+			}
+			frames.swap(pendingFrames);
+		}
+
+		for (Frame& frame : frames) {
+			writeFrame(frame);
+			if (!frame.goldenPath.empty() && !compareFrame(frame)) {
+				std::lock_guard<std::mutex> lock(mutex);
+				failedComparisons++;
+			}
+		}
+		frames.clear();
+	}
+}
+
+void FrameWriter::writeFrame(Frame& frame) {
+	// Captures are opaque, whatever the blending left in alpha
+	for (size_t i = 0; i < frame.pixels.size(); i += 4) {
+		if (frame.bgra) {
+			std::swap(frame.pixels[i], frame.pixels[i + 2]);
+		}
+		frame.pixels[i + 3] = 255;
+	}
+	frame.bgra = false;
+
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(frame.path).parent_path(), error);
+	if (!stbi_write_png(frame.path.c_str(), frame.width, frame.height, 4, frame.pixels.data(), frame.width * 4)) {
+		LOG_WARNING("Could not write the capture ", frame.path);
+		return;
+	}
+	LOG_INFO("Captured ", frame.path);
+}
+
+bool FrameWriter::compareFrame(const Frame& frame) {
+	int width = 0, height = 0, channels = 0;
+	uint8_t* golden = stbi_load(frame.goldenPath.c_str(), &width, &height, &channels, 4);
+	if (!golden) {
+		LOG_ERROR("Missing golden image ", frame.goldenPath);
+		return false;
+	}
+	if (uint32_t(width) != frame.width || uint32_t(height) != frame.height) {
+		LOG_ERROR("Golden image ", frame.goldenPath, " is ", width, "x", height, ", the capture is ", frame.width, "x", frame.height);
+		stbi_image_free(golden);
+		return false;
+	}
+
+	uint32_t currentTolerance;
+	double currentMaxDifferentShare;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentTolerance = tolerance;
+		currentMaxDifferentShare = maxDifferentShare;
+	}
+
+	// Different pixels are red in the diff image, equal ones a faded gray of the capture
+	std::vector<uint8_t> diff(frame.pixels.size());
+	size_t differentPixels = 0;
+	uint32_t maxDifference = 0;
+	for (size_t i = 0; i < frame.pixels.size(); i += 4) {
+		uint32_t difference = 0;
+		for (size_t channel = 0; channel < 3; channel++) {
+			difference = std::max(difference, uint32_t(std::abs(int(frame.pixels[i + channel]) - int(golden[i + channel]))));
+		}
+		maxDifference = std::max(maxDifference, difference);
+
+		if (difference > currentTolerance) {
+			differentPixels++;
+			diff[i] = 255;
+			diff[i + 1] = 0;
+			diff[i + 2] = 0;
+		}
+		else {
+			uint8_t gray = uint8_t((frame.pixels[i] + frame.pixels[i + 1] + frame.pixels[i + 2]) / 12);
+			diff[i] = gray;
+			diff[i + 1] = gray;
+			diff[i + 2] = gray;
+		}
+		diff[i + 3] = 255;
+	}
+	stbi_image_free(golden);
+
+	double share = double(differentPixels) / (double(frame.width) * frame.height);
+	bool passed = share <= currentMaxDifferentShare;
+	if (differentPixels > 0) {
+		std::filesystem::path diffPath = std::filesystem::path(frame.path);
+		diffPath.replace_filename(diffPath.stem().string() + "_diff.png");
+		stbi_write_png(diffPath.string().c_str(), frame.width, frame.height, 4, diff.data(), frame.width * 4);
+	}
+
+	if (passed) {
+		LOG_INFO("Matches ", frame.goldenPath, " (", differentPixels, " pixels differ, max difference ", maxDifference, ")");
+	}
+	else {
+		LOG_ERROR("Differs from ", frame.goldenPath, ": ", differentPixels, " pixels (", share * 100.0, "%), max difference ", maxDifference);
+	}
+	return passed;
+}
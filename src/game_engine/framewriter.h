@@ -0,0 +1,61 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes captured frames as PNGs on its own thread, so a capture never waits for the encoder.
+// A frame with a golden path is also compared against that reference image: pixels with a channel
+// further off than the tolerance count as different, and a diff image is written next to the capture.
+class FrameWriter {
+public:
+	struct Frame {
+		std::string path;
+		std::string goldenPath; // Empty if the frame is not compared
+		uint32_t width;
+		uint32_t height;
+		bool bgra; // Swapchain order, swizzled to RGBA on the worker
+		std::vector<uint8_t> pixels;
+	};
+
+	FrameWriter();
+	~FrameWriter();
+
+	FrameWriter(const FrameWriter&) = delete;
+	FrameWriter& operator=(const FrameWriter&) = delete;
+
+	void write(Frame&& frame);
+
+	// Largest difference of a channel that still counts as equal
+	void setTolerance(uint32_t tolerance);
+	// More differing pixels than this share fail the comparison
+	void setMaxDifferentShare(double share);
+
+	uint32_t getFailedComparisons();
+
+	// Writes everything still queued and stops the thread
+	void shutdown();
+
+private:
+	void run();
+	void writeFrame(Frame& frame);
+	bool compareFrame(const Frame& frame);
+
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stopping;
+	std::deque<Frame> pendingFrames;
+
+	uint32_t tolerance;
+	double maxDifferentShare;
+	uint32_t failedComparisons;
+
+	std::thread thread;
+};
+
+#endif // !FRAMEWRITER_H
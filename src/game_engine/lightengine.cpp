@@ -0,0 +1,294 @@
+#include "lightengine.h"
+#include "worldmanager.h"
+
+static const glm::ivec3 directions[6] = {
+	{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, 1, 0 }, { 0, -1, 0 }
+};
+static const int DIRECTION_DOWN = 5;
+
+static uint8_t readLight(const Chunk* chunk, LightEngine::Channel channel, int x, int y, int z) {
+	return channel == LightEngine::CHANNEL_SKY ? chunk->getSkyLight(x, y, z) : chunk->getBlockLight(x, y, z);
+}
+
+static void writeLight(Chunk* chunk, LightEngine::Channel channel, int x, int y, int z, uint8_t level) {
+	if (channel == LightEngine::CHANNEL_SKY) chunk->setSkyLight(x, y, z, level);
+	else chunk->setBlockLight(x, y, z, level);
+}
+
+// Level a neighbor receives when light moves one step in direction
+static uint8_t spreadLevel(LightEngine::Channel channel, int direction, uint8_t level) {
+	if (channel == LightEngine::CHANNEL_SKY && direction == DIRECTION_DOWN && level == MAX_LIGHT_LEVEL) {
+		return MAX_LIGHT_LEVEL;
+	}
+	return level - 1;
+}
+
+// Flood fill inside a single chunk, queue holds local coordinates
+static void propagateLocal(Chunk& chunk, LightEngine::Channel channel, std::vector<glm::ivec3>& queue) {
+	const Block* blocks = chunk.getBlockData();
+	for (size_t head = 0; head < queue.size(); head++) {
+		glm::ivec3 position = queue[head];
+		uint8_t level = readLight(&chunk, channel, position.x, position.y, position.z);
+		if (level <= 1) continue;
+
+		for (int direction = 0; direction < 6; direction++) {
+			glm::ivec3 neighbor = position + directions[direction];
+			if (neighbor.x < 0 || neighbor.x >= CHUNK_SIZE_X || neighbor.y < 0 || neighbor.y >= CHUNK_SIZE_Y || neighbor.z < 0 || neighbor.z >= CHUNK_SIZE_Z) continue;
+			if (blocks[Chunk::blockIndex(neighbor.x, neighbor.y, neighbor.z)].isOpaque()) continue;
+
+			uint8_t newLevel = spreadLevel(channel, direction, level);
+			if (readLight(&chunk, channel, neighbor.x, neighbor.y, neighbor.z) < newLevel) {
+				writeLight(&chunk, channel, neighbor.x, neighbor.y, neighbor.z, newLevel);
+				queue.push_back(neighbor);
+			}
+		}
+	}
+	queue.clear();
+}
+
+LightEngine::LightEngine(WorldManager& world) : world(world) {
+	cachedChunkX = 0;
+	cachedChunkZ = 0;
+	cachedChunk = nullptr;
+	cacheValid = false;
+}
+
+void LightEngine::lightChunk(Chunk& chunk) {
+	chunk.clearLight();
+	const Block* blocks = chunk.getBlockData();
+	std::vector<glm::ivec3> queue;
+
+	// SKYLIGHT: full strength down every column until the first opaque block
+	for (int x = 0; x < CHUNK_SIZE_X; x++) {
+		for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+			for (int y = CHUNK_SIZE_Y - 1; y >= 0 && !blocks[Chunk::blockIndex(x, y, z)].isOpaque(); y--) {
+				chunk.setSkyLight(x, y, z, MAX_LIGHT_LEVEL);
+			}
+		}
+	}
+
+	// Spread sideways from lit voxels that have dark air next to them (overhangs, caves)
+	for (int x = 0; x < CHUNK_SIZE_X; x++) {
+		for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+			for (int y = CHUNK_SIZE_Y - 1; y >= 0 && chunk.getSkyLight(x, y, z) == MAX_LIGHT_LEVEL; y--) {
+				for (int direction = 0; direction < 4; direction++) {
+					glm::ivec3 neighbor = glm::ivec3(x, y, z) + directions[direction];
+					if (neighbor.x < 0 || neighbor.x >= CHUNK_SIZE_X || neighbor.z < 0 || neighbor.z >= CHUNK_SIZE_Z) continue;
+					if (!blocks[Chunk::blockIndex(neighbor.x, y, neighbor.z)].isOpaque() && chunk.getSkyLight(neighbor.x, y, neighbor.z) == 0) {
+						queue.push_back(glm::ivec3(x, y, z));
+						break;
+					}
+				}
+			}
+		}
+	}
+	propagateLocal(chunk, CHANNEL_SKY, queue);
+
+	// BLOCK LIGHT
+	for (int x = 0; x < CHUNK_SIZE_X; x++) {
+		for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+			for (int z = 0; z < CHUNK_SIZE_Z; z++) {
+				uint8_t emission = blocks[Chunk::blockIndex(x, y, z)].getLightEmission();
+				if (emission > 0) {
+					chunk.setBlockLight(x, y, z, emission);
+					queue.push_back(glm::ivec3(x, y, z));
+				}
+			}
+		}
+	}
+	propagateLocal(chunk, CHANNEL_BLOCK, queue);
+}
+
+Chunk* LightEngine::lookup(glm::ivec3 position, int& localX, int& localZ) {
+	int chunkX = floorDiv(position.x, CHUNK_SIZE_X);
+	int chunkZ = floorDiv(position.z, CHUNK_SIZE_Z);
+	if (!cacheValid || chunkX != cachedChunkX || chunkZ != cachedChunkZ) {
+		cachedChunkX = chunkX;
+		cachedChunkZ = chunkZ;
+		cachedChunk = world.findChunk(chunkX, chunkZ);
+		cacheValid = true;
+	}
+	localX = position.x - chunkX * CHUNK_SIZE_X;
+	localZ = position.z - chunkZ * CHUNK_SIZE_Z;
+	return cachedChunk;
+}
+
+uint8_t LightEngine::getLight(Channel channel, glm::ivec3 position) {
+	if (position.y >= CHUNK_SIZE_Y) {
+		return channel == CHANNEL_SKY ? MAX_LIGHT_LEVEL : 0;
+	}
+	if (position.y < 0) {
+		return 0;
+	}
+
+	int localX, localZ;
+	Chunk* chunk = lookup(position, localX, localZ);
+	return chunk ? readLight(chunk, channel, localX, position.y, localZ) : 0;
+}
+
+void LightEngine::connectChunk(int chunkX, int chunkZ, std::vector<glm::ivec3>& changedVoxels) {
+	cacheValid = false;
+	Chunk* chunk = world.findChunk(chunkX, chunkZ);
+	if (!chunk) {
+		return;
+	}
+
+	static const int neighborOffsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	glm::ivec3 chunkOrigin(chunkX * CHUNK_SIZE_X, 0, chunkZ * CHUNK_SIZE_Z);
+	for (const auto& offset : neighborOffsets) {
+		Chunk* neighbor = world.findChunk(chunkX + offset[0], chunkZ + offset[1]);
+		if (!neighbor) continue;
+
+		glm::ivec3 step(offset[0], 0, offset[1]);
+		glm::ivec3 neighborOrigin = chunkOrigin + glm::ivec3(offset[0] * CHUNK_SIZE_X, 0, offset[1] * CHUNK_SIZE_Z);
+
+		// Both sides of the shared border are light sources for the other side
+		for (int i = 0; i < CHUNK_SIZE_X; i++) {
+			glm::ivec3 local;
+			local.x = offset[0] > 0 ? CHUNK_SIZE_X - 1 : (offset[0] < 0 ? 0 : i);
+			local.z = offset[1] > 0 ? CHUNK_SIZE_Z - 1 : (offset[1] < 0 ? 0 : i);
+			glm::ivec3 neighborLocal = local + step - glm::ivec3(offset[0] * CHUNK_SIZE_X, 0, offset[1] * CHUNK_SIZE_Z);
+
+			for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+				for (int channel = 0; channel < CHANNEL_COUNT; channel++) {
+					if (readLight(chunk, Channel(channel), local.x, y, local.z) > 1) {
+						addQueues[channel].push_back({ chunkOrigin + glm::ivec3(local.x, y, local.z), 0 });
+					}
+					if (readLight(neighbor, Channel(channel), neighborLocal.x, y, neighborLocal.z) > 1) {
+						addQueues[channel].push_back({ neighborOrigin + glm::ivec3(neighborLocal.x, y, neighborLocal.z), 0 });
+					}
+				}
+			}
+		}
+	}
+
+	propagate(CHANNEL_SKY, changedVoxels);
+	propagate(CHANNEL_BLOCK, changedVoxels);
+}
+
+void LightEngine::blockChanged(glm::ivec3 position, const Block& oldBlock, const Block& newBlock) {
+	cacheValid = false;
+	if (position.y < 0 || position.y >= CHUNK_SIZE_Y) {
+		return;
+	}
+
+	bool opacityChanged = oldBlock.isOpaque() != newBlock.isOpaque();
+	uint8_t newEmission = newBlock.getLightEmission();
+	if (!opacityChanged && oldBlock.getLightEmission() == newEmission) {
+		return;
+	}
+
+	int localX, localZ;
+	Chunk* chunk = lookup(position, localX, localZ);
+	if (!chunk) {
+		return;
+	}
+
+	for (int channel = 0; channel < CHANNEL_COUNT; channel++) {
+		// Skylight only cares about opacity, block light also about the emitter that was here
+		bool removeHere = channel == CHANNEL_SKY ? newBlock.isOpaque() : true;
+		uint8_t level = readLight(chunk, Channel(channel), localX, position.y, localZ);
+		if (removeHere && level > 0) {
+			writeLight(chunk, Channel(channel), localX, position.y, localZ, 0);
+			removalQueues[channel].push_back({ position, level });
+		}
+
+		// An opened voxel gets lit again by its surroundings
+		if (!newBlock.isOpaque() && opacityChanged) {
+			for (const glm::ivec3& direction : directions) {
+				glm::ivec3 neighbor = position + direction;
+				if (neighbor.y >= 0 && neighbor.y < CHUNK_SIZE_Y) {
+					addQueues[channel].push_back({ neighbor, 0 });
+				}
+			}
+		}
+	}
+
+	if (!newBlock.isOpaque() && opacityChanged && position.y == CHUNK_SIZE_Y - 1) {
+		chunk->setSkyLight(localX, position.y, localZ, MAX_LIGHT_LEVEL);
+		addQueues[CHANNEL_SKY].push_back({ position, MAX_LIGHT_LEVEL });
+	}
+	if (newEmission > 0) {
+		emitters.push_back({ position, newEmission });
+	}
+}
+
+void LightEngine::update(std::vector<glm::ivec3>& changedVoxels) {
+	cacheValid = false;
+
+	removeLight(CHANNEL_SKY, changedVoxels);
+	removeLight(CHANNEL_BLOCK, changedVoxels);
+
+	for (const LightNode& emitter : emitters) {
+		int localX, localZ;
+		Chunk* chunk = lookup(emitter.position, localX, localZ);
+		if (chunk && chunk->getBlockLight(localX, emitter.position.y, localZ) < emitter.level) {
+			chunk->setBlockLight(localX, emitter.position.y, localZ, emitter.level);
+			addQueues[CHANNEL_BLOCK].push_back(emitter);
+			changedVoxels.push_back(emitter.position);
+		}
+	}
+	emitters.clear();
+
+	propagate(CHANNEL_SKY, changedVoxels);
+	propagate(CHANNEL_BLOCK, changedVoxels);
+}
+
+void LightEngine::removeLight(Channel channel, std::vector<glm::ivec3>& changedVoxels) {
+	std::vector<LightNode>& queue = removalQueues[channel];
+	for (size_t head = 0; head < queue.size(); head++) {
+		LightNode node = queue[head];
+		changedVoxels.push_back(node.position);
+
+		for (int direction = 0; direction < 6; direction++) {
+			glm::ivec3 neighbor = node.position + directions[direction];
+			if (neighbor.y < 0 || neighbor.y >= CHUNK_SIZE_Y) continue;
+
+			int localX, localZ;
+			Chunk* chunk = lookup(neighbor, localX, localZ);
+			if (!chunk) continue;
+
+			uint8_t neighborLevel = readLight(chunk, channel, localX, neighbor.y, localZ);
+			if (neighborLevel == 0) continue;
+
+			// Darker neighbors (and skylight straight below) were lit by this voxel,
+			// brighter ones have their own source and fill the hole again
+			bool dependent = neighborLevel < node.level || (channel == CHANNEL_SKY && direction == DIRECTION_DOWN && node.level == MAX_LIGHT_LEVEL);
+			if (dependent) {
+				writeLight(chunk, channel, localX, neighbor.y, localZ, 0);
+				queue.push_back({ neighbor, neighborLevel });
+			}
+			else {
+				addQueues[channel].push_back({ neighbor, neighborLevel });
+			}
+		}
+	}
+	queue.clear();
+}
+
+void LightEngine::propagate(Channel channel, std::vector<glm::ivec3>& changedVoxels) {
+	std::vector<LightNode>& queue = addQueues[channel];
+	for (size_t head = 0; head < queue.size(); head++) {
+		// Levels in the queue may be outdated after a removal pass, read the current one
+		glm::ivec3 position = queue[head].position;
+		uint8_t level = getLight(channel, position);
+		if (level <= 1) continue;
+
+		for (int direction = 0; direction < 6; direction++) {
+			glm::ivec3 neighbor = position + directions[direction];
+			if (neighbor.y < 0 || neighbor.y >= CHUNK_SIZE_Y) continue;
+
+			int localX, localZ;
+			Chunk* chunk = lookup(neighbor, localX, localZ);
+			if (!chunk || chunk->getBlockData()[Chunk::blockIndex(localX, neighbor.y, localZ)].isOpaque()) continue;
+
+			uint8_t newLevel = spreadLevel(channel, direction, level);
+			if (readLight(chunk, channel, localX, neighbor.y, localZ) < newLevel) {
+				writeLight(chunk, channel, localX, neighbor.y, localZ, newLevel);
+				queue.push_back({ neighbor, newLevel });
+				changedVoxels.push_back(neighbor);
+			}
+		}
+	}
+	queue.clear();
+}
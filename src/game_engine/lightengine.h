@@ -0,0 +1,67 @@
+#ifndef LIGHTENGINE_H
+#define LIGHTENGINE_H
+
+#include <cstdint>
+#include <vector>
+#include "chunk.h"
+
+class WorldManager;
+
+// Flood fill lighting for skylight and block light (4 bit each, stored in the chunks).
+//
+// Skylight enters from the top of the world and travels straight down without losing
+// strength, every other step costs one level. Block light starts at emitting blocks.
+// New chunks are lit on their own (lightChunk, safe on worker threads) and then
+// connected to their loaded neighbors. Edits only relight the affected area:
+// a removal pass darkens everything that depended on the old light and collects the
+// surrounding light sources, which are then propagated again across chunk borders.
+class LightEngine {
+public:
+	enum Channel {
+		CHANNEL_SKY = 0,
+		CHANNEL_BLOCK = 1,
+		CHANNEL_COUNT = 2
+	};
+
+	LightEngine(WorldManager& world);
+
+	// Lights a chunk as if it had no neighbors. Only touches the given chunk.
+	static void lightChunk(Chunk& chunk);
+
+	// Spreads light over the borders between a newly added chunk and its loaded neighbors.
+	// Light fades out within 15 voxels of the border, so only the chunk and its 8 neighbors are
+	// touched: separate engines may connect chunks 3 or more chunks apart at the same time.
+	void connectChunk(int chunkX, int chunkZ, std::vector<glm::ivec3>& changedVoxels);
+
+	// Queues the relight of an edited voxel (world coordinates), runs on the next update
+	void blockChanged(glm::ivec3 position, const Block& oldBlock, const Block& newBlock);
+
+	// Runs all queued removals and propagations, every voxel whose light changed is appended.
+	// Runs on the calling thread: the removal and the refill are one flood fill that can reach
+	// two chunks away from an edit, and the remesh has to wait for it anyway.
+	void update(std::vector<glm::ivec3>& changedVoxels);
+
+private:
+	struct LightNode {
+		glm::ivec3 position;
+		uint8_t level;
+	};
+
+	WorldManager& world;
+
+	std::vector<LightNode> removalQueues[CHANNEL_COUNT];
+	std::vector<LightNode> addQueues[CHANNEL_COUNT];
+	std::vector<LightNode> emitters;
+
+	// Chunk of the last lookup, reset on every public call
+	int cachedChunkX, cachedChunkZ;
+	Chunk* cachedChunk;
+	bool cacheValid;
+
+	Chunk* lookup(glm::ivec3 position, int& localX, int& localZ);
+	uint8_t getLight(Channel channel, glm::ivec3 position);
+	void propagate(Channel channel, std::vector<glm::ivec3>& changedVoxels);
+	void removeLight(Channel channel, std::vector<glm::ivec3>& changedVoxels);
+};
+
+#endif // !LIGHTENGINE_H
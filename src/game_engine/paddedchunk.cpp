@@ -0,0 +1,43 @@
+#include "paddedchunk.h"
+#include <algorithm>
+#include <cstring>
+
+void PaddedChunk::fill(const Chunk& chunk, const Chunk* neighbors[3][3]) {
+	const uint8_t fullSkyLight = MAX_LIGHT_LEVEL << 4;
+
+	for (int dx = 0; dx < 3; dx++) {
+		for (int dz = 0; dz < 3; dz++) {
+			loaded[dx][dz] = (dx == 1 && dz == 1) || neighbors[dx][dz] != nullptr;
+			neighborLod[dx][dz] = neighbors[dx][dz] ? neighbors[dx][dz]->lodLevel : -1;
+		}
+	}
+
+	for (int paddedX = 0; paddedX < SIZE_X; paddedX++) {
+		// Which column of chunks this slice comes from and the x inside that chunk
+		int dx = paddedX == 0 ? -1 : (paddedX == SIZE_X - 1 ? 1 : 0);
+		int sourceX = paddedX - 1 - dx * CHUNK_SIZE_X;
+		const Chunk* back = neighbors[dx + 1][0];
+		const Chunk* middle = dx == 0 ? &chunk : neighbors[dx + 1][1];
+		const Chunk* front = neighbors[dx + 1][2];
+
+		for (int y = 0; y < CHUNK_SIZE_Y; y++) {
+			int backIndex = Chunk::blockIndex(sourceX, y, CHUNK_SIZE_Z - 1);
+			int rowIndex = Chunk::blockIndex(sourceX, y, 0);
+
+			Block* row = blocks[paddedX][y];
+			uint8_t* lightRow = light[paddedX][y];
+			row[0] = back ? back->getBlockData()[backIndex] : AIR;
+			lightRow[0] = back ? back->getLightData()[backIndex] : fullSkyLight;
+			if (middle) {
+				memcpy(row + 1, &middle->getBlockData()[rowIndex], CHUNK_SIZE_Z * sizeof(Block));
+				memcpy(lightRow + 1, &middle->getLightData()[rowIndex], CHUNK_SIZE_Z);
+			}
+			else {
+				std::fill(row + 1, row + 1 + CHUNK_SIZE_Z, AIR);
+				memset(lightRow + 1, fullSkyLight, CHUNK_SIZE_Z);
+			}
+			row[SIZE_Z - 1] = front ? front->getBlockData()[rowIndex] : AIR;
+			lightRow[SIZE_Z - 1] = front ? front->getLightData()[rowIndex] : fullSkyLight;
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef PADDEDCHUNK_H
+#define PADDEDCHUNK_H
+
+#include "chunk.h"
+
+// Copy of a chunk's blocks and light plus a one block border taken from the 8 surrounding
+// chunks, the only input of the mesher. Filled on a worker while the world is not written to,
+// afterwards the mesher never looks at the world again.
+// Unloaded neighbors read as air with full skylight, everything above the world as well.
+class PaddedChunk {
+public:
+	static const int SIZE_X = CHUNK_SIZE_X + 2;
+	static const int SIZE_Z = CHUNK_SIZE_Z + 2;
+
+	// neighbors[dx + 1][dz + 1], nullptr for unloaded chunks, the center entry is ignored
+	void fill(const Chunk& chunk, const Chunk* neighbors[3][3]);
+
+	// Chunk local coordinates, x and z from -1 to CHUNK_SIZE
+	const Block& getBlock(int x, int y, int z) const { return blocks[x + 1][y][z + 1]; }
+	bool isOpaque(int x, int y, int z) const { return y >= 0 && y < CHUNK_SIZE_Y && blocks[x + 1][y][z + 1].isOpaque(); }
+
+	// Faces towards unloaded chunks stay hidden until the neighbor arrives and remeshes us
+	bool hidesFace(int x, int y, int z) const { return isOpaque(x, y, z) || !isLoaded(x, z); }
+	bool isLoaded(int x, int z) const { return loaded[x < 0 ? 0 : (x < CHUNK_SIZE_X ? 1 : 2)][z < 0 ? 0 : (z < CHUNK_SIZE_Z ? 1 : 2)]; }
+
+	// Level of detail the neighbor is meshed at, -1 if it is not loaded
+	int getNeighborLod(int dx, int dz) const { return neighborLod[dx + 1][dz + 1]; }
+
+	// Sky and block light of a voxel, 0 - 1
+	glm::vec2 getFaceLight(int x, int y, int z) const {
+		if (y < 0 || y >= CHUNK_SIZE_Y) {
+			return glm::vec2(1.0f, 0.0f);
+		}
+		uint8_t level = light[x + 1][y][z + 1];
+		return glm::vec2(level >> 4, level & 0x0F) / float(MAX_LIGHT_LEVEL);
+	}
+
+	// Raw blocks and light, laid out as [x + 1][y][z + 1]
+	const Block* getBlockData() const { return &blocks[0][0][0]; }
+	const uint8_t* getLightData() const { return &light[0][0][0]; }
+
+private:
+	Block blocks[SIZE_X][CHUNK_SIZE_Y][SIZE_Z];
+	uint8_t light[SIZE_X][CHUNK_SIZE_Y][SIZE_Z];
+	bool loaded[3][3];
+	int neighborLod[3][3];
+};
+
+#endif // !PADDEDCHUNK_H
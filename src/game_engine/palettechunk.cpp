@@ -0,0 +1,59 @@
+#include "palettechunk.h"
+#include <cstring>
+
+bool PaletteChunk::pack(const PaddedChunk& padded) {
+	data.assign(SIZE, 0);
+
+	uint32_t flags = 0;
+	for (int dx = 0; dx < 3; dx++) {
+		for (int dz = 0; dz < 3; dz++) {
+			int x = dx == 0 ? -1 : (dx == 1 ? 0 : CHUNK_SIZE_X);
+			int z = dz == 0 ? -1 : (dz == 1 ? 0 : CHUNK_SIZE_Z);
+			if (padded.isLoaded(x, z)) {
+				flags |= 1u << (dx * 3 + dz);
+			}
+		}
+	}
+	// Full detail chunks put skirts towards neighbors at a coarser level
+	const int sides[4][2] = { { 0, 1 }, { 0, -1 }, { -1, 0 }, { 1, 0 } };
+	for (int side = 0; side < 4; side++) {
+		if (padded.getNeighborLod(sides[side][0], sides[side][1]) > 0) {
+			flags |= 1u << (SKIRT_FLAGS_SHIFT + side);
+		}
+	}
+	data[FLAGS_OFFSET] = flags;
+
+	// Chunks only hold a handful of block kinds, runs along z mostly repeat the previous one
+	Block palette[MAX_PALETTE_SIZE];
+	uint32_t paletteSize = 0;
+	uint8_t* ids = reinterpret_cast<uint8_t*>(&data[IDS_OFFSET]);
+	const Block* blocks = padded.getBlockData();
+	uint32_t previousId = 0;
+	for (uint32_t voxel = 0; voxel < VOXEL_COUNT; voxel++) {
+		const Block& block = blocks[voxel];
+		if (paletteSize == 0 || block != palette[previousId]) {
+			uint32_t id = 0;
+			while (id < paletteSize && block != palette[id]) {
+				id++;
+			}
+			if (id == paletteSize) {
+				if (paletteSize == MAX_PALETTE_SIZE || block.getRenderLayer() == Block::LAYER_TRANSLUCENT) {
+					return false;
+				}
+				palette[paletteSize++] = block;
+			}
+			previousId = id;
+		}
+		ids[voxel] = uint8_t(previousId);
+	}
+
+	data[PALETTE_SIZE_OFFSET] = paletteSize;
+	for (uint32_t id = 0; id < paletteSize; id++) {
+		const Block& block = palette[id];
+		data[PALETTE_OFFSET + id * 2] = block.type | (block.topTexture << 8) | (block.sideTexture << 16) | (uint32_t(block.bottomTexture) << 24);
+		data[PALETTE_OFFSET + id * 2 + 1] = uint32_t(block.getRenderLayer()) | (block.isOpaque() ? 4u : 0u);
+	}
+
+	memcpy(&data[LIGHT_OFFSET], padded.getLightData(), VOXEL_COUNT);
+	return true;
+}
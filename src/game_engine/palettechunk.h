@@ -0,0 +1,41 @@
+#ifndef PALETTECHUNK_H
+#define PALETTECHUNK_H
+
+#include <cstdint>
+#include <vector>
+#include "paddedchunk.h"
+
+// Compact copy of a padded chunk, the input of the GPU mesher (shaders/chunkmesh_comp.glsl).
+// Every voxel is a one byte index into a palette of the blocks that occur plus its light byte,
+// about 40 KB instead of the hundreds of KB of a finished mesh. Stored as one array of uints that
+// is copied into the mesher's input buffer as is, the shader uses the same offsets.
+// Only for level of detail 0, coarser levels are always meshed on the CPU.
+class PaletteChunk {
+public:
+	static const uint32_t MAX_PALETTE_SIZE = 256;
+	static const uint32_t VOXEL_COUNT = PaddedChunk::SIZE_X * CHUNK_SIZE_Y * PaddedChunk::SIZE_Z;
+	static_assert(VOXEL_COUNT % 4 == 0, "Voxel bytes are packed four to a uint");
+
+	// Bit dx * 3 + dz: the chunk at (dx - 1, dz - 1) is loaded.
+	// Bit SKIRT_FLAGS_SHIFT + i: skirt towards the neighbor of side i (FRONT, BACK, LEFT, RIGHT), it is at a coarser level.
+	static const uint32_t FLAGS_OFFSET = 0;
+	static const uint32_t SKIRT_FLAGS_SHIFT = 9;
+	static const uint32_t PALETTE_SIZE_OFFSET = 1;
+	// Two uints per entry: type, top, side and bottom texture in bytes, then render layer | opaque << 2
+	static const uint32_t PALETTE_OFFSET = 2;
+	// One byte per voxel in the padded layout [x + 1][y][z + 1], lowest byte first
+	static const uint32_t IDS_OFFSET = PALETTE_OFFSET + MAX_PALETTE_SIZE * 2;
+	static const uint32_t LIGHT_OFFSET = IDS_OFFSET + VOXEL_COUNT / 4;
+	static const uint32_t SIZE = LIGHT_OFFSET + VOXEL_COUNT / 4;
+
+	// False if the chunk has to be meshed on the CPU: more than MAX_PALETTE_SIZE different blocks,
+	// or translucent blocks, whose faces are sorted on the CPU
+	bool pack(const PaddedChunk& padded);
+
+	const std::vector<uint32_t>& getData() const { return data; }
+
+private:
+	std::vector<uint32_t> data;
+};
+
+#endif // !PALETTECHUNK_H
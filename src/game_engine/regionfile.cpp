@@ -0,0 +1,335 @@
+#include "regionfile.h"
+#include "../logger.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint8_t REGION_MAGIC[4] = { 'M', 'C', 'R', 'G' };
+const uint32_t REGION_VERSION = 1;
+const uint32_t REGION_FILE_HEADER_SIZE = 16; // magic, version, reserved
+const uint32_t REGION_HEADER_SECTORS = (REGION_FILE_HEADER_SIZE + REGION_CHUNK_COUNT * 8 + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+
+RegionFile::RegionFile(const std::string& path) {
+	opened = false;
+	tableDirty = false;
+	fileSize = 0;
+	mapped = nullptr;
+	mappedSize = 0;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#else
+	fileDescriptor = -1;
+#endif
+	memset(table, 0, sizeof(table));
+
+	if (!openFile(path)) {
+		closeFile();
+		return;
+	}
+
+	if (fileSize == 0) {
+		// New region, write an empty header
+		std::vector<uint8_t> header(REGION_HEADER_SECTORS * REGION_SECTOR_SIZE, 0);
+		memcpy(header.data(), REGION_MAGIC, sizeof(REGION_MAGIC));
+		memcpy(header.data() + 4, &REGION_VERSION, sizeof(REGION_VERSION));
+		if (!writeAt(0, header.data(), header.size())) {
+			LOG_ERROR("Could not write region header: ", path);
+			closeFile();
+			return;
+		}
+		fileSize = header.size();
+	}
+	else {
+		if (fileSize < REGION_HEADER_SECTORS * REGION_SECTOR_SIZE || !map()
+			|| memcmp(mapped, REGION_MAGIC, sizeof(REGION_MAGIC)) != 0) {
+			LOG_ERROR("Invalid region file: ", path);
+			closeFile();
+			return;
+		}
+		uint32_t version;
+		memcpy(&version, mapped + 4, sizeof(version));
+		if (version != REGION_VERSION) {
+			LOG_ERROR("Unsupported region file version ", version, ": ", path);
+			closeFile();
+			return;
+		}
+		memcpy(table, mapped + REGION_FILE_HEADER_SIZE, sizeof(table));
+	}
+
+	// Rebuild the sector allocation map from the table
+	usedSectors.assign(sectorsFor(fileSize), false);
+	markSectors(0, REGION_HEADER_SECTORS, true);
+	for (TableEntry& entry : table) {
+		if (entry.byteSize == 0) {
+			continue;
+		}
+		uint64_t end = (uint64_t(entry.firstSector) + sectorsFor(entry.byteSize)) * REGION_SECTOR_SIZE;
+		if (entry.firstSector < REGION_HEADER_SECTORS || end > fileSize) {
+			LOG_WARNING("Dropping corrupt chunk entry in region file: ", path);
+			entry = {};
+			continue;
+		}
+		markSectors(entry.firstSector, sectorsFor(entry.byteSize), true);
+	}
+
+	opened = true;
+}
+
+RegionFile::~RegionFile() {
+	flushTable();
+	closeFile();
+}
+
+bool RegionFile::hasChunk(int localX, int localZ) const {
+	return opened && table[tableIndex(localX, localZ)].byteSize != 0;
+}
+
+bool RegionFile::readChunk(int localX, int localZ, const uint8_t*& data, size_t& size) {
+	if (!hasChunk(localX, localZ)) {
+		return false;
+	}
+
+	// The mapping is dropped whenever the file grows, map it again lazily
+	if (mappedSize < fileSize && !map()) {
+		return false;
+	}
+
+	const TableEntry& entry = table[tableIndex(localX, localZ)];
+	data = mapped + uint64_t(entry.firstSector) * REGION_SECTOR_SIZE;
+	size = entry.byteSize;
+	return true;
+}
+
+bool RegionFile::writeChunk(int localX, int localZ, const uint8_t* data, size_t size) {
+	if (!opened) {
+		return false;
+	}
+
+	int index = tableIndex(localX, localZ);
+	TableEntry entry = table[index];
+	uint32_t neededSectors = sectorsFor(size);
+
+	// Never overwrite the old payload, the table on disk may still point at it
+	SectorRun oldRun = { entry.firstSector, sectorsFor(entry.byteSize) };
+	entry.firstSector = neededSectors ? allocateSectors(neededSectors) : 0;
+	entry.byteSize = uint32_t(size);
+
+	if (size > 0) {
+		uint64_t offset = uint64_t(entry.firstSector) * REGION_SECTOR_SIZE;
+		uint64_t end = offset + uint64_t(neededSectors) * REGION_SECTOR_SIZE;
+		if (end > fileSize) {
+			unmap();
+		}
+		bool written = writeAt(offset, data, size);
+		// Pad the last sector so the file always ends on a sector boundary
+		if (written && end > fileSize) {
+			std::vector<uint8_t> padding(size_t(end - offset - size), 0);
+			written = padding.empty() || writeAt(offset + size, padding.data(), padding.size());
+			if (written) {
+				fileSize = end;
+			}
+		}
+		if (!written) {
+			LOG_ERROR("Failed to write chunk payload to region file");
+			markSectors(entry.firstSector, neededSectors, false);
+			return false;
+		}
+	}
+
+	if (oldRun.count > 0) {
+		pendingFreeSectors.push_back(oldRun);
+	}
+	table[index] = entry;
+	tableDirty = true;
+	return true;
+}
+
+bool RegionFile::flushTable() {
+	if (!opened || !tableDirty) {
+		return true;
+	}
+
+	// Payloads first, the table must never point at sectors that are not on disk yet
+	if (!syncFile() || !writeAt(REGION_FILE_HEADER_SIZE, table, sizeof(table)) || !syncFile()) {
+		LOG_ERROR("Failed to write region table");
+		return false;
+	}
+	tableDirty = false;
+
+	// Nothing on disk refers to the replaced payloads anymore
+	for (const SectorRun& run : pendingFreeSectors) {
+		markSectors(run.first, run.count, false);
+	}
+	pendingFreeSectors.clear();
+	return true;
+}
+
+uint32_t RegionFile::allocateSectors(uint32_t count) {
+	// First fit, append to the end of the file if no hole is big enough
+	uint32_t runStart = 0;
+	uint32_t runLength = 0;
+	for (uint32_t i = REGION_HEADER_SECTORS; i < usedSectors.size(); i++) {
+		if (usedSectors[i]) {
+			runLength = 0;
+			continue;
+		}
+		if (runLength == 0) {
+			runStart = i;
+		}
+		if (++runLength == count) {
+			markSectors(runStart, count, true);
+			return runStart;
+		}
+	}
+
+	uint32_t first = runLength > 0 ? runStart : uint32_t(usedSectors.size());
+	markSectors(first, count, true);
+	return first;
+}
+
+void RegionFile::markSectors(uint32_t first, uint32_t count, bool used) {
+	if (first + count > usedSectors.size()) {
+		usedSectors.resize(first + count, false);
+	}
+	for (uint32_t i = first; i < first + count; i++) {
+		usedSectors[i] = used;
+	}
+}
+
+#ifdef _WIN32
+
+bool RegionFile::openFile(const std::string& path) {
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		LOG_ERROR("Could not open region file: ", path);
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size)) {
+		return false;
+	}
+	fileSize = uint64_t(size.QuadPart);
+	return true;
+}
+
+void RegionFile::closeFile() {
+	unmap();
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+	opened = false;
+}
+
+bool RegionFile::map() {
+	unmap();
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		return false;
+	}
+	mapped = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped) {
+		unmap();
+		return false;
+	}
+	mappedSize = fileSize;
+	return true;
+}
+
+void RegionFile::unmap() {
+	if (mapped) {
+		UnmapViewOfFile(mapped);
+		mapped = nullptr;
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	mappedSize = 0;
+}
+
+bool RegionFile::writeAt(uint64_t offset, const void* data, size_t size) {
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = DWORD(offset >> 32);
+	DWORD written = 0;
+	return WriteFile(fileHandle, data, DWORD(size), &written, &overlapped) && written == size;
+}
+
+bool RegionFile::syncFile() {
+	return FlushFileBuffers(fileHandle) != 0;
+}
+
+#else
+
+bool RegionFile::openFile(const std::string& path) {
+	fileDescriptor = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fileDescriptor < 0) {
+		LOG_ERROR("Could not open region file: ", path);
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0) {
+		return false;
+	}
+	fileSize = uint64_t(fileStat.st_size);
+	return true;
+}
+
+void RegionFile::closeFile() {
+	unmap();
+	if (fileDescriptor >= 0) {
+		close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+	opened = false;
+}
+
+bool RegionFile::map() {
+	unmap();
+	void* result = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	if (result == MAP_FAILED) {
+		return false;
+	}
+	mapped = (const uint8_t*)result;
+	mappedSize = fileSize;
+	return true;
+}
+
+void RegionFile::unmap() {
+	if (mapped) {
+		munmap((void*)mapped, mappedSize);
+		mapped = nullptr;
+	}
+	mappedSize = 0;
+}
+
+bool RegionFile::writeAt(uint64_t offset, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	while (size > 0) {
+		ssize_t written = pwrite(fileDescriptor, bytes, size, off_t(offset));
+		if (written <= 0) {
+			return false;
+		}
+		bytes += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool RegionFile::syncFile() {
+	return fsync(fileDescriptor) == 0;
+}
+
+#endif
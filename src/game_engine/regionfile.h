@@ -0,0 +1,92 @@
+#ifndef REGIONFILE_H
+#define REGIONFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// const region constants
+const int REGION_SIZE = 32; // Chunks per region along x and z
+const int REGION_CHUNK_COUNT = REGION_SIZE * REGION_SIZE;
+const uint32_t REGION_SECTOR_SIZE = 4096;
+
+// A region file stores the payloads of 32x32 chunks.
+//
+// Layout:
+//   file header (magic, version) followed by a table of REGION_CHUNK_COUNT
+//   entries { uint32 firstSector, uint32 byteSize }, padded to whole sectors.
+//   Every chunk payload starts on a sector boundary and occupies
+//   ceil(byteSize / REGION_SECTOR_SIZE) sectors.
+//
+// Reads go through a read-only memory mapping of the whole file, writes use
+// positioned writes so a single chunk can be rewritten without touching the rest.
+// Writes are copy-on-write: a new payload always goes to free sectors, and the sectors
+// of the old one stay allocated until the table no longer pointing at them is on disk.
+// A crash before flushTable leaves the previous version of every chunk intact.
+class RegionFile {
+public:
+	RegionFile(const std::string& path);
+	~RegionFile();
+
+	RegionFile(const RegionFile&) = delete;
+	RegionFile& operator=(const RegionFile&) = delete;
+
+	bool isOpen() const { return opened; }
+
+	bool hasChunk(int localX, int localZ) const;
+
+	// Points data into the mapped file. Only valid until the next write to this region.
+	bool readChunk(int localX, int localZ, const uint8_t*& data, size_t& size);
+	bool writeChunk(int localX, int localZ, const uint8_t* data, size_t size);
+
+	// Table updates from writeChunk are kept in memory until flushed,
+	// so a batch of chunk writes costs a single header write.
+	// The payloads are synced before the table, then the replaced sectors are released.
+	bool flushTable();
+
+	static int toRegionCoord(int chunkCoord) { return chunkCoord >= 0 ? chunkCoord / REGION_SIZE : (chunkCoord + 1) / REGION_SIZE - 1; }
+	static int toLocalCoord(int chunkCoord) { return chunkCoord - toRegionCoord(chunkCoord) * REGION_SIZE; }
+
+private:
+	struct TableEntry {
+		uint32_t firstSector;
+		uint32_t byteSize;
+	};
+
+	static uint32_t sectorsFor(size_t bytes) { return uint32_t((bytes + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE); }
+	static int tableIndex(int localX, int localZ) { return localX + localZ * REGION_SIZE; }
+
+	bool openFile(const std::string& path);
+	void closeFile();
+	bool map();
+	void unmap();
+	bool writeAt(uint64_t offset, const void* data, size_t size);
+	bool syncFile();
+
+	uint32_t allocateSectors(uint32_t count);
+	void markSectors(uint32_t first, uint32_t count, bool used);
+
+	bool opened;
+	uint64_t fileSize;
+	TableEntry table[REGION_CHUNK_COUNT];
+	bool tableDirty;
+	std::vector<bool> usedSectors;
+	// Sectors of replaced payloads, the table on disk may still point at them until the next flush
+	struct SectorRun {
+		uint32_t first;
+		uint32_t count;
+	};
+	std::vector<SectorRun> pendingFreeSectors;
+
+	// Platform handles
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+	const uint8_t* mapped;
+	uint64_t mappedSize;
+};
+
+#endif // !REGIONFILE_H
@@ -0,0 +1,338 @@
+#include "texturepack.h"
+#include "threadpool.h"
+#include "../logger.h"
+#include <stb/stb_image.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint8_t TEXTURE_PACK_MAGIC[4] = { 'M', 'C', 'T', 'P' };
+const uint32_t TEXTURE_PACK_VERSION = 1;
+
+struct TexturePackHeader {
+	uint8_t magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t width;
+	uint32_t height;
+	uint32_t layerCount;
+	uint32_t mipLevels;
+	uint64_t dataSize;
+};
+
+TexturePack::TexturePack() {
+	width = 0;
+	height = 0;
+	layerCount = 0;
+	mipLevels = 0;
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#else
+	fileDescriptor = -1;
+#endif
+	mapped = nullptr;
+	mappedSize = 0;
+}
+
+TexturePack::~TexturePack() {
+	unmap();
+}
+
+bool TexturePack::load(const std::vector<const char*>& paths, const std::string& cachePath) {
+	if (paths.empty()) {
+		return false;
+	}
+
+	uint64_t sourceHash = hashSources(paths);
+	if (loadCache(cachePath, sourceHash)) {
+		return true;
+	}
+
+	LOG_INFO("Texture cache is missing or stale, decoding ", paths.size(), " textures");
+	bool complete = false;
+	if (!decode(paths, complete)) {
+		return false;
+	}
+	// Missing textures are retried on the next start
+	if (complete) {
+		writeCache(cachePath, sourceHash);
+	}
+	return true;
+}
+
+size_t TexturePack::getLevelOffset(uint32_t level) const {
+	size_t offset = 0;
+	for (uint32_t i = 0; i < level; i++) {
+		offset += size_t(getLevelSize(width, i)) * getLevelSize(height, i) * 4 * layerCount;
+	}
+	return offset;
+}
+
+uint32_t TexturePack::getMipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+	while (getLevelSize(width, levels - 1) > 1 || getLevelSize(height, levels - 1) > 1) {
+		levels++;
+	}
+	return levels;
+}
+
+bool TexturePack::loadCache(const std::string& cachePath, uint64_t sourceHash) {
+	if (!map(cachePath)) {
+		return false;
+	}
+
+	TexturePackHeader header;
+	if (mappedSize < sizeof(header)) {
+		unmap();
+		return false;
+	}
+	memcpy(&header, mapped, sizeof(header));
+	if (memcmp(header.magic, TEXTURE_PACK_MAGIC, sizeof(TEXTURE_PACK_MAGIC)) != 0 || header.version != TEXTURE_PACK_VERSION
+		|| header.sourceHash != sourceHash || header.dataSize != mappedSize - sizeof(header)) {
+		unmap();
+		return false;
+	}
+
+	// The sizes are checked before getLevelOffset walks the mip chain with them
+	bool validSize = header.width > 0 && header.height > 0 && header.layerCount > 0
+		&& uint64_t(header.width) * header.height * 4 <= header.dataSize / header.layerCount;
+	if (!validSize || header.mipLevels != getMipLevelCount(header.width, header.height)) {
+		LOG_WARNING("Damaged texture cache: ", cachePath);
+		unmap();
+		return false;
+	}
+
+	width = header.width;
+	height = header.height;
+	layerCount = header.layerCount;
+	mipLevels = header.mipLevels;
+	if (getLevelOffset(mipLevels) != header.dataSize) {
+		LOG_WARNING("Damaged texture cache: ", cachePath);
+		unmap();
+		return false;
+	}
+
+	data = mapped + sizeof(header);
+	size = header.dataSize;
+	return true;
+}
+
+bool TexturePack::decode(const std::vector<const char*>& paths, bool& complete) {
+	layerCount = uint32_t(paths.size());
+	std::vector<uint8_t*> images(layerCount, nullptr);
+	std::vector<int> widths(layerCount, 0);
+	std::vector<int> heights(layerCount, 0);
+
+	ThreadPool threadPool;
+	threadPool.parallelFor(layerCount, [&](size_t layer) {
+		int channels = 0;
+		images[layer] = stbi_load(paths[layer], &widths[layer], &heights[layer], &channels, 4);  // Load as RGBA
+	});
+
+	if (!images[0]) {
+		LOG_ERROR("Could not load image data for the first texture!");
+		for (uint8_t* image : images) {
+			stbi_image_free(image);
+		}
+		return false;
+	}
+
+	width = uint32_t(widths[0]);
+	height = uint32_t(heights[0]);
+	mipLevels = getMipLevelCount(width, height);
+
+	size = getLevelOffset(mipLevels);
+	decoded.assign(size, 0);
+	data = decoded.data();
+
+	complete = true;
+	size_t layerSize = size_t(width) * height * 4;
+	for (uint32_t layer = 0; layer < layerCount; layer++) {
+		if (!images[layer]) {
+			LOG_ERROR("Could not load image data for layer ", layer);
+			complete = false;
+		}
+		else if (widths[layer] != widths[0] || heights[layer] != heights[0]) {
+			LOG_ERROR("Texture ", paths[layer], " is ", widths[layer], "x", heights[layer], ", the array needs ", width, "x", height);
+			complete = false;
+		}
+		else {
+			memcpy(decoded.data() + layerSize * layer, images[layer], layerSize);
+		}
+		stbi_image_free(images[layer]);
+	}
+
+	threadPool.parallelFor(layerCount, [&](size_t layer) {
+		for (uint32_t level = 1; level < mipLevels; level++) {
+			uint32_t sourceWidth = getLevelSize(width, level - 1);
+			uint32_t sourceHeight = getLevelSize(height, level - 1);
+			size_t sourceLayerSize = size_t(sourceWidth) * sourceHeight * 4;
+			size_t targetLayerSize = size_t(getLevelSize(width, level)) * getLevelSize(height, level) * 4;
+			buildMip(decoded.data() + getLevelOffset(level - 1) + sourceLayerSize * layer, sourceWidth, sourceHeight,
+				decoded.data() + getLevelOffset(level) + targetLayerSize * layer);
+		}
+	});
+	return true;
+}
+
+void TexturePack::buildMip(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint8_t* target) {
+	uint32_t targetWidth = getLevelSize(sourceWidth, 1);
+	uint32_t targetHeight = getLevelSize(sourceHeight, 1);
+	for (uint32_t y = 0; y < targetHeight; y++) {
+		uint32_t y0 = std::min(y * 2, sourceHeight - 1);
+		uint32_t y1 = std::min(y * 2 + 1, sourceHeight - 1);
+		for (uint32_t x = 0; x < targetWidth; x++) {
+			uint32_t x0 = std::min(x * 2, sourceWidth - 1);
+			uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1);
+			for (uint32_t channel = 0; channel < 4; channel++) {
+				uint32_t sum = source[(y0 * sourceWidth + x0) * 4 + channel] + source[(y0 * sourceWidth + x1) * 4 + channel]
+					+ source[(y1 * sourceWidth + x0) * 4 + channel] + source[(y1 * sourceWidth + x1) * 4 + channel];
+				target[(y * targetWidth + x) * 4 + channel] = uint8_t((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void TexturePack::writeCache(const std::string& cachePath, uint64_t sourceHash) {
+	TexturePackHeader header = {};
+	memcpy(header.magic, TEXTURE_PACK_MAGIC, sizeof(TEXTURE_PACK_MAGIC));
+	header.version = TEXTURE_PACK_VERSION;
+	header.sourceHash = sourceHash;
+	header.width = width;
+	header.height = height;
+	header.layerCount = layerCount;
+	header.mipLevels = mipLevels;
+	header.dataSize = size;
+
+	// Written next to the old cache and renamed over it, so a crash never leaves a half written cache behind
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+	std::string temporaryPath = cachePath + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)data, size);
+		if (!file) {
+			LOG_WARNING("Could not write the texture cache ", temporaryPath);
+			return;
+		}
+	}
+	std::filesystem::rename(temporaryPath, cachePath, error);
+	if (error) {
+		LOG_WARNING("Could not replace the texture cache ", cachePath, ": ", error.message());
+	}
+}
+
+uint64_t TexturePack::hashSources(const std::vector<const char*>& paths) {
+	// FNV-1a over the paths, sizes and modification times of the textures
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* bytes, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			hash = (hash ^ ((const uint8_t*)bytes)[i]) * 1099511628211ull;
+		}
+	};
+
+	add(&TEXTURE_PACK_VERSION, sizeof(TEXTURE_PACK_VERSION));
+	for (const char* path : paths) {
+		std::error_code error;
+		uint64_t fileSize = std::filesystem::file_size(path, error);
+		int64_t writeTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+		add(path, strlen(path) + 1);
+		add(&fileSize, sizeof(fileSize));
+		add(&writeTime, sizeof(writeTime));
+	}
+	return hash;
+}
+
+#ifdef _WIN32
+
+bool TexturePack::map(const std::string& path) {
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		unmap();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		unmap();
+		return false;
+	}
+	mapped = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped) {
+		unmap();
+		return false;
+	}
+	mappedSize = uint64_t(fileSize.QuadPart);
+	return true;
+}
+
+void TexturePack::unmap() {
+	if (mapped) {
+		UnmapViewOfFile(mapped);
+		mapped = nullptr;
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+	mappedSize = 0;
+}
+
+#else
+
+bool TexturePack::map(const std::string& path) {
+	fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+		unmap();
+		return false;
+	}
+	void* result = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	if (result == MAP_FAILED) {
+		unmap();
+		return false;
+	}
+	mapped = (const uint8_t*)result;
+	mappedSize = uint64_t(fileStat.st_size);
+	return true;
+}
+
+void TexturePack::unmap() {
+	if (mapped) {
+		munmap((void*)mapped, mappedSize);
+		mapped = nullptr;
+	}
+	if (fileDescriptor >= 0) {
+		close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+	mappedSize = 0;
+}
+
+#endif
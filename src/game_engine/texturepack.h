@@ -0,0 +1,71 @@
+#ifndef TEXTUREPACK_H
+#define TEXTUREPACK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The block textures decoded to RGBA8 with their whole mip chains, ready to be copied into a texture array.
+//
+// The PNGs are only decoded when the cache file is missing or stale (a texture file changed, or the
+// cache is from another version), on a thread pool with one texture per task. The result is written
+// to the cache, later starts map the cache file and use the pixels in place.
+//
+// Cache layout:
+//   header (magic, version, source hash, width, height, layer count, mip levels, data size)
+//   followed by the pixels level by level, all layers of a level one after the other.
+class TexturePack {
+public:
+	TexturePack();
+	~TexturePack();
+
+	TexturePack(const TexturePack&) = delete;
+	TexturePack& operator=(const TexturePack&) = delete;
+
+	// All textures must have the size of the first one
+	bool load(const std::vector<const char*>& paths, const std::string& cachePath);
+
+	const uint8_t* getData() const { return data; }
+	size_t getSize() const { return size; }
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+	uint32_t getLayerCount() const { return layerCount; }
+	uint32_t getMipLevels() const { return mipLevels; }
+	bool isFromCache() const { return mapped != nullptr; }
+
+	size_t getLevelOffset(uint32_t level) const;
+	static uint32_t getLevelSize(uint32_t size, uint32_t level) { return (size >> level) > 0 ? size >> level : 1; }
+	// Full mip chain down to 1x1
+	static uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+private:
+	bool loadCache(const std::string& cachePath, uint64_t sourceHash);
+	bool decode(const std::vector<const char*>& paths, bool& complete);
+	void writeCache(const std::string& cachePath, uint64_t sourceHash);
+	static uint64_t hashSources(const std::vector<const char*>& paths);
+	// 2x2 box filter, odd sizes repeat their last row or column
+	static void buildMip(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint8_t* target);
+
+	bool map(const std::string& path);
+	void unmap();
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t layerCount;
+	uint32_t mipLevels;
+	const uint8_t* data; // Into the mapped cache or decoded
+	size_t size;
+	std::vector<uint8_t> decoded;
+
+	// Platform handles
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+	const uint8_t* mapped;
+	uint64_t mappedSize;
+};
+
+#endif // !TEXTUREPACK_H
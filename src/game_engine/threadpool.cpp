@@ -0,0 +1,81 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) : stopping(false), jobGeneration(0), task(nullptr), taskCount(0), nextTask(0), activeWorkers(0) {
+	if (threadCount == 0) {
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads.emplace_back(&ThreadPool::run, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+	if (count == 0) {
+		return;
+	}
+	if (count == 1 || threads.empty()) {
+		for (size_t i = 0; i < count; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		taskCount = count;
+		nextTask = 0;
+		activeWorkers = threads.size();
+		jobGeneration++;
+	}
+	wakeUp.notify_all();
+
+	work();
+
+	// The task object lives on our stack, wait until no worker can touch it anymore
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this] { return activeWorkers == 0; });
+	this->task = nullptr;
+}
+
+void ThreadPool::run() {
+	uint64_t seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [&] { return stopping || jobGeneration != seenGeneration; });
+			if (stopping) {
+				return;
+			}
+			seenGeneration = jobGeneration;
+		}
+
+		work();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		jobDone.notify_one();
+	}
+}
+
+void ThreadPool::work() {
+	size_t i;
+	while ((i = nextTask.fetch_add(1)) < taskCount) {
+		(*task)(i);
+	}
+}
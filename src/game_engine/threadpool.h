@@ -0,0 +1,46 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel jobs (chunk generation, lighting, meshing).
+// parallelFor blocks until every task is done, the calling thread works along.
+class ThreadPool {
+public:
+	// 0 picks one thread less than the hardware has, the caller is the last one
+	ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+	size_t getThreadCount() const { return threads.size(); }
+
+private:
+	void run();
+	void work();
+
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::condition_variable jobDone;
+	bool stopping;
+	uint64_t jobGeneration;
+
+	// Current job
+	const std::function<void(size_t)>* task;
+	size_t taskCount;
+	std::atomic<size_t> nextTask;
+	size_t activeWorkers;
+};
+
+#endif // !THREADPOOL_H
@@ -11,6 +11,8 @@ struct Vertex {
     glm::vec3 normal;
     glm::vec2 texCoord;
     int texIndex;
+    glm::vec2 light; // Sky and block light, 0 - 1
+    float ao; // Ambient occlusion of the corner, 0 (dark) - 1 (open)
 };
 
 #endif // VERTEX_H
\ No newline at end of file
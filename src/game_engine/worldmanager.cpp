@@ -1,25 +1,99 @@
 #include "worldmanager.h"
 #include "../logger.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
 
 const float groundLevel = 0.0f;
 const float maxHeight = 50.0f;
 const float noiseScale = 0.1f;
-WorldManager::WorldManager() {
+const size_t maxPendingLoads = 64;
+const float autosaveInterval = 30.0f; // Seconds between saves of edited chunks
+const char* worldDirectory = "../saves/world";
+const int defaultWorldSeed = 1337;
+// BUMP THIS WHENEVER generateTerrain PRODUCES DIFFERENT BLOCKS, SAVED EDITS ARE DELTAS AGAINST IT
+const uint32_t terrainGeneratorVersion = 1;
+const int defaultLodRings[ChunkMesher::LOD_LEVEL_COUNT - 1] = { 4, 8, 12 };
+
+WorldManager::WorldManager()
+	: worldSeed(defaultWorldSeed),
+	saveMode(openLevel(worldSeed)),
+	chunkIO(worldDirectory, saveMode,
+		{ worldSeed, terrainGeneratorVersion, [this](int chunkX, int chunkZ, Block* blocks) { generateTerrain(chunkX, chunkZ, blocks); } }),
+	lightEngine(*this) {
+	autosaveTimer = 0.0f;
+	editBatchDepth = 0;
+	meshVersionCounter = 0;
+	gpuMeshing = false;
+	validateGpuMeshes = false;
+	lodCenter = { 0, 0 };
+	for (int level = 0; level < ChunkMesher::LOD_LEVEL_COUNT - 1; level++) {
+		lodRings[level] = defaultLodRings[level];
+	}
 	noiseGenerator.SetNoiseType(FastNoiseLite::NoiseType_Perlin); // PERLIN NOISE
 	noiseGenerator.SetFrequency(noiseScale); // CHANGEABLE
+	noiseGenerator.SetSeed(worldSeed);
 }
 
-float WorldManager::getHeight(float x, float z) {
+WorldStorage::SaveMode WorldManager::openLevel(int& seed) {
+	WorldStorage::LevelInfo level;
+	if (WorldStorage::readLevelInfo(worldDirectory, level)) {
+		// The saved edits are deltas against the terrain of that generator, on other terrain they would
+		// wreck the world. It is left untouched and nothing is loaded from or saved to it.
+		if (level.generatorVersion != terrainGeneratorVersion) {
+			LOG_ERROR("World in ", worldDirectory, " was created with terrain generator ", level.generatorVersion, ", this build has ",
+				terrainGeneratorVersion, ". Not loading it, the world is played without saving");
+			seed = level.seed;
+			return WorldStorage::SAVE_MODE_NONE;
+		}
+		seed = level.seed;
+		return WorldStorage::SAVE_MODE_DELTA;
+	}
+
+	level.seed = defaultWorldSeed;
+	level.generatorVersion = terrainGeneratorVersion;
+	WorldStorage::writeLevelInfo(worldDirectory, level);
+	seed = level.seed;
+	return WorldStorage::SAVE_MODE_DELTA;
+}
+
+float WorldManager::getHeight(float x, float z) const {
 	float noiseValue = noiseGenerator.GetNoise(x * noiseScale, z * noiseScale);
 
 	return (noiseValue + 1.0f) / 2.0f * maxHeight;
 }
 
-void WorldManager::generateChunks(int chunkX, int chunkZ) {
-	glm::vec3 chunkPosition = glm::vec3(chunkX * CHUNK_SIZE_X, 0, chunkZ * CHUNK_SIZE_Z);
+float WorldManager::getSurfaceHeight(float x, float z) const {
+	// The top block of a column starts at the truncated height, on average its top face is half a block above it
+	return groundLevel + getHeight(x, z) + 0.5f;
+}
 
-	Chunk* chunk = new Chunk(chunkPosition);
+Block WorldManager::getSurfaceBlock(int x, int z) const {
+	// Highest non air block of the column, grass unless the column is cut off by the top of the world
+	int highestBlockY = static_cast<int>(groundLevel + getHeight(float(x), float(z)));
+	for (int y = std::min(highestBlockY, CHUNK_SIZE_Y - 1); y >= 0; y--) {
+		Block block = getGeneratedBlock(y, highestBlockY);
+		if (!block.isAir()) {
+			return block;
+		}
+	}
+	return AIR;
+}
 
+Block WorldManager::getGeneratedBlock(int y, int highestBlockY) {
+	if (y < highestBlockY - 5) {
+		return STONE_BLOCK; // Deep stone
+	}
+	if (y < highestBlockY) {
+		return DIRT_BLOCK; // Dirt layer below grass
+	}
+	if (y == highestBlockY) {
+		return GRASS_BLOCK; // Grass on top
+	}
+	return AIR;
+}
+
+void WorldManager::generateTerrain(int chunkX, int chunkZ, Block* blocks) const {
 	for (int x = 0; x < CHUNK_SIZE_X; x++) {
 		for (int z = 0; z < CHUNK_SIZE_Z; z++) {
 
@@ -30,243 +104,66 @@ void WorldManager::generateChunks(int chunkX, int chunkZ) {
 			int highestBlockY = static_cast<int>(height);
 
 			for (int y = 0; y < CHUNK_SIZE_Y; y++) {
-
-				Block block;
-
-				if (y < highestBlockY - 5) {
-					block = STONE_BLOCK; // Deep stone
-				}
-				else if (y < highestBlockY) {
-					block = DIRT_BLOCK; // Dirt layer below grass
-				}
-				else if (y == highestBlockY) {
-					block = GRASS_BLOCK; // Grass on top
-				}
-				else {
-					continue; // Skip air blocks for culling
-				}
-
-				chunk->setBlock(x, y, z, block);
-				
-				//glm::vec3 position = glm::vec3(x, y, z);
-				/*if (z == CHUNK_SIZE_Z - 1 || chunk->getBlock(x, y, z + 1).isAir()) {
-					chunk->addFaceToMesh(position, Chunk::FaceDirection::FRONT, block.sideTexture);
-				}
-				if (z == 0 || chunk->getBlock(x, y, z - 1).isAir()) {
-					chunk->addFaceToMesh(position, Chunk::FaceDirection::BACK, block.sideTexture);
-				}
-				if (x == CHUNK_SIZE_X - 1 || chunk->getBlock(x + 1, y, z).isAir()) {
-					chunk->addFaceToMesh(position, Chunk::FaceDirection::RIGHT, block.sideTexture);
-				}
-				if (x == 0 || chunk->getBlock(x - 1, y, z).isAir()) {
-					chunk->addFaceToMesh(position, Chunk::FaceDirection::LEFT, block.sideTexture);
-				}*/
-				//if (y == CHUNK_SIZE_Y - 1 || chunk->getBlock(x, y + 1, z).isAir()) {
-				//	chunk->addFaceToMesh(position, Chunk::FaceDirection::TOP, block.topTexture);
-				//}
-				//if (y == 0 || chunk->getBlock(x, y - 1, z).isAir()) {
-				//	chunk->addFaceToMesh(position, Chunk::FaceDirection::BOTTOM, block.bottomTexture);
-				//}
-
+				blocks[Chunk::blockIndex(x, y, z)] = getGeneratedBlock(y, highestBlockY);
 			}
 
 		}
 	}
-	generateChunkMesh(chunkX, chunkZ, chunk);
-	chunks[{chunkX, chunkZ}] = std::unique_ptr<Chunk>(chunk);
 }
 
-void WorldManager::generateChunkMesh(int chunkX, int chunkZ, Chunk* chunk) {
-
-	for (int x = 0; x < CHUNK_SIZE_X; x++) {
-		for (int z = 0; z < CHUNK_SIZE_Z; z++) {
-			for (int y = 0; y < CHUNK_SIZE_Y; y++) {
-
-				//int worldX = chunkX * CHUNK_SIZE_X + x;
-				//int worldZ = chunkZ * CHUNK_SIZE_Z + z;
-
-				std::optional<Block> blockOpt = getBlockInChunk(x, y, z, chunk);
-				if (blockOpt.has_value() && blockOpt->type != 0) {
-					Block block = blockOpt.value();
-					glm::vec3 position(x, y, z);
-
-					// TOP FACE
-					std::optional<Block> blockAboveOpt = chunk->getBlock(x, y + 1, z);
-					bool isBlockAboveAir = !blockAboveOpt.has_value() || blockAboveOpt->type == 0;
-					if(isBlockAboveAir)
-						chunk->addFaceToMesh(position, Chunk::FaceDirection::TOP, block.topTexture);
-					
-					// BOTTOM FACE
-					if (y > 0) {
-						std::optional<Block> blockBelowOpt = chunk->getBlock(x, y - 1, z);
-						bool isBlockBelowAir = !blockBelowOpt.has_value() || blockBelowOpt->type == 0;
-						if (isBlockBelowAir)
-							chunk->addFaceToMesh(position, Chunk::FaceDirection::BOTTOM, block.bottomTexture);
-					}
-
-
-					// RIGHT FACE
-					if (x == CHUNK_SIZE_X - 1) {
-						if (auto rightNeighbor = getChunk(chunkX + 1, chunkZ)) {
-							auto rightBlockOpt = rightNeighbor->getBlock(0, y, z);
-							if (!rightBlockOpt || rightBlockOpt->type == 0)
-								chunk->addFaceToMesh(position, Chunk::FaceDirection::RIGHT, block.sideTexture);
-						}
-						else {
-							// Defer the face if no neighbor
-							chunk->deferredFaces.push_back({ position, Chunk::FaceDirection::RIGHT, block.sideTexture });
-						}
-					}
-					else {
-						std::optional<Block> blockRightOpt = getBlockInChunk(x + 1, y, z, chunk);
-						bool isBlockRightAir = !blockRightOpt.has_value() || blockRightOpt->type == 0;
-						if (isBlockRightAir)
-							chunk->addFaceToMesh(position, Chunk::FaceDirection::RIGHT, block.sideTexture);
-					}
-
-
-					// LEFT FACE
-					if (x == 0) {
-						if (auto leftNeighbor = getChunk(chunkX - 1, chunkZ)) {
-							auto leftBlockOpt = leftNeighbor->getBlock(CHUNK_SIZE_X - 1, y, z);
-							if (!leftBlockOpt || leftBlockOpt->type == 0)
-								chunk->addFaceToMesh(position, Chunk::FaceDirection::LEFT, block.sideTexture);
-						}
-						else {
-							// Defer the face if no neighbor
-							chunk->deferredFaces.push_back({ position, Chunk::FaceDirection::LEFT, block.sideTexture });
-						}
-					}
-					else {
-						std::optional<Block> blockLeftOpt = getBlockInChunk(x - 1, y, z, chunk);
-						bool isBlockLeftAir = !blockLeftOpt.has_value() || blockLeftOpt->type == 0;
-						if (isBlockLeftAir)
-							chunk->addFaceToMesh(position, Chunk::FaceDirection::LEFT, block.sideTexture);
-					}
-
-					// FRONT FACE
-					if (z == CHUNK_SIZE_Z - 1) {
-						if (auto frontNeighbor = getChunk(chunkX, chunkZ + 1)) {
-							auto frontBlockOpt = frontNeighbor->getBlock(x, y, 0);
-							if (!frontBlockOpt || frontBlockOpt->type == 0) {
-								// If there is no front block or it is air, add the front face
-								chunk->addFaceToMesh(position, Chunk::FaceDirection::FRONT, block.sideTexture);
-							}
-						}
-						else {
-							// Defer the face if no neighbor chunk
-							chunk->deferredFaces.push_back({ position, Chunk::FaceDirection::FRONT, block.sideTexture });
-						}
-					}
-					else {
-						std::optional<Block> blockFrontOpt = getBlockInChunk(x, y, z + 1, chunk);
-						bool isBlockFrontAir = !blockFrontOpt.has_value() || blockFrontOpt->type == 0;
-						if (isBlockFrontAir) {
-							chunk->addFaceToMesh(position, Chunk::FaceDirection::FRONT, block.sideTexture);
-						}
-					}
-
-
-					// BACK FACE
-					if (z == 0) {
-						if (auto backNeighbor = getChunk(chunkX, chunkZ - 1)) {
-							auto backBlockOpt = backNeighbor->getBlock(x, y, CHUNK_SIZE_Z - 1);
-							if (!backBlockOpt || backBlockOpt->type == 0) {
-								// If there is no back block or it is air, add the back face
-								chunk->addFaceToMesh(position, Chunk::FaceDirection::BACK, block.sideTexture);
-							}
-						}
-						else {
-							// Defer the face if no neighbor chunk
-							chunk->deferredFaces.push_back({ position, Chunk::FaceDirection::BACK, block.sideTexture });
-						}
-					}
-					else {
-						std::optional<Block> blockBackOpt = getBlockInChunk(x, y, z - 1, chunk);
-						bool isBlockBackAir = !blockBackOpt.has_value() || blockBackOpt->type == 0;
-						if (isBlockBackAir) {
-							chunk->addFaceToMesh(position, Chunk::FaceDirection::BACK, block.sideTexture);
-						}
-					}
+std::unique_ptr<Chunk> WorldManager::loadCachedChunk(int chunkX, int chunkZ) {
+	glm::vec3 chunkPosition = glm::vec3(chunkX * CHUNK_SIZE_X, 0, chunkZ * CHUNK_SIZE_Z);
 
-					// RIGHT FACE
-					/*std::optional<Block> blockRightOpt = getBlockInChunk(x + 1, y, z, chunk);
-					bool isBlockRightAir = !blockRightOpt.has_value() || blockRightOpt->type == 0;
-					if(isBlockRightAir)
-						chunk->addFaceToMesh(position, Chunk::FaceDirection::RIGHT, block.sideTexture);
-
-					// LEFT FACE
-					std::optional<Block> blockLeftOpt = getBlockInChunk(x - 1, y, z, chunk);
-					bool isBlockLeftAir = !blockLeftOpt.has_value() || blockLeftOpt->type == 0;
-					if (isBlockLeftAir)
-						chunk->addFaceToMesh(position, Chunk::FaceDirection::LEFT, block.sideTexture);
-
-					// FRONT FACE
-					std::optional<Block> blockFrontOpt = getBlockInChunk(x, y, z + 1, chunk);
-					bool isBlockFrontAir = !blockFrontOpt.has_value() || blockFrontOpt->type == 0;
-					if (isBlockFrontAir)
-						chunk->addFaceToMesh(position, Chunk::FaceDirection::FRONT, block.sideTexture);
-
-					// BACK FACE
-					std::optional<Block> blockBackOpt = getBlockInChunk(x, y, z - 1, chunk);
-					bool isBlockBackAir = !blockBackOpt.has_value() || blockBackOpt->type == 0;
-					if (isBlockBackAir)
-						chunk->addFaceToMesh(position, Chunk::FaceDirection::BACK, block.sideTexture);
-						*/
-				}
+	std::unique_ptr<Chunk> chunk = std::make_unique<Chunk>(chunkPosition);
+	if (!chunkCache.take(chunkX, chunkZ, *chunk)) {
+		return nullptr;
+	}
+	return chunk;
+}
 
-			}
+// Expects blocks, occupancy and chunk local light to be done (see processChunkQueue),
+// the light is connected to the neighbors afterwards by connectChunks
+void WorldManager::addChunk(int chunkX, int chunkZ, std::unique_ptr<Chunk> chunk) {
+	chunk->lodLevel = uint8_t(getLodLevel(getLodDistance(chunkX, chunkZ)));
+	chunks[{chunkX, chunkZ}] = std::move(chunk);
+
+	// Meshed with the edit batch. The neighbors can now show their border faces
+	// and need the new blocks for occlusion.
+	for (int dx = -1; dx <= 1; dx++) {
+		for (int dz = -1; dz <= 1; dz++) {
+			markSectionsDirty(chunkX + dx, chunkZ + dz, 0, CHUNK_SIZE_Y - 1);
 		}
 	}
 }
 
-void WorldManager::processDeferredFaces(int chunkX, int chunkZ) {
-	auto chunk = getChunk(chunkX, chunkZ);
-	if (!chunk) return;
-
-	for (auto it = chunk->deferredFaces.begin(); it != chunk->deferredFaces.end();) {
-		const auto& face = *it;
-		bool isVisible = false;
-
-		switch (face.direction) {
-		case Chunk::FaceDirection::LEFT:
-			if (auto leftNeighbor = getChunk(chunkX - 1, chunkZ)) {
-				auto blockOpt = leftNeighbor->getBlock(CHUNK_SIZE_X - 1, face.position.y, face.position.z);
-				isVisible = !blockOpt || blockOpt->type == 0;
-			}
-			break;
-		case Chunk::FaceDirection::RIGHT:
-			if (auto rightNeighbor = getChunk(chunkX + 1, chunkZ)) {
-				auto blockOpt = rightNeighbor->getBlock(0, face.position.y, face.position.z);
-				isVisible = !blockOpt || blockOpt->type == 0;
+void WorldManager::connectChunks(const std::vector<std::pair<int, int>>& added) {
+	// Connecting a chunk only touches it and its 8 neighbors (see LightEngine::connectChunk).
+	// Chunks in the same pass are 3 or more chunks apart, so they run on the workers together,
+	// each with its own engine.
+	std::vector<std::vector<glm::ivec3>> changes(added.size());
+	std::vector<size_t> batch;
+	for (int pass = 0; pass < 9; pass++) {
+		batch.clear();
+		for (size_t i = 0; i < added.size(); i++) {
+			int passX = added[i].first - floorDiv(added[i].first, 3) * 3;
+			int passZ = added[i].second - floorDiv(added[i].second, 3) * 3;
+			if (passX * 3 + passZ == pass) {
+				batch.push_back(i);
 			}
-			break;
-		case Chunk::FaceDirection::FRONT:
-			if (auto backNeighbor = getChunk(chunkX, chunkZ + 1)) {
-				auto blockOpt = backNeighbor->getBlock(face.position.x, face.position.y, 0);
-				isVisible = !blockOpt || blockOpt->type == 0;
-			}
-			break;
-		case Chunk::FaceDirection::BACK:
-			if (auto frontNeighbor = getChunk(chunkX, chunkZ - 1)) {
-				auto blockOpt = frontNeighbor->getBlock(face.position.x, face.position.y, CHUNK_SIZE_Z - 1);
-				isVisible = !blockOpt || blockOpt->type == 0;
-			}
-			break;
 		}
+		workerPool.parallelFor(batch.size(), [&](size_t i) {
+			LightEngine engine(*this);
+			engine.connectChunk(added[batch[i]].first, added[batch[i]].second, changes[batch[i]]);
+		});
+	}
 
-		if (isVisible) {
-			chunk->addFaceToMesh(face.position, face.direction, face.textureIndex);
-			it = chunk->deferredFaces.erase(it);
-			chunk->vertexAndIndexBufferUploaded = false;
-		}
-		else {
-			++it;
-		}
+	lightChanges.clear();
+	for (const std::vector<glm::ivec3>& chunkChanges : changes) {
+		lightChanges.insert(lightChanges.end(), chunkChanges.begin(), chunkChanges.end());
 	}
+	markLightChanges();
 }
 
-
 std::pair<int, int> WorldManager::getChunkCoordinates(glm::vec3 cameraPos) {
 	int chunkX = static_cast<int>(floor(cameraPos.x / CHUNK_SIZE_X));
 	int chunkZ = static_cast<int>(floor(cameraPos.z / CHUNK_SIZE_X));
@@ -290,25 +187,74 @@ void WorldManager::generateChunksAround(glm::vec3 cameraPos, int viewDistance) {
 }
 
 void WorldManager::processChunkQueue(int chunksPerFrame) {
-	int chunksProcessed = 0;
+	std::vector<ReadyChunk> ready;
+	auto isReady = [&](int x, int z) {
+		for (const ReadyChunk& entry : ready) {
+			if (entry.chunkX == x && entry.chunkZ == z) return true;
+		}
+		return false;
+	};
+
+	// Answers from the IO thread: either the saved chunk or nothing, then we generate it
+	chunkIO.takeLoaded(loadedChunks);
+	size_t loadedCount = 0;
+	while (loadedCount < loadedChunks.size() && int(ready.size()) < chunksPerFrame) {
+		ChunkIOWorker::LoadResult& result = loadedChunks[loadedCount++];
+		pendingLoads.erase({ result.chunkX, result.chunkZ });
+		if (findChunk(result.chunkX, result.chunkZ) || isReady(result.chunkX, result.chunkZ)) {
+			continue;
+		}
 
-	while (!chunkLoadingPriorityQueue.empty() && chunksProcessed < chunksPerFrame) {
+		ReadyChunk entry = { result.chunkX, result.chunkZ, std::move(result.chunk), false };
+		if (!entry.chunk) {
+			entry.chunk = std::make_unique<Chunk>(glm::vec3(result.chunkX * CHUNK_SIZE_X, 0, result.chunkZ * CHUNK_SIZE_Z));
+			entry.generate = true;
+		}
+		ready.push_back(std::move(entry));
+	}
+	loadedChunks.erase(loadedChunks.begin(), loadedChunks.begin() + loadedCount);
+
+	while (!chunkLoadingPriorityQueue.empty() && int(ready.size()) < chunksPerFrame && pendingLoads.size() < maxPendingLoads) {
 		auto chunkPriority = chunkLoadingPriorityQueue.top();
 		chunkLoadingPriorityQueue.pop();
 
 		int x = chunkPriority.x;
 		int z = chunkPriority.z;
 
-		if (!getChunk(x, z)) {
-			generateChunks(x, z);
-			chunksProcessed++;
+		if (findChunk(x, z) || pendingLoads.count({ x, z }) || isReady(x, z)) {
+			continue;
+		}
+
+		// Chunks we flew away from are still in the cache, everything else goes through the region files
+		if (std::unique_ptr<Chunk> cached = loadCachedChunk(x, z)) {
+			ready.push_back({ x, z, std::move(cached), false });
+		}
+		else {
+			pendingLoads.insert({ x, z });
+			chunkIO.requestLoad(x, z);
+		}
+	}
 
-			processDeferredFaces(x - 1, z);
-			processDeferredFaces(x + 1, z);
-			processDeferredFaces(x, z + 1);
-			processDeferredFaces(x, z - 1);
+	// Terrain and chunk local light only touch their own chunk, so the batch runs in parallel
+	workerPool.parallelFor(ready.size(), [&](size_t i) {
+		ReadyChunk& entry = ready[i];
+		if (entry.generate) {
+			generateTerrain(entry.chunkX, entry.chunkZ, entry.chunk->getBlockData());
 		}
+		entry.chunk->updateOccupancy();
+		LightEngine::lightChunk(*entry.chunk);
+	});
+
+	// One batch, so chunks bordering several new ones are meshed once
+	beginBlockEdits();
+	std::vector<std::pair<int, int>> added;
+	added.reserve(ready.size());
+	for (ReadyChunk& entry : ready) {
+		addChunk(entry.chunkX, entry.chunkZ, std::move(entry.chunk));
+		added.push_back({ entry.chunkX, entry.chunkZ });
 	}
+	connectChunks(added);
+	commitBlockEdits();
 }
 
 std::shared_ptr<Chunk> WorldManager::getChunk(int x, int z) {
@@ -319,17 +265,428 @@ std::shared_ptr<Chunk> WorldManager::getChunk(int x, int z) {
 	return nullptr;
 }
 
+Chunk* WorldManager::findChunk(int chunkX, int chunkZ) {
+	auto found = chunks.find({ chunkX, chunkZ });
+	return found != chunks.end() ? found->second.get() : nullptr;
+}
+
+WorldManager::RaycastHit WorldManager::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+	ChunkCursor cursor = {};
+	return raycast({ origin, direction, maxDistance }, cursor);
+}
+
+void WorldManager::raycastBatch(const std::vector<Ray>& rays, std::vector<RaycastHit>& hits) {
+	ChunkCursor cursor = {};
+	hits.resize(rays.size());
+	for (size_t i = 0; i < rays.size(); i++) {
+		hits[i] = raycast(rays[i], cursor);
+	}
+}
+
+WorldManager::RaycastHit WorldManager::raycast(const Ray& ray, ChunkCursor& cursor) {
+	RaycastHit result = {};
+	float length = glm::length(ray.direction);
+	if (length == 0.0f) {
+		return result;
+	}
+	glm::vec3 direction = ray.direction / length;
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	glm::ivec3 voxel = glm::ivec3(glm::floor(ray.origin));
+	glm::ivec3 step;
+	glm::vec3 tDelta;
+	glm::vec3 tMax;
+	for (int axis = 0; axis < 3; axis++) {
+		step[axis] = direction[axis] > 0.0f ? 1 : (direction[axis] < 0.0f ? -1 : 0);
+		tDelta[axis] = step[axis] != 0 ? std::abs(1.0f / direction[axis]) : infinity;
+	}
+
+	// Distance along the ray to the next voxel boundary on every axis
+	auto computeTMax = [&]() {
+		for (int axis = 0; axis < 3; axis++) {
+			if (step[axis] > 0) tMax[axis] = (voxel[axis] + 1 - ray.origin[axis]) / direction[axis];
+			else if (step[axis] < 0) tMax[axis] = (voxel[axis] - ray.origin[axis]) / direction[axis];
+			else tMax[axis] = infinity;
+		}
+	};
+	computeTMax();
+
+	float t = 0.0f;
+	int lastAxis = -1;
+	while (t <= ray.maxDistance) {
+		int chunkX = floorDiv(voxel.x, CHUNK_SIZE_X);
+		int chunkZ = floorDiv(voxel.z, CHUNK_SIZE_Z);
+		if (!cursor.valid || cursor.chunkX != chunkX || cursor.chunkZ != chunkZ) {
+			cursor = { chunkX, chunkZ, findChunk(chunkX, chunkZ), true };
+		}
+
+		// Box that is known to be empty around the current voxel, skipped in one step
+		glm::vec3 emptyMin(chunkX * CHUNK_SIZE_X, 0.0f, chunkZ * CHUNK_SIZE_Z);
+		glm::vec3 emptyMax = emptyMin + glm::vec3(CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z);
+		bool empty = true;
+		if (voxel.y < 0) {
+			if (step.y <= 0) break;
+			emptyMin.y = -infinity;
+			emptyMax.y = 0.0f;
+		}
+		else if (voxel.y >= CHUNK_SIZE_Y) {
+			if (step.y >= 0) break;
+			emptyMin.y = float(CHUNK_SIZE_Y);
+			emptyMax.y = infinity;
+		}
+		else if (cursor.chunk) {
+			int section = voxel.y / CHUNK_SECTION_HEIGHT;
+			if (cursor.chunk->isSectionEmpty(section)) {
+				emptyMin.y = float(section * CHUNK_SECTION_HEIGHT);
+				emptyMax.y = emptyMin.y + CHUNK_SECTION_HEIGHT;
+			}
+			else {
+				empty = false;
+			}
+		}
+
+		if (!empty) {
+			int localX = voxel.x - chunkX * CHUNK_SIZE_X;
+			int localZ = voxel.z - chunkZ * CHUNK_SIZE_Z;
+			const Block& block = cursor.chunk->getBlockData()[Chunk::blockIndex(localX, voxel.y, localZ)];
+			if (!block.isAir()) {
+				result.hit = true;
+				result.blockPosition = voxel;
+				result.distance = t;
+				result.block = block;
+				if (lastAxis >= 0) {
+					result.normal[lastAxis] = -step[lastAxis];
+				}
+				static const Chunk::FaceDirection faces[3][2] = {
+					{ Chunk::LEFT, Chunk::RIGHT }, { Chunk::BOTTOM, Chunk::TOP }, { Chunk::BACK, Chunk::FRONT }
+				};
+				result.face = lastAxis >= 0 ? faces[lastAxis][result.normal[lastAxis] > 0] : Chunk::TOP;
+				return result;
+			}
+
+			// Single DDA step
+			lastAxis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+			t = tMax[lastAxis];
+			voxel[lastAxis] += step[lastAxis];
+			tMax[lastAxis] += tDelta[lastAxis];
+			continue;
+		}
+
+		// Jump to the voxel right behind the exit face of the empty box
+		float exitT = infinity;
+		int exitAxis = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			if (step[axis] == 0) continue;
+			float boundary = step[axis] > 0 ? emptyMax[axis] : emptyMin[axis];
+			float axisT = (boundary - ray.origin[axis]) / direction[axis];
+			if (axisT < exitT) {
+				exitT = axisT;
+				exitAxis = axis;
+			}
+		}
+		if (exitT > ray.maxDistance) {
+			break;
+		}
+
+		glm::vec3 exitPoint = ray.origin + direction * exitT;
+		for (int axis = 0; axis < 3; axis++) {
+			if (axis == exitAxis) {
+				voxel[axis] = step[axis] > 0 ? int(emptyMax[axis]) : int(emptyMin[axis]) - 1;
+			}
+			else {
+				voxel[axis] = int(std::floor(glm::clamp(exitPoint[axis], emptyMin[axis], std::nextafter(emptyMax[axis], emptyMin[axis]))));
+			}
+		}
+		t = std::max(t, exitT);
+		lastAxis = exitAxis;
+		computeTMax();
+	}
+
+	return result;
+}
+
+double WorldManager::benchmarkRaycast(glm::vec3 origin, int rayCount, float maxDistance) {
+	// Evenly spread directions on a sphere (fibonacci lattice)
+	std::vector<Ray> rays(rayCount);
+	const float goldenAngle = glm::pi<float>() * (3.0f - std::sqrt(5.0f));
+	for (int i = 0; i < rayCount; i++) {
+		float y = 1.0f - 2.0f * (i + 0.5f) / rayCount;
+		float radius = std::sqrt(1.0f - y * y);
+		float angle = goldenAngle * i;
+		rays[i] = { origin, glm::vec3(std::cos(angle) * radius, y, std::sin(angle) * radius), maxDistance };
+	}
+
+	std::vector<RaycastHit> hits;
+	auto start = std::chrono::steady_clock::now();
+	raycastBatch(rays, hits);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	int hitCount = 0;
+	for (const RaycastHit& hit : hits) {
+		if (hit.hit) hitCount++;
+	}
+
+	double raysPerSecond = elapsed.count() > 0.0 ? rayCount / elapsed.count() : 0.0;
+	LOG_INFO("Raycast benchmark: ", rayCount, " rays (", hitCount, " hits) in ", elapsed.count() * 1000.0, " ms, ", raysPerSecond, " rays/s");
+	return raysPerSecond;
+}
+
+void WorldManager::beginBlockEdits() {
+	editBatchDepth++;
+}
+
+void WorldManager::commitBlockEdits() {
+	if (editBatchDepth == 0 || --editBatchDepth > 0) {
+		return;
+	}
+
+	// Stays on this thread, see LightEngine::update
+	lightChanges.clear();
+	lightEngine.update(lightChanges);
+	markLightChanges();
+
+	struct MeshJob {
+		int chunkX, chunkZ;
+		Chunk* chunk;
+	};
+	std::vector<MeshJob> jobs;
+	jobs.reserve(dirtyChunks.size());
+	for (const std::pair<int, int>& coords : dirtyChunks) {
+		if (Chunk* chunk = findChunk(coords.first, coords.second)) {
+			jobs.push_back({ coords.first, coords.second, chunk });
+		}
+	}
+	dirtyChunks.clear();
+
+	// Nothing writes to the world until parallelFor returns, so the workers can read the
+	// neighbors while each one only writes the mesh of its own chunk
+	workerPool.parallelFor(jobs.size(), [&](size_t i) {
+		remeshChunk(jobs[i].chunkX, jobs[i].chunkZ, jobs[i].chunk);
+	});
+}
+
 void WorldManager::setBlock(int x, int y, int z, Block block) {
-	std::pair<int, int> chunkCoords = getChunkCoordinates(glm::vec3(x, y, z));
-	int chunkX = chunkCoords.first;
-	int chunkZ = chunkCoords.second;
-    std::shared_ptr<Chunk> chunk = getChunk(chunkX, chunkZ);
-    if (chunk) {
-        //int localX = x % CHUNK_SIZE_X;
-        //int localY = y;
-        //int localZ = z % CHUNK_SIZE_Z;
-		chunk->setBlock(x, y, z, block);
-    }
+	if (y < 0 || y >= CHUNK_SIZE_Y) {
+		return;
+	}
+
+	int chunkX = floorDiv(x, CHUNK_SIZE_X);
+	int chunkZ = floorDiv(z, CHUNK_SIZE_Z);
+	Chunk* chunk = findChunk(chunkX, chunkZ);
+	if (!chunk) {
+		return;
+	}
+
+	glm::ivec3 local(x - chunkX * CHUNK_SIZE_X, y, z - chunkZ * CHUNK_SIZE_Z);
+	Block oldBlock = chunk->getBlockData()[Chunk::blockIndex(local.x, local.y, local.z)];
+	chunk->setBlock(local.x, local.y, local.z, block);
+	chunk->modified = true;
+	lightEngine.blockChanged(glm::ivec3(x, y, z), oldBlock, block);
+
+	beginBlockEdits();
+	markEdited(chunkX, chunkZ, local, local);
+	commitBlockEdits();
+}
+
+void WorldManager::fillRegion(glm::ivec3 from, glm::ivec3 to, Block block) {
+	glm::ivec3 minCorner = glm::min(from, to);
+	glm::ivec3 maxCorner = glm::max(from, to);
+	minCorner.y = std::max(minCorner.y, 0);
+	maxCorner.y = std::min(maxCorner.y, CHUNK_SIZE_Y - 1);
+	if (minCorner.y > maxCorner.y) {
+		return;
+	}
+
+	beginBlockEdits();
+	for (int chunkX = floorDiv(minCorner.x, CHUNK_SIZE_X); chunkX <= floorDiv(maxCorner.x, CHUNK_SIZE_X); chunkX++) {
+		for (int chunkZ = floorDiv(minCorner.z, CHUNK_SIZE_Z); chunkZ <= floorDiv(maxCorner.z, CHUNK_SIZE_Z); chunkZ++) {
+			Chunk* chunk = findChunk(chunkX, chunkZ);
+			if (!chunk) {
+				continue;
+			}
+
+			// Part of the region inside this chunk
+			glm::ivec3 chunkOrigin(chunkX * CHUNK_SIZE_X, 0, chunkZ * CHUNK_SIZE_Z);
+			glm::ivec3 localMin = glm::max(minCorner - chunkOrigin, glm::ivec3(0));
+			glm::ivec3 localMax = glm::min(maxCorner - chunkOrigin, glm::ivec3(CHUNK_SIZE_X - 1, CHUNK_SIZE_Y - 1, CHUNK_SIZE_Z - 1));
+
+			for (int x = localMin.x; x <= localMax.x; x++) {
+				for (int y = localMin.y; y <= localMax.y; y++) {
+					for (int z = localMin.z; z <= localMax.z; z++) {
+						Block oldBlock = chunk->getBlockData()[Chunk::blockIndex(x, y, z)];
+						chunk->setBlock(x, y, z, block);
+						lightEngine.blockChanged(chunkOrigin + glm::ivec3(x, y, z), oldBlock, block);
+					}
+				}
+			}
+			chunk->modified = true;
+			markEdited(chunkX, chunkZ, localMin, localMax);
+		}
+	}
+	commitBlockEdits();
+}
+
+void WorldManager::markEdited(int chunkX, int chunkZ, glm::ivec3 localMin, glm::ivec3 localMax) {
+	// One block above and below, the faces of those blocks change too
+	markSectionsDirty(chunkX, chunkZ, localMin.y - 1, localMax.y + 1);
+
+	// Edits on the border change the faces of the neighbor chunk
+	if (localMin.x == 0) markSectionsDirty(chunkX - 1, chunkZ, localMin.y, localMax.y);
+	if (localMax.x == CHUNK_SIZE_X - 1) markSectionsDirty(chunkX + 1, chunkZ, localMin.y, localMax.y);
+	if (localMin.z == 0) markSectionsDirty(chunkX, chunkZ - 1, localMin.y, localMax.y);
+	if (localMax.z == CHUNK_SIZE_Z - 1) markSectionsDirty(chunkX, chunkZ + 1, localMin.y, localMax.y);
+
+	// Corners only change the occlusion of the diagonal chunk
+	bool minX = localMin.x == 0, maxX = localMax.x == CHUNK_SIZE_X - 1;
+	bool minZ = localMin.z == 0, maxZ = localMax.z == CHUNK_SIZE_Z - 1;
+	if (minX && minZ) markSectionsDirty(chunkX - 1, chunkZ - 1, localMin.y - 1, localMax.y + 1);
+	if (minX && maxZ) markSectionsDirty(chunkX - 1, chunkZ + 1, localMin.y - 1, localMax.y + 1);
+	if (maxX && minZ) markSectionsDirty(chunkX + 1, chunkZ - 1, localMin.y - 1, localMax.y + 1);
+	if (maxX && maxZ) markSectionsDirty(chunkX + 1, chunkZ + 1, localMin.y - 1, localMax.y + 1);
+}
+
+void WorldManager::markLightChanges() {
+	for (const glm::ivec3& voxel : lightChanges) {
+		int chunkX = floorDiv(voxel.x, CHUNK_SIZE_X);
+		int chunkZ = floorDiv(voxel.z, CHUNK_SIZE_Z);
+		glm::ivec3 local(voxel.x - chunkX * CHUNK_SIZE_X, voxel.y, voxel.z - chunkZ * CHUNK_SIZE_Z);
+		markEdited(chunkX, chunkZ, local, local);
+	}
+	lightChanges.clear();
+}
+
+void WorldManager::markSectionsDirty(int chunkX, int chunkZ, int minY, int maxY) {
+	Chunk* chunk = findChunk(chunkX, chunkZ);
+	if (!chunk) {
+		return;
+	}
+
+	int firstSection = std::max(minY, 0) / CHUNK_SECTION_HEIGHT;
+	int lastSection = std::min(maxY, CHUNK_SIZE_Y - 1) / CHUNK_SECTION_HEIGHT;
+	for (int section = firstSection; section <= lastSection; section++) {
+		chunk->dirtySections |= uint8_t(1 << section);
+	}
+	dirtyChunks.insert({ chunkX, chunkZ });
+}
+
+// The mesher works on whole chunks, so any dirty section rebuilds the chunk mesh once.
+// Runs on the worker pool: only reads the world and writes to the given chunk.
+void WorldManager::remeshChunk(int chunkX, int chunkZ, Chunk* chunk) {
+	const Chunk* neighbors[3][3];
+	for (int dx = -1; dx <= 1; dx++) {
+		for (int dz = -1; dz <= 1; dz++) {
+			neighbors[dx + 1][dz + 1] = findChunk(chunkX + dx, chunkZ + dz);
+		}
+	}
+	PaddedChunk& padded = ChunkMesher::getScratchPadding();
+	padded.fill(*chunk, neighbors);
+	chunk->meshVersion = ++meshVersionCounter;
+
+	// The old mesh stays until the GPU mesh is done
+	if (gpuMeshing && chunk->lodLevel == 0) {
+		GpuMeshRequest request;
+		if (request.input.pack(padded)) {
+			request.chunkX = chunkX;
+			request.chunkZ = chunkZ;
+			request.meshVersion = chunk->meshVersion;
+			request.validate = validateGpuMeshes;
+			if (validateGpuMeshes) {
+				ChunkMesher::buildMesh(padded, 0, request.referenceVertices, request.referenceIndices, request.referenceRanges);
+			}
+			chunk->dirtySections = 0;
+
+			std::lock_guard<std::mutex> lock(gpuMeshMutex);
+			gpuMeshRequests.push_back(std::move(request));
+			return;
+		}
+	}
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	uint32_t meshRanges[Chunk::MESH_RANGE_COUNT + 1];
+	ChunkMesher::buildMesh(padded, chunk->lodLevel, vertices, indices, meshRanges);
+	chunk->setMesh(std::move(vertices), std::move(indices), meshRanges);
+	chunk->dirtySections = 0;
+	chunk->vertexAndIndexBufferUploaded = false;
+}
+
+void WorldManager::setGpuMeshing(bool enabled, bool validate) {
+	gpuMeshing = enabled;
+	validateGpuMeshes = validate;
+}
+
+void WorldManager::takeGpuMeshRequests(std::deque<GpuMeshRequest>& requests) {
+	std::lock_guard<std::mutex> lock(gpuMeshMutex);
+	for (GpuMeshRequest& request : gpuMeshRequests) {
+		requests.push_back(std::move(request));
+	}
+	gpuMeshRequests.clear();
+}
+
+void WorldManager::remeshAllChunks() {
+	beginBlockEdits();
+	for (auto& chunkPair : chunks) {
+		markSectionsDirty(chunkPair.first.first, chunkPair.first.second, 0, CHUNK_SIZE_Y - 1);
+	}
+	commitBlockEdits();
+}
+
+void WorldManager::setLodRings(int fullDetail, int halfDetail, int quarterDetail) {
+	lodRings[0] = fullDetail;
+	lodRings[1] = std::max(halfDetail, fullDetail);
+	lodRings[2] = std::max(quarterDetail, lodRings[1]);
+}
+
+int WorldManager::getLodDistance(int chunkX, int chunkZ) const {
+	return std::max(abs(chunkX - lodCenter.first), abs(chunkZ - lodCenter.second));
+}
+
+int WorldManager::getLodLevel(int distance) const {
+	int level = 0;
+	while (level < ChunkMesher::LOD_LEVEL_COUNT - 1 && distance > lodRings[level]) {
+		level++;
+	}
+	return level;
+}
+
+void WorldManager::updateLod(glm::vec3 cameraPos) {
+	std::pair<int, int> center = getChunkCoordinates(cameraPos);
+	if (center == lodCenter) {
+		return;
+	}
+	lodCenter = center;
+
+	beginBlockEdits();
+	for (auto& chunkPair : chunks) {
+		int chunkX = chunkPair.first.first;
+		int chunkZ = chunkPair.first.second;
+		Chunk* chunk = chunkPair.second.get();
+
+		// Only get coarser one chunk past the ring, walking along a ring does not flip chunks back and forth
+		int distance = getLodDistance(chunkX, chunkZ);
+		int level = getLodLevel(distance);
+		if (level > chunk->lodLevel) {
+			level = std::max(int(chunk->lodLevel), getLodLevel(distance - 1));
+		}
+		if (level == chunk->lodLevel) {
+			continue;
+		}
+
+		// Full resolution neighbors put skirts towards chunks at another level
+		bool skirtsChange = level == 0 || chunk->lodLevel == 0;
+		chunk->lodLevel = uint8_t(level);
+		markSectionsDirty(chunkX, chunkZ, 0, CHUNK_SIZE_Y - 1);
+		if (skirtsChange) {
+			const int neighborOffsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+			for (const int* offset : neighborOffsets) {
+				Chunk* neighbor = findChunk(chunkX + offset[0], chunkZ + offset[1]);
+				if (neighbor && neighbor->lodLevel == 0) {
+					markSectionsDirty(chunkX + offset[0], chunkZ + offset[1], 0, CHUNK_SIZE_Y - 1);
+				}
+			}
+		}
+	}
+	commitBlockEdits();
 }
 
 std::optional<Block> WorldManager::getBlockInChunk(int x, int y, int z, Chunk* chunk) {
@@ -344,7 +701,7 @@ std::optional<Block> WorldManager::getBlockInChunk(int x, int y, int z, Chunk* c
 }
 
 // Unload distant chunks
-void WorldManager::unloadDistantChunks(glm::vec3 cameraPos, int viewDistance, VkDevice device) {
+void WorldManager::unloadDistantChunks(glm::vec3 cameraPos, int viewDistance, VulkanAllocator& allocator) {
     int chunkViewDistance = viewDistance * 2; // CHANGE THIS TO BIGGER VALUE LATER
 	std::pair<int, int> chunkCoords = getChunkCoordinates(cameraPos);
 	int playerChunkX = chunkCoords.first;
@@ -355,8 +712,15 @@ void WorldManager::unloadDistantChunks(glm::vec3 cameraPos, int viewDistance, Vk
         int chunkZ = it->first.second;
 
         if (abs(chunkX - playerChunkX) > chunkViewDistance || abs(chunkZ - playerChunkZ) > chunkViewDistance) {
-			vkDeviceWaitIdle(device);
-			cleanupBuffers(device, it->second.get());
+			Chunk* chunk = it->second.get();
+			if (chunk->modified) {
+				chunkIO.requestStore(chunkX, chunkZ, *chunk);
+				chunk->modified = false;
+			}
+			chunkCache.store(chunkX, chunkZ, *chunk);
+
+			vkDeviceWaitIdle(allocator.getDevice());
+			cleanupBuffers(allocator, it->second.get());
 			it->second.get()->cleanup();
 			it = chunks.erase(it);
         }
@@ -366,28 +730,45 @@ void WorldManager::unloadDistantChunks(glm::vec3 cameraPos, int viewDistance, Vk
     }
 }
 
-void WorldManager::cleanupBuffers(VkDevice device, Chunk* chunk) {
+void WorldManager::cleanupBuffers(VulkanAllocator& allocator, Chunk* chunk) {
 	if (chunk->vertexBuffer != VK_NULL_HANDLE) {
-		vkDestroyBuffer(device, chunk->vertexBuffer, nullptr);
+		vkDestroyBuffer(allocator.getDevice(), chunk->vertexBuffer, nullptr);
 		chunk->vertexBuffer = VK_NULL_HANDLE;
 	}
 
 	if (chunk->indexBuffer != VK_NULL_HANDLE) {
-		vkDestroyBuffer(device, chunk->indexBuffer, nullptr);
+		vkDestroyBuffer(allocator.getDevice(), chunk->indexBuffer, nullptr);
 		chunk->indexBuffer = VK_NULL_HANDLE;
 	}
 
-	if (chunk->vertexBufferMemory != VK_NULL_HANDLE) {
-		vkFreeMemory(device, chunk->vertexBufferMemory, nullptr);
-		chunk->vertexBufferMemory = VK_NULL_HANDLE;
+	allocator.free(&chunk->vertexBufferAllocation);
+	allocator.free(&chunk->indexBufferAllocation);
+}
+
+void WorldManager::saveModifiedChunks() {
+	for (auto& chunkPair : chunks) {
+		Chunk* chunk = chunkPair.second.get();
+		if (chunk->modified) {
+			chunkIO.requestStore(chunkPair.first.first, chunkPair.first.second, *chunk);
+			chunk->modified = false;
+		}
 	}
+}
 
-	if (chunk->indexBufferMemory != VK_NULL_HANDLE) {
-		vkFreeMemory(device, chunk->indexBufferMemory, nullptr);
-		chunk->indexBufferMemory = VK_NULL_HANDLE;
+void WorldManager::tickAutosave(float delta) {
+	autosaveTimer += delta;
+	if (autosaveTimer >= autosaveInterval) {
+		autosaveTimer = 0.0f;
+		saveModifiedChunks();
 	}
 }
 
 void WorldManager::clearChunks() {
+	saveModifiedChunks();
+	chunkIO.shutdown();
+
 	chunks.clear();
+	chunkCache.clear();
+	pendingLoads.clear();
+	loadedChunks.clear();
 }
\ No newline at end of file
@@ -4,41 +4,110 @@
 #include <utility>
 #include <functional>
 #include <unordered_map>
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include "chunk.h"
+#include "chunkcache.h"
+#include "chunkmesher.h"
+#include "chunkioworker.h"
+#include "lightengine.h"
+#include "paddedchunk.h"
+#include "palettechunk.h"
+#include "threadpool.h"
+#include <unordered_set>
 #include "../FastNoiseLite.h"
 #include <optional>
 
-struct pair_hash {
-	template <class T1, class T2>
-	std::size_t operator () (const std::pair<T1, T2>& pair) const {
-		auto hash1 = std::hash<T1>{}(pair.first);
-		auto hash2 = std::hash<T2>{}(pair.second);
-		return hash1 ^ hash2;
-	}
-};
-
 class WorldManager {
 public:
 	WorldManager();
 
 	void generateChunksAround(glm::vec3 cameraPos, int viewDistance);
-	void unloadDistantChunks(glm::vec3 cameraPos, int viewDistance, VkDevice device);
+	void unloadDistantChunks(glm::vec3 cameraPos, int viewDistance, VulkanAllocator& allocator);
 
 	void processChunkQueue(int chunksPerFrame);
 
 	std::shared_ptr<Chunk> getChunk(int x, int z);
-
+	// Lookup without touching the shared_ptr reference count, for hot loops
+	Chunk* findChunk(int chunkX, int chunkZ);
+
+	// BLOCK EDITS (world coordinates)
+	// Edits between beginBlockEdits and commitBlockEdits only mark sections dirty,
+	// every touched chunk is remeshed once on commit. Single calls commit right away.
+	void beginBlockEdits();
+	void commitBlockEdits();
 	void setBlock(int x, int y, int z, Block block);
+	void fillRegion(glm::ivec3 from, glm::ivec3 to, Block block);
 	std::optional<Block> getBlockInChunk(int x, int y, int z, Chunk* chunk);
 
+	// RAYCAST
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float maxDistance;
+	};
+
+	struct RaycastHit {
+		bool hit;
+		glm::ivec3 blockPosition; // World coordinates of the hit block
+		glm::ivec3 normal; // Zero if the ray starts inside a block
+		Chunk::FaceDirection face;
+		float distance;
+		Block block;
+	};
+
+	// Amanatides-Woo voxel traversal. Unloaded chunks and empty sections count as air.
+	RaycastHit raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance);
+	void raycastBatch(const std::vector<Ray>& rays, std::vector<RaycastHit>& hits);
+	// Casts rayCount rays in all directions from origin and logs the throughput, returns rays per second
+	double benchmarkRaycast(glm::vec3 origin, int rayCount, float maxDistance);
+
 	const std::unordered_map<std::pair<int, int>, std::shared_ptr<Chunk>, pair_hash> getChunks(){ return chunks; }
 
-	void cleanupBuffers(VkDevice device, Chunk* chunk);
+	void cleanupBuffers(VulkanAllocator& allocator, Chunk* chunk);
 
+	// Queues all edited chunks for saving
+	void saveModifiedChunks();
+	void tickAutosave(float delta);
 	void clearChunks();
 
+	// LEVEL OF DETAIL
+	// Chunks up to fullDetail chunks away from the camera are meshed at full resolution,
+	// every following ring halves the resolution. Chunks switch when the camera enters another chunk.
+	void setLodRings(int fullDetail, int halfDetail, int quarterDetail);
+	void updateLod(glm::vec3 cameraPos);
+
+	// GPU MESHING
+	// If enabled, full detail chunks are packed for the GPU mesher instead of meshed on the worker pool.
+	// The renderer takes the requests every frame, a request is dropped if its chunk was remeshed again
+	// (or unloaded) before the GPU finished it. Chunks that can't be packed are meshed on the CPU.
+	struct GpuMeshRequest {
+		int chunkX, chunkZ;
+		uint32_t meshVersion;
+		PaletteChunk input;
+		// CPU mesh of the same chunk when validating, compared face for face with the GPU mesh
+		bool validate;
+		std::vector<Vertex> referenceVertices;
+		std::vector<uint32_t> referenceIndices;
+		uint32_t referenceRanges[Chunk::MESH_RANGE_COUNT + 1];
+	};
+	void setGpuMeshing(bool enabled, bool validate);
+	void takeGpuMeshRequests(std::deque<GpuMeshRequest>& requests);
+	// Remeshes every loaded chunk, after switching between CPU and GPU meshing
+	void remeshAllChunks();
+
+	// TERRAIN GENERATOR
+	// Height of the top face of the generated terrain, smoothed over the blocks
+	float getSurfaceHeight(float x, float z) const;
+	// Highest block generateTerrain puts into the column, AIR if it is empty
+	Block getSurfaceBlock(int x, int z) const;
+
+	// Memory cap for the compressed data of unloaded chunks
+	void setChunkCacheBudget(size_t bytes) { chunkCache.setMemoryBudget(bytes); }
+
 private:
 
 	struct ChunkPriority {
@@ -52,8 +121,28 @@ private:
 
 	// FAST NOISE LITE
 	FastNoiseLite noiseGenerator;
-	float getHeight(float x, float z);
-	void generateChunks(int chunkX, int chunkZ);
+	int worldSeed;
+	// SAVE_MODE_NONE if the saved world was made by another terrain generator
+	WorldStorage::SaveMode saveMode;
+	// Reads or creates level.dat, sets seed to the world's seed
+	WorldStorage::SaveMode openLevel(int& seed);
+	float getHeight(float x, float z) const;
+	// Pure function of seed and coordinates, also called from the IO thread
+	void generateTerrain(int chunkX, int chunkZ, Block* blocks) const;
+	// Block of the generated terrain at height y of a column whose grass is at highestBlockY
+	static Block getGeneratedBlock(int y, int highestBlockY);
+	std::unique_ptr<Chunk> loadCachedChunk(int chunkX, int chunkZ);
+	void addChunk(int chunkX, int chunkZ, std::unique_ptr<Chunk> chunk);
+	// Spreads the light of freshly added chunks over their borders, on the worker pool
+	void connectChunks(const std::vector<std::pair<int, int>>& added);
+
+	// Chunks collected by processChunkQueue, prepared together on the worker pool
+	struct ReadyChunk {
+		int chunkX, chunkZ;
+		std::unique_ptr<Chunk> chunk;
+		bool generate; // Terrain still has to be generated
+	};
+	ThreadPool workerPool;
 
 	// WORLD DATA STUFF
 	std::pair<int, int> getChunkCoordinates(glm::vec3 cameraPos);
@@ -62,8 +151,43 @@ private:
 
 	std::priority_queue<ChunkPriority> chunkLoadingPriorityQueue;
 
-	void generateChunkMesh(int chunkX, int chunkZ, Chunk* chunk);
-	void processDeferredFaces(int chunkX, int chunkZ);
+	// Chunks evicted by unloadDistantChunks, checked before regenerating
+	ChunkCache chunkCache;
+
+	// Region file reads and writes, only edited chunks are written
+	ChunkIOWorker chunkIO;
+	std::unordered_set<std::pair<int, int>, pair_hash> pendingLoads;
+	std::vector<ChunkIOWorker::LoadResult> loadedChunks;
+	float autosaveTimer;
+
+	// Last chunk looked up by a raycast, reused across steps and rays of a batch
+	struct ChunkCursor {
+		int chunkX, chunkZ;
+		Chunk* chunk;
+		bool valid;
+	};
+	RaycastHit raycast(const Ray& ray, ChunkCursor& cursor);
+
+	int editBatchDepth;
+	std::unordered_set<std::pair<int, int>, pair_hash> dirtyChunks;
+	void markEdited(int chunkX, int chunkZ, glm::ivec3 localMin, glm::ivec3 localMax);
+	void markSectionsDirty(int chunkX, int chunkZ, int minY, int maxY);
+	void remeshChunk(int chunkX, int chunkZ, Chunk* chunk);
+
+	int lodRings[ChunkMesher::LOD_LEVEL_COUNT - 1];
+	std::pair<int, int> lodCenter;
+	int getLodDistance(int chunkX, int chunkZ) const;
+	int getLodLevel(int distance) const;
+
+	LightEngine lightEngine;
+	std::vector<glm::ivec3> lightChanges;
+	void markLightChanges();
+
+	std::atomic<uint32_t> meshVersionCounter;
+	bool gpuMeshing;
+	bool validateGpuMeshes;
+	std::mutex gpuMeshMutex;
+	std::vector<GpuMeshRequest> gpuMeshRequests; // Filled by the workers
 };
 
 #endif // !WORLDMANAGER_H
@@ -0,0 +1,266 @@
+#include "worldstorage.h"
+#include "chunkcodec.h"
+#include "../logger.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+const uint8_t LEVEL_MAGIC[4] = { 'M', 'C', 'L', 'V' };
+const uint32_t LEVEL_VERSION = 1;
+
+// Delta payload after the format byte:
+//   int32 seed, uint32 generatorVersion, uint8 kind
+//   DELTA_SPARSE: varint count, count * (varint index gap, 4 byte block)
+//   DELTA_BITMASK: CHUNK_BLOCK_COUNT / 8 bytes changed mask, 4 byte block per set bit
+// Indices are Chunk::blockIndex order.
+enum DeltaKind : uint8_t {
+	DELTA_SPARSE = 0,
+	DELTA_BITMASK = 1,
+};
+const size_t DELTA_HEADER_SIZE = 9;
+
+static void writeBlock(std::vector<uint8_t>& out, const Block& block) {
+	out.push_back(block.type);
+	out.push_back(block.topTexture);
+	out.push_back(block.sideTexture);
+	out.push_back(block.bottomTexture);
+}
+
+WorldStorage::WorldStorage(const std::string& directory, SaveMode saveMode, const Terrain& terrain)
+	: directory(directory), saveMode(saveMode), terrain(terrain), warnedGeneratorMismatch(false) {
+	regionDirectory = directory + "/region";
+	generatedBlocks.resize(CHUNK_BLOCK_COUNT);
+}
+
+bool WorldStorage::loadChunk(int chunkX, int chunkZ, Block* blocks) {
+	if (saveMode == SAVE_MODE_NONE) {
+		return false;
+	}
+	RegionFile* region = getRegion(RegionFile::toRegionCoord(chunkX), RegionFile::toRegionCoord(chunkZ), false);
+	if (!region) {
+		return false;
+	}
+
+	const uint8_t* data;
+	size_t size;
+	if (!region->readChunk(RegionFile::toLocalCoord(chunkX), RegionFile::toLocalCoord(chunkZ), data, size)) {
+		return false;
+	}
+
+	bool loaded = false;
+	if (size >= 1 && data[0] == PAYLOAD_FULL) {
+		loaded = ChunkCodec::decode(data + 1, size - 1, blocks);
+	}
+	else if (size >= 1 && data[0] == PAYLOAD_DELTA) {
+		// Edits of other terrain would land on the wrong blocks, the chunk is generated and its edits are kept on disk
+		if (!isOwnDelta(data + 1, size - 1)) {
+			foreignDeltas.insert({ chunkX, chunkZ });
+			return false;
+		}
+		// Edited chunk, regenerate the terrain and put the edits back on top
+		terrain.generate(chunkX, chunkZ, blocks);
+		loaded = applyDelta(data + 1, size - 1, blocks);
+	}
+
+	if (!loaded) {
+		LOG_WARNING("Corrupt chunk data at ", chunkX, ", ", chunkZ, ", regenerating it");
+	}
+	return loaded;
+}
+
+bool WorldStorage::saveChunk(int chunkX, int chunkZ, const Block* blocks) {
+	if (saveMode == SAVE_MODE_NONE) {
+		return true;
+	}
+	if (foreignDeltas.count({ chunkX, chunkZ })) {
+		LOG_WARNING("Not saving chunk ", chunkX, ", ", chunkZ, ", it would overwrite edits of another terrain generator");
+		return true;
+	}
+	encodeBuffer.clear();
+	if (saveMode == SAVE_MODE_DELTA) {
+		terrain.generate(chunkX, chunkZ, generatedBlocks.data());
+		encodeDelta(blocks, generatedBlocks.data(), encodeBuffer);
+	}
+	else {
+		ChunkCodec::encode(blocks, encodeBuffer);
+		encodeBuffer.insert(encodeBuffer.begin(), PAYLOAD_FULL);
+	}
+
+	// An empty payload removes the chunk, it is regenerated on load
+	RegionFile* region = getRegion(RegionFile::toRegionCoord(chunkX), RegionFile::toRegionCoord(chunkZ), !encodeBuffer.empty());
+	if (!region) {
+		return encodeBuffer.empty();
+	}
+	return region->writeChunk(RegionFile::toLocalCoord(chunkX), RegionFile::toLocalCoord(chunkZ), encodeBuffer.data(), encodeBuffer.size());
+}
+
+void WorldStorage::encodeDelta(const Block* blocks, const Block* generated, std::vector<uint8_t>& out) {
+	uint32_t changedCount = 0;
+	for (int i = 0; i < CHUNK_BLOCK_COUNT; i++) {
+		if (blocks[i] != generated[i]) changedCount++;
+	}
+	if (changedCount == 0) {
+		return; // Nothing left of the edits, drop the saved chunk
+	}
+
+	out.push_back(PAYLOAD_DELTA);
+	out.resize(out.size() + 8);
+	memcpy(out.data() + 1, &terrain.seed, 4);
+	memcpy(out.data() + 5, &terrain.generatorVersion, 4);
+
+	// A sparse entry costs 1-2 bytes of index, the mask a fixed 2KB
+	if (changedCount * 2 < CHUNK_BLOCK_COUNT / 8) {
+		out.push_back(DELTA_SPARSE);
+		ChunkCodec::writeVarint(out, changedCount);
+		int previous = -1;
+		for (int i = 0; i < CHUNK_BLOCK_COUNT; i++) {
+			if (blocks[i] == generated[i]) continue;
+			ChunkCodec::writeVarint(out, uint32_t(i - previous));
+			writeBlock(out, blocks[i]);
+			previous = i;
+		}
+	}
+	else {
+		out.push_back(DELTA_BITMASK);
+		size_t maskOffset = out.size();
+		out.resize(out.size() + CHUNK_BLOCK_COUNT / 8, 0);
+		for (int i = 0; i < CHUNK_BLOCK_COUNT; i++) {
+			if (blocks[i] == generated[i]) continue;
+			out[maskOffset + i / 8] |= uint8_t(1 << (i % 8));
+			writeBlock(out, blocks[i]);
+		}
+	}
+}
+
+bool WorldStorage::isOwnDelta(const uint8_t* data, size_t size) {
+	if (size < DELTA_HEADER_SIZE) {
+		return true; // Corrupt, applyDelta rejects it
+	}
+	int seed;
+	uint32_t generatorVersion;
+	memcpy(&seed, data, 4);
+	memcpy(&generatorVersion, data + 4, 4);
+	if (seed == terrain.seed && generatorVersion == terrain.generatorVersion) {
+		return true;
+	}
+	if (!warnedGeneratorMismatch) {
+		LOG_ERROR("Chunk edits were saved with seed ", seed, " / generator ", generatorVersion,
+			", current terrain is seed ", terrain.seed, " / generator ", terrain.generatorVersion, ". They are not loaded and not overwritten");
+		warnedGeneratorMismatch = true;
+	}
+	return false;
+}
+
+bool WorldStorage::applyDelta(const uint8_t* data, size_t size, Block* blocks) {
+	if (size < DELTA_HEADER_SIZE) {
+		return false;
+	}
+	const uint8_t* end = data + size;
+
+	uint8_t kind = data[8];
+	data += DELTA_HEADER_SIZE;
+
+	if (kind == DELTA_SPARSE) {
+		uint32_t count;
+		if (!ChunkCodec::readVarint(data, end, count)) return false;
+		int index = -1;
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t gap;
+			if (!ChunkCodec::readVarint(data, end, gap) || gap == 0 || end - data < 4) return false;
+			index += gap;
+			if (index >= CHUNK_BLOCK_COUNT) return false;
+			blocks[index] = Block(data[0], data[1], data[2], data[3]);
+			data += 4;
+		}
+	}
+	else if (kind == DELTA_BITMASK) {
+		if (size_t(end - data) < CHUNK_BLOCK_COUNT / 8) return false;
+		const uint8_t* mask = data;
+		data += CHUNK_BLOCK_COUNT / 8;
+		for (int i = 0; i < CHUNK_BLOCK_COUNT; i++) {
+			if (!(mask[i / 8] & (1 << (i % 8)))) continue;
+			if (end - data < 4) return false;
+			blocks[i] = Block(data[0], data[1], data[2], data[3]);
+			data += 4;
+		}
+	}
+	else {
+		return false;
+	}
+	return data == end;
+}
+
+void WorldStorage::flush() {
+	for (auto& region : regions) {
+		if (region.second) {
+			region.second->flushTable();
+		}
+	}
+}
+
+void WorldStorage::close() {
+	flush();
+	regions.clear();
+}
+
+bool WorldStorage::readLevelInfo(const std::string& directory, LevelInfo& info) {
+	std::ifstream file(directory + "/level.dat", std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	uint8_t magic[4];
+	uint32_t version;
+	file.read((char*)magic, sizeof(magic));
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&info.seed, sizeof(info.seed));
+	file.read((char*)&info.generatorVersion, sizeof(info.generatorVersion));
+	if (!file || memcmp(magic, LEVEL_MAGIC, sizeof(magic)) != 0 || version != LEVEL_VERSION) {
+		LOG_ERROR("Invalid level.dat in ", directory);
+		return false;
+	}
+	return true;
+}
+
+bool WorldStorage::writeLevelInfo(const std::string& directory, const LevelInfo& info) {
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	std::ofstream file(directory + "/level.dat", std::ios::binary | std::ios::trunc);
+	if (!file) {
+		LOG_ERROR("Could not write level.dat in ", directory);
+		return false;
+	}
+	file.write((const char*)LEVEL_MAGIC, sizeof(LEVEL_MAGIC));
+	file.write((const char*)&LEVEL_VERSION, sizeof(LEVEL_VERSION));
+	file.write((const char*)&info.seed, sizeof(info.seed));
+	file.write((const char*)&info.generatorVersion, sizeof(info.generatorVersion));
+	return bool(file);
+}
+
+RegionFile* WorldStorage::getRegion(int regionX, int regionZ, bool create) {
+	std::pair<int, int> coords = { regionX, regionZ };
+	auto found = regions.find(coords);
+	if (found != regions.end() && (found->second || !create)) {
+		return found->second.get();
+	}
+
+	std::string path = regionDirectory + "/r." + std::to_string(regionX) + "." + std::to_string(regionZ) + ".region";
+
+	std::error_code error;
+	if (!create && !std::filesystem::exists(path, error)) {
+		regions[coords] = nullptr;
+		return nullptr;
+	}
+	if (create) {
+		std::filesystem::create_directories(regionDirectory, error);
+	}
+
+	std::unique_ptr<RegionFile> region = std::make_unique<RegionFile>(path);
+	if (!region->isOpen()) {
+		region.reset();
+	}
+	RegionFile* result = region.get();
+	regions[coords] = std::move(region);
+	return result;
+}
@@ -0,0 +1,75 @@
+#ifndef WORLDSTORAGE_H
+#define WORLDSTORAGE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "chunk.h"
+#include "regionfile.h"
+
+// Saves and loads chunks to region files inside a world directory.
+// Every chunk is compressed on its own, so it can be read and rewritten independently.
+class WorldStorage {
+public:
+	enum SaveMode {
+		SAVE_MODE_FULL,  // Whole voxel array of every saved chunk
+		SAVE_MODE_DELTA, // Only the voxels that differ from the regenerated terrain
+		SAVE_MODE_NONE,  // Nothing is read or written, for a world this build can't load
+	};
+
+	// The terrain generator has to be a pure function of seed and chunk coordinates
+	struct Terrain {
+		int seed;
+		uint32_t generatorVersion;
+		std::function<void(int chunkX, int chunkZ, Block* blocks)> generate;
+	};
+
+	// Contents of level.dat
+	struct LevelInfo {
+		int seed;
+		uint32_t generatorVersion;
+	};
+
+	WorldStorage(const std::string& directory, SaveMode saveMode, const Terrain& terrain);
+
+	bool loadChunk(int chunkX, int chunkZ, Block* blocks);
+	bool saveChunk(int chunkX, int chunkZ, const Block* blocks);
+
+	// Writes the chunk tables of all regions touched since the last flush
+	void flush();
+	void close();
+
+	static bool readLevelInfo(const std::string& directory, LevelInfo& info);
+	static bool writeLevelInfo(const std::string& directory, const LevelInfo& info);
+
+private:
+	enum PayloadFormat : uint8_t {
+		PAYLOAD_FULL = 1,  // ChunkCodec data of the whole chunk
+		PAYLOAD_DELTA = 2, // Edits on top of the generated terrain, see encodeDelta
+	};
+
+	RegionFile* getRegion(int regionX, int regionZ, bool create);
+
+	void encodeDelta(const Block* blocks, const Block* generated, std::vector<uint8_t>& out);
+	// False if the delta was saved for another seed or terrain generator
+	bool isOwnDelta(const uint8_t* data, size_t size);
+	bool applyDelta(const uint8_t* data, size_t size, Block* blocks);
+
+	std::string directory;
+	std::string regionDirectory;
+	SaveMode saveMode;
+	Terrain terrain;
+	bool warnedGeneratorMismatch;
+	// Chunks whose deltas belong to another seed or generator, they are never overwritten
+	std::unordered_set<std::pair<int, int>, pair_hash> foreignDeltas;
+
+	// nullptr marks a region without a file on disk
+	std::unordered_map<std::pair<int, int>, std::unique_ptr<RegionFile>, pair_hash> regions;
+
+	std::vector<uint8_t> encodeBuffer;
+	std::vector<Block> generatedBlocks;
+};
+
+#endif // !WORLDSTORAGE_H
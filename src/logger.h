@@ -38,7 +38,11 @@ private:
         time_t now = time(0);
         struct tm timeInfo;
         char buf[80];
+#ifdef _WIN32
         localtime_s(&timeInfo, &now);
+#else
+        localtime_r(&now, &timeInfo);
+#endif
         strftime(buf, sizeof(buf), "%Y-%m-%d %X", &timeInfo);
         return std::string(buf);
     }
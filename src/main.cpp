@@ -1,9 +1,7 @@
 #include "app.h"
 
-int main() {
+int main(int argc, char** argv) {
 
 	App app;
-	app.run();
-
-	return 0;
+	return app.run(argc, argv);
 }
\ No newline at end of file
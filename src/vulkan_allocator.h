@@ -0,0 +1,115 @@
+#ifndef VULKAN_ALLOCATOR_H
+#define VULKAN_ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Memory of one buffer or image: a range inside a block of device memory
+struct VulkanAllocation {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	void* mapped; // Host visible memory stays mapped, points at offset. nullptr for device local memory.
+	uint32_t memoryType;
+	uint32_t block; // In the pool of the memory type, DEDICATED_BLOCK for allocations with their own memory
+	bool linear;
+	uint8_t category;
+};
+
+// Sub-allocates buffers and images from large blocks of device memory, one pool of blocks per memory type
+// and resource tiling (keeping linear and optimal resources apart avoids bufferImageGranularity padding).
+// Blocks hand out ranges best fit from an offset ordered free list, freed ranges merge with their neighbors.
+// Requests bigger than half a block get a dedicated allocation.
+//
+// Every allocation is counted per category, heap usage is checked against the budget of VK_EXT_memory_budget
+// when the device has it (a fixed share of the heap otherwise).
+class VulkanAllocator {
+public:
+	enum Category {
+		CATEGORY_CHUNK_MESH = 0,
+		CATEGORY_UNIFORM = 1,
+		CATEGORY_TEXTURE = 2,
+		CATEGORY_RENDER_TARGET = 3,
+		CATEGORY_STAGING = 4,
+		CATEGORY_FAR_TERRAIN = 5,
+		CATEGORY_COUNT = 6
+	};
+
+	static const uint32_t DEDICATED_BLOCK = UINT32_MAX;
+
+	struct CategoryStatistics {
+		VkDeviceSize bytes;
+		uint32_t allocationCount;
+	};
+
+	struct HeapStatistics {
+		VkDeviceSize size;
+		VkDeviceSize budget; // What the process should stay below
+		VkDeviceSize usage; // Whole process if the driver reports it, otherwise our blocks
+		VkDeviceSize blockBytes; // Device memory we allocated
+		VkDeviceSize allocationBytes; // Handed out of it
+	};
+
+	struct Statistics {
+		CategoryStatistics categories[CATEGORY_COUNT];
+		HeapStatistics heaps[VK_MAX_MEMORY_HEAPS];
+		uint32_t heapCount;
+		uint32_t blockCount;
+		uint32_t dedicatedCount;
+		bool driverBudget;
+	};
+
+	// memoryBudget: VK_EXT_memory_budget is enabled on the device (needs VK_KHR_get_physical_device_properties2)
+	void init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget);
+	void cleanup();
+
+	// linear: buffers and linear images, false for optimal tiling images
+	bool allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, Category category, VulkanAllocation* allocation);
+	void free(VulkanAllocation* allocation);
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+	VkDevice getDevice() const { return device; }
+
+	// Refreshes the driver budget on every call
+	Statistics getStatistics();
+	void logStatistics();
+
+	static const char* getCategoryName(Category category);
+
+private:
+	struct Block {
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		void* mapped;
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges; // Offset -> size
+		VkDeviceSize usedBytes;
+		uint32_t allocationCount;
+	};
+
+	struct Pool {
+		std::vector<Block> blocks; // Released blocks stay as empty slots, allocations refer to them by index
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+
+	Pool pools[VK_MAX_MEMORY_TYPES][2]; // [memory type][linear]
+	VkDeviceSize blockSizes[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize heapBlockBytes[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize heapAllocationBytes[VK_MAX_MEMORY_HEAPS];
+	CategoryStatistics categories[CATEGORY_COUNT];
+	uint32_t dedicatedCount = 0;
+	bool budgetWarned = false;
+
+	bool allocateMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory* memory, void** mapped);
+	void freeMemory(uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, void* mapped);
+	bool allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+	void getHeapBudgets(VkDeviceSize* budgets, VkDeviceSize* usages);
+	void checkBudget(uint32_t heap, VkDeviceSize size);
+};
+
+#endif // !VULKAN_ALLOCATOR_H
@@ -1,37 +1,53 @@
 #include "vulkan_base.h"
+#include <cstring>
 
 // CONSTRUCTOR
-Vulkan::Vulkan(SDL_Window* window) {
+Vulkan::Vulkan(SDL_Window* window, const Settings& settings) : collision(worldManager), farTerrain(worldManager) {
 	this->window = window;
+	this->settings = settings;
+	this->settings.framesInFlight = std::min(std::max(settings.framesInFlight, 1u), uint32_t(MAX_FRAMES_IN_FLIGHT));
+	frameTimingHistory.reserve(FRAME_TIMING_HISTORY);
+	for (FrameTiming& timing : frameTimings) {
+		timing = {};
+	}
+	for (CaptureSlot& slot : captureSlots) {
+		slot.buffer = {};
+		slot.size = 0;
+		slot.pending = false;
+	}
 	context = new VulkanContext;
 	context->device = nullptr;
 	mipmapLevels = 4.0f;
 }
 
 // INIT VULKAN
-void Vulkan::initVulkan() {
+bool Vulkan::initVulkan() {
 	
 	// Init Vulkan Context and Surface
 	this->loadDeviceExtensions();
 	if (!this->initVulkanContext()) {
 		LOG_ERROR("Error creating vulkan context!");
-		return;
+		return false;
 	}
 	
-	// Create Swapchain
-	if (!this->createSwapchain(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0)) {
+	// Create Swapchain (offscreen images when headless)
+	if (settings.headless) {
+		if (!this->createOffscreenTarget()) {
+			LOG_ERROR("Error creating offscreen target!");
+			return false;
+		}
+	}
+	else if (!this->createSwapchain(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0)) {
 		LOG_ERROR("Error creating swapchain!");
-		return;
+		return false;
 	}
 
 	// Create RenderPass
 	if (!this->recreateRenderPass()) {
 		LOG_ERROR("Error creating renderPass!");
-		return;
+		return false;
 	}
 
-	createSampler();
-
 	// CREATE TEXTURE ARRAY
 	paths.push_back("../data/textures/stone.png"); // 1
 	paths.push_back("../data/textures/dirt.png"); // 2
@@ -41,8 +57,12 @@ void Vulkan::initVulkan() {
 	paths.push_back("../data/textures/oak_log_top.png"); // 6
 	createTextureArray();
 
+	// After the texture array, the sampler covers its whole mip chain
+	createSampler();
+
 	// CAMERA
 	cameraManager.initCamera();
+	cameraManager.setCollision(&collision);
 
 	//worldManager.generateChunksAround(cameraManager.camera.cameraPosition, viewDistance);
 	//worldManager.processChunkQueue(1);
@@ -53,9 +73,26 @@ void Vulkan::initVulkan() {
 
 	createDescriptorSets();
 
+	createTextureTable();
+
 	createVextexInputAttributes();
 
-	createPipeline("../shaders/texture_vert.spv", "../shaders/texture_frag.spv", &vertexInputBinding);
+	// One pipeline per block render layer
+	loadPipelineCache();
+	const char* fragmentShader = bindlessTextures ? "../shaders/texture_bindless_frag.spv" : "../shaders/texture_frag.spv";
+	const char* cutoutFragmentShader = bindlessTextures ? "../shaders/texture_bindless_cutout_frag.spv" : "../shaders/texture_cutout_frag.spv";
+	queuePipeline(&pipeline, "../shaders/texture_vert.spv", fragmentShader, &vertexInputBinding,
+		vertexAttributeDescriptions, ARRAY_COUNT(vertexAttributeDescriptions), chunkSetLayouts, chunkSetLayoutCount, nullptr, false);
+	queuePipeline(&cutoutPipeline, "../shaders/texture_vert.spv", cutoutFragmentShader, &vertexInputBinding,
+		vertexAttributeDescriptions, ARRAY_COUNT(vertexAttributeDescriptions), chunkSetLayouts, chunkSetLayoutCount, nullptr, false);
+	queuePipeline(&translucentPipeline, "../shaders/texture_vert.spv", fragmentShader, &vertexInputBinding,
+		vertexAttributeDescriptions, ARRAY_COUNT(vertexAttributeDescriptions), chunkSetLayouts, chunkSetLayoutCount, nullptr, true);
+
+	createFarTerrain();
+	createQueuedPipelines();
+
+	// After the pipeline cache is loaded
+	createGpuMesher();
 
 	createFencesAndSemaphores();
 
@@ -72,6 +109,7 @@ void Vulkan::initVulkan() {
 		begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 		VKA(vkBeginCommandBuffer(commandBuffer, &begin_info));
 	}
+	return true;
 }
 
 // LOAD DEVICE EXTENSIONS
@@ -81,13 +119,53 @@ void Vulkan::loadDeviceExtensions() {
 		VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME
 	};
 
-	SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, 0);
+	// Headless needs no surface extensions
+	instanceExtensionCount = 0;
+	if (!settings.headless) {
+		SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, 0);
+	}
+
+	// +1 for the optional properties2 extension
+	enabledInstanceExtensions = new const char* [instanceExtensionCount + ARRAY_COUNT(additionalInstanceExtensions) + 1];
+	if (!settings.headless) {
+		SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, enabledInstanceExtensions);
+	}
 
-	enabledInstanceExtensions = new const char* [instanceExtensionCount + ARRAY_COUNT(additionalInstanceExtensions)];
-	SDL_Vulkan_GetInstanceExtensions(window, &instanceExtensionCount, enabledInstanceExtensions);
+	// The debug extensions come with the validation layer, CI machines often do not have it
+	validationEnabled = false;
+	if (settings.validation) {
+		uint32_t layerPropertyCount = 0;
+		VKA(vkEnumerateInstanceLayerProperties(&layerPropertyCount, 0));
+		std::vector<VkLayerProperties> layerProperties(layerPropertyCount);
+		VKA(vkEnumerateInstanceLayerProperties(&layerPropertyCount, layerProperties.data()));
+		for (const VkLayerProperties& layer : layerProperties) {
+			if (strcmp(layer.layerName, "VK_LAYER_KHRONOS_validation") == 0) {
+				validationEnabled = true;
+				break;
+			}
+		}
+		if (!validationEnabled) {
+			LOG_WARNING("VK_LAYER_KHRONOS_validation is not installed, running without validation");
+		}
+	}
+	if (validationEnabled) {
+		for (uint32_t i = 0; i < ARRAY_COUNT(additionalInstanceExtensions); i++) {
+			enabledInstanceExtensions[instanceExtensionCount++] = additionalInstanceExtensions[i];
+		}
+	}
 
-	for (uint32_t i = 0; i < ARRAY_COUNT(additionalInstanceExtensions); i++) {
-		enabledInstanceExtensions[instanceExtensionCount++] = additionalInstanceExtensions[i];
+	// Needed to query VK_EXT_memory_budget on a 1.0 instance
+	uint32_t extensionPropertyCount = 0;
+	VKA(vkEnumerateInstanceExtensionProperties(0, &extensionPropertyCount, 0));
+	std::vector<VkExtensionProperties> extensionProperties(extensionPropertyCount);
+	VKA(vkEnumerateInstanceExtensionProperties(0, &extensionPropertyCount, extensionProperties.data()));
+	physicalDeviceProperties2 = false;
+	for (const VkExtensionProperties& extension : extensionProperties) {
+		if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+			enabledInstanceExtensions[instanceExtensionCount++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+			physicalDeviceProperties2 = true;
+			break;
+		}
 	}
 }
 
@@ -124,13 +202,7 @@ VkDebugUtilsMessengerEXT Vulkan::registerDebugCallback() {
 // INIT VULKAN INSTANCE
 bool Vulkan::initVulkanInstance() {
 
-	//LOAD LAYERS
-	uint32_t layerPropertyCount = 0;
-	VKA(vkEnumerateInstanceLayerProperties(&layerPropertyCount, 0));
-	VkLayerProperties* layerProperties = new VkLayerProperties[layerPropertyCount];
-	VKA(vkEnumerateInstanceLayerProperties(&layerPropertyCount, layerProperties));
-	delete[] layerProperties;
-
+	//LOAD LAYERS (checked in loadDeviceExtensions)
 	const char* enabledLayers[] = { "VK_LAYER_KHRONOS_validation" };
 	// VALIDATION
 	VkValidationFeatureEnableEXT enableValidationFeatures[] = {
@@ -146,13 +218,20 @@ bool Vulkan::initVulkanInstance() {
 	VkApplicationInfo applicationInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
 	applicationInfo.pApplicationName = "Test Game";
 	applicationInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 1); // 0.0.1
-	applicationInfo.apiVersion = VK_API_VERSION_1_0;
+	// 1.2 IF THE LOADER HAS IT, DESCRIPTOR INDEXING IS CORE THERE
+	instanceApiVersion = VK_API_VERSION_1_0;
+	PFN_vkEnumerateInstanceVersion pfnEnumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(0, "vkEnumerateInstanceVersion");
+	uint32_t loaderApiVersion = VK_API_VERSION_1_0;
+	if (pfnEnumerateInstanceVersion && pfnEnumerateInstanceVersion(&loaderApiVersion) == VK_SUCCESS && loaderApiVersion >= VK_API_VERSION_1_2) {
+		instanceApiVersion = VK_API_VERSION_1_2;
+	}
+	applicationInfo.apiVersion = instanceApiVersion;
 
 	// Load Create Info
 	VkInstanceCreateInfo createInfo{ VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
-	createInfo.pNext = &validationFeatures;
+	createInfo.pNext = validationEnabled ? &validationFeatures : 0;
 	createInfo.pApplicationInfo = &applicationInfo;
-	createInfo.enabledLayerCount = ARRAY_COUNT(enabledLayers);
+	createInfo.enabledLayerCount = validationEnabled ? ARRAY_COUNT(enabledLayers) : 0;
 	createInfo.ppEnabledLayerNames = enabledLayers;
 	createInfo.enabledExtensionCount = instanceExtensionCount;
 	createInfo.ppEnabledExtensionNames = enabledInstanceExtensions;
@@ -163,7 +242,7 @@ bool Vulkan::initVulkanInstance() {
 		return false;
 	}
 
-	context->debugCallback = registerDebugCallback();
+	context->debugCallback = validationEnabled ? registerDebugCallback() : 0;
 
 	return true;
 }
@@ -243,6 +322,7 @@ bool Vulkan::createLogicalDevice(uint32_t deviceExtensionCount, const char** dev
 	createInfo.enabledExtensionCount = deviceExtensionCount;
 	createInfo.ppEnabledExtensionNames = deviceExtensions;
 	createInfo.pEnabledFeatures = &enabledFeatures;
+	createInfo.pNext = bindlessTextures ? &descriptorIndexingFeatures : 0;
 
 	if (vkCreateDevice(context->physicalDevice, &createInfo, 0, &context->device)) {
 		LOG_ERROR("Failed to create vulkan logical device");
@@ -270,7 +350,11 @@ bool Vulkan::createLogicalDevice(uint32_t deviceExtensionCount, const char** dev
 // INIT VULKAN CONTEXT
 bool Vulkan::initVulkanContext() {
 
-	const char* deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	const char* deviceExtensions[4] = {};
+	uint32_t deviceExtensionCount = 0;
+	if (!settings.headless) {
+		deviceExtensions[deviceExtensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+	}
 
 	// INIT VULKAN
 	LOG_INFO("Initializing vulkan...");
@@ -285,15 +369,38 @@ bool Vulkan::initVulkanContext() {
 		return false;
 	}
 
+	// MEMORY BUDGET (optional, the allocator falls back to a fixed share of the heaps)
+	bool memoryBudget = false;
+	if (physicalDeviceProperties2) {
+		uint32_t extensionPropertyCount = 0;
+		VKA(vkEnumerateDeviceExtensionProperties(context->physicalDevice, 0, &extensionPropertyCount, 0));
+		std::vector<VkExtensionProperties> extensionProperties(extensionPropertyCount);
+		VKA(vkEnumerateDeviceExtensionProperties(context->physicalDevice, 0, &extensionPropertyCount, extensionProperties.data()));
+		for (const VkExtensionProperties& extension : extensionProperties) {
+			if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+				deviceExtensions[deviceExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+				memoryBudget = true;
+				break;
+			}
+		}
+	}
+
+	// BINDLESS TEXTURES (optional, core in 1.2, VK_EXT_descriptor_indexing before)
+	checkDescriptorIndexing(deviceExtensions, deviceExtensionCount);
+
 	// SELECT THE LOGICAL DEVICE (gpu "software" to render)
 	LOG_INFO("Creating logical device...");
-	if (!createLogicalDevice(ARRAY_COUNT(deviceExtensions), deviceExtensions)) {
+	if (!createLogicalDevice(deviceExtensionCount, deviceExtensions)) {
 		LOG_ERROR("Error creating logical device");
 		return false;
 	}
+	allocator.init(context->instance, context->physicalDevice, context->device, memoryBudget);
 
 	// CREATE VULKAN SURFACE
-	if (SDL_Vulkan_CreateSurface(window, context->instance, &surface) != SDL_TRUE) {
+	if (settings.headless) {
+		surface = VK_NULL_HANDLE;
+	}
+	else if (SDL_Vulkan_CreateSurface(window, context->instance, &surface) != SDL_TRUE) {
 		LOG_ERROR("Failed to create Vulkan surface!");
 		return false;
 	}
@@ -303,7 +410,10 @@ bool Vulkan::initVulkanContext() {
 
 // CLEANUP THE CONTEXT
 void Vulkan::cleanupContext() {
-	VK(vkDestroySurfaceKHR(context->instance, surface, 0));
+	if (surface) {
+		VK(vkDestroySurfaceKHR(context->instance, surface, 0));
+	}
+	allocator.cleanup();
 	VK(vkDestroyDevice(context->device, 0));
 
 	if (context->debugCallback) {
@@ -320,43 +430,54 @@ void Vulkan::cleanupContext() {
 // CLEANUP
 void Vulkan::cleanup() {
 	LOG_INFO("Exiting vulkan...");
-	VKA(vkDeviceWaitIdle(context->device));
+	finishFrames();
+	frameWriter.shutdown();
+	cleanupCaptures();
+	cleanupGpuMesher();
 
 	VK(vkDestroyDescriptorPool(context->device, descriptorPool, 0));
 
 	VK(vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, 0));
 
-	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		for (uint32_t j = 0; j < UNIFORM_BUFFER_COUNT; j++) {
-			cleanupBuffer(&uniformBuffers[j][i].buffer, &uniformBuffers[j][i].memory);
+			cleanupBuffer(&uniformBuffers[j][i].buffer, &uniformBuffers[j][i].allocation);
 		}
 	}
 
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		releaseRetiredBuffers(i);
+	}
+
+	cleanupRegions();
 	for (auto& chunkPair : worldManager.getChunks()) {
-		worldManager.cleanupBuffers(context->device, chunkPair.second.get());
+		worldManager.cleanupBuffers(allocator, chunkPair.second.get());
 	}
 	worldManager.clearChunks();
 	
-	for (uint32_t i = 0; i < textureArray.images.size(); i++) {
-		cleanupImage(textureArray.images[i]);
-	}
-	textureArray.images.clear();
+	cleanupTextureTable();
+	cleanupImage(&textureArray.image);
 	paths.clear();
 
-	for (uint32_t i = 0; i < ARRAY_COUNT(fences); i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		VK(vkDestroyFence(context->device, fences[i], 0));
 	}
 
-	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 
 		VK(vkDestroySemaphore(context->device, acquireSemaphores[i], 0));
 		VK(vkDestroySemaphore(context->device, releaseSemaphores[i], 0));
 	}
-	for (uint32_t i = 0; i < ARRAY_COUNT(commandPools); i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		VK(vkDestroyCommandPool(context->device, commandPools[i], 0));
 	}
 
-	cleanupPipeline();
+	cleanupFarTerrain();
+	cleanupPipeline(&translucentPipeline);
+	cleanupPipeline(&cutoutPipeline);
+	cleanupPipeline(&pipeline);
+	savePipelineCache();
+	VK(vkDestroyPipelineCache(context->device, pipelineCache, 0));
 
 	vkDestroySampler(context->device, sampler, 0);
 
@@ -379,6 +500,11 @@ void Vulkan::cleanup() {
 	depthBuffers.clear();
 
 	cleanupRenderPass();
-	cleanupSwapchain(&swapchain);
+	if (settings.headless) {
+		cleanupOffscreenTarget();
+	}
+	else {
+		cleanupSwapchain(&swapchain);
+	}
 	cleanupContext();
 }
\ No newline at end of file
@@ -3,10 +3,16 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <deque>
+#include <unordered_map>
 
 #include "game_engine/window.h"
 #include "game_engine/cameramanager.h"
 #include "game_engine/worldmanager.h"
+#include "game_engine/collision.h"
+#include "game_engine/farterrain.h"
+#include "game_engine/framewriter.h"
+#include "vulkan_allocator.h"
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm/ext/matrix_transform.hpp>
@@ -25,12 +31,31 @@
 #define ARRAY_COUNT(array) (sizeof(array) / sizeof((array)[0]))
 #define ALIGN_UP_POW2(x, p) (((x)+(p) - 1) &~((p) - 1))
 
-#define FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT 3
 #define UNIFORM_BUFFER_COUNT 2
 
 class Vulkan {
 public:
-	Vulkan(SDL_Window* window);
+	// Chosen on the command line
+	struct Settings {
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // Falls back to FIFO if the surface does not support it
+		uint32_t framesInFlight = 2; // 1 to MAX_FRAMES_IN_FLIGHT, fewer frames means less latency but less overlap of CPU and GPU
+		bool logLatency = false; // Log the latency of every frame, not only with F6
+		bool validation = true; // Validation layer, if it is installed
+		bool bindless = true; // Texture table with descriptor indexing, if the device supports it
+		bool gpuMesher = false; // Experimental: full detail chunks are meshed by a compute shader, not yet validated on a device
+		bool validateGpuMesher = false; // Every GPU mesh is read back and compared with the CPU mesh of the chunk
+		// Render into offscreen images instead of a window surface, nothing is presented
+		bool headless = false;
+		uint32_t width = 1240;
+		uint32_t height = 720;
+	};
+
+	Vulkan(SDL_Window* window, const Settings& settings);
+
+	// fifo, fifo-relaxed, mailbox or immediate
+	static bool parsePresentMode(const char* name, VkPresentModeKHR* mode);
+	static const char* getPresentModeName(VkPresentModeKHR mode);
 
 	// QUEUE
 	struct VulkanQueue {
@@ -46,6 +71,7 @@ public:
 		VkFormat format;
 		std::vector<VkImage> images;
 		std::vector<VkImageView> imageViews;
+		bool transferSource; // Images can be copied out for captures
 	};
 
 	// PIPELINE
@@ -67,14 +93,14 @@ public:
 	// BUFFER
 	struct VulkanBuffer {
 		VkBuffer buffer;
-		VkDeviceMemory memory;
+		VulkanAllocation allocation;
 	};
 
 	// IMAGE
 	struct VulkanImage {
 		VkImage image;
 		VkImageView view;
-		VkDeviceMemory memory;
+		VulkanAllocation allocation;
 	};
 
 	// Uniform Buffer
@@ -83,65 +109,124 @@ public:
 		glm::mat4 modelView;
 	};
 
-	// TextureArray
+	// Far terrain, vertex stage push constants
+	struct FarTerrainPushConstants {
+		glm::mat4 viewProj;
+		glm::vec4 cameraPosition;
+		glm::vec4 fog; // Start and end distance
+	};
+
+	// TextureArray, one layer per block texture in a single image
 	struct TextureArray {
-		std::vector<VulkanImage*> images;
-		void* data;
+		VulkanImage image;
+		const void* data; // Level by level, all layers of a level one after the other
 		size_t size;
 		uint32_t width;
 		uint32_t height;
 		uint32_t layerCount;
-		uint32_t arrayLayer;
+		uint32_t mipLevels;
+		uint32_t uploadedLevels; // Levels in data, the rest is blitted on the GPU
 		VkImageLayout finalLayout;
 		VkAccessFlags dstAccessMask;
 	};
 
 	SDL_Window* window;
+	Settings settings;
 	VulkanContext* context;
+	// Memory of all buffers and images, statistics are logged with F5
+	VulkanAllocator allocator;
+	// Encodes captures and compares them against golden images
+	FrameWriter frameWriter;
 	VkSurfaceKHR surface;
 	VulkanSwapchain swapchain;
 	VulkanSwapchain oldSwapchain;
 	VkRenderPass renderPass;
 	std::vector<VulkanImage> depthBuffers;
 	std::vector<VkFramebuffer> framebuffers;
-	VkCommandPool commandPools[FRAMES_IN_FLIGHT];
-	VkCommandBuffer commandBuffers[FRAMES_IN_FLIGHT];
-	VkFence fences[FRAMES_IN_FLIGHT];
-	VkSemaphore acquireSemaphores[FRAMES_IN_FLIGHT];
-	VkSemaphore releaseSemaphores[FRAMES_IN_FLIGHT];
+	VkCommandPool commandPools[MAX_FRAMES_IN_FLIGHT];
+	VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkFence fences[MAX_FRAMES_IN_FLIGHT];
+	VkSemaphore acquireSemaphores[MAX_FRAMES_IN_FLIGHT];
+	VkSemaphore releaseSemaphores[MAX_FRAMES_IN_FLIGHT];
 
-	VkDescriptorSet descriptorSets[UNIFORM_BUFFER_COUNT][FRAMES_IN_FLIGHT];
+	VkDescriptorSet descriptorSets[UNIFORM_BUFFER_COUNT][MAX_FRAMES_IN_FLIGHT];
 	VkDescriptorSetLayout descriptorSetLayout;
 
 	TextureArray textureArray;
 	std::vector<const char*> paths;
 
 	VulkanPipeline pipeline;
+	VulkanPipeline cutoutPipeline;
+	VulkanPipeline translucentPipeline;
 	VkSampler sampler;
 	VkDescriptorPool descriptorPool;
-	VulkanBuffer uniformBuffers[UNIFORM_BUFFER_COUNT][FRAMES_IN_FLIGHT];
+	VulkanBuffer uniformBuffers[UNIFORM_BUFFER_COUNT][MAX_FRAMES_IN_FLIGHT];
 	CameraManager cameraManager;
 
 	uint32_t maxUniformSize;
 	uint64_t singleElementSize;
 
-	VkVertexInputAttributeDescription vertexAttributeDescriptions[4];
+	VkVertexInputAttributeDescription vertexAttributeDescriptions[6];
 	VkVertexInputBindingDescription vertexInputBinding;
 
 	WorldManager worldManager;
+	Collision collision;
 	const uint32_t viewDistance = 10;
 
+	// FAR TERRAIN
+	FarTerrain farTerrain;
+	VulkanPipeline farTerrainPipeline;
+	VkVertexInputAttributeDescription farTerrainAttributeDescriptions[3];
+	VkVertexInputBindingDescription farTerrainInputBinding;
+	VkPushConstantRange farTerrainPushConstantRange;
+
 	float mipmapLevels;
 
-	void initVulkan();
+	bool initVulkan();
 
 	// RENDER
-	void renderVulkan();
+	// inputCounter is the performance counter when the input of this frame was read
+	void renderVulkan(uint64_t inputCounter);
 	void updateVulkan(float delta);
+	// Waits for all submitted frames, so their timings are complete and their captures are handed to the frame writer
+	void finishFrames();
+	// Adds a texture to the bindless texture table while the game runs, returns its texture index for blocks
+	// (0 if it failed or the device has no descriptor indexing)
+	uint32_t registerTexture(const char* path);
+	// Copies the next rendered frame to path (PNG), compared against goldenPath if it is not empty.
+	// F7 captures a screenshot.
+	void requestCapture(const std::string& path, const std::string& goldenPath = "");
+	void logFrameTimings();
+	// GPU meshes that differed from the CPU mesh, with validateGpuMesher
+	uint32_t getFailedGpuMeshComparisons() const { return failedGpuMeshComparisons; }
+
+	// CAPTURE
+	// The image of a captured frame is copied into a host visible buffer of its frame index in the frame's
+	// own command buffer. The pixels are taken out once the fence of that frame index was waited on anyway,
+	// so a capture never makes the render loop wait for the GPU.
+	struct CaptureSlot {
+		VulkanBuffer buffer;
+		VkDeviceSize size;
+		bool pending;
+		FrameWriter::Frame frame; // Without pixels until the copy finished
+	};
+	CaptureSlot captureSlots[MAX_FRAMES_IN_FLIGHT];
+	bool captureRequested = false;
+	std::string capturePath;
+	std::string captureGoldenPath;
+	void recordCapture(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex);
+	void collectCapture(uint32_t frameIndex);
+	void cleanupCaptures();
 
 	void cleanup();
 private:
 
+	// DEBUG KEYS
+	// True only in the frame the key went down, holding it does not repeat the action
+	bool debugKeyPressed(SDL_Scancode key);
+	bool debugKeysDown[SDL_NUM_SCANCODES] = {};
+	uint32_t screenshotCount = 0;
+
 	// DEVICE
 	void loadDeviceExtensions();
 	static VkBool32 VKAPI_CALL debugReportCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT messageTypes,
@@ -158,34 +243,91 @@ private:
 
 	uint32_t instanceExtensionCount;
 	const char** enabledInstanceExtensions;
+	bool physicalDeviceProperties2;
+	bool validationEnabled;
+	uint32_t instanceApiVersion;
 
 	// SWAPCHAIN
 	bool createSwapchain(VkImageUsageFlags usage, VulkanSwapchain* oldSwapchain);
 	void recreateSwapchain();
 	void cleanupSwapchain(VulkanSwapchain* swapchain);
 
+	// OFFSCREEN (headless)
+	// Stands in for the swapchain: one color image per frame in flight, the image index is the frame index
+	std::vector<VulkanImage> offscreenImages;
+	bool createOffscreenTarget();
+	void cleanupOffscreenTarget();
+
 	// RENDERPASS
 	bool createRenderPass(VkFormat format);
 	bool recreateRenderPass();
 	void cleanupRenderPass();
 
 	// PIPELINE
+	struct PipelineDescription {
+		VulkanPipeline* pipeline;
+		const char* vertexShaderFilename;
+		const char* fragmentShaderFilename;
+		VkVertexInputBindingDescription* binding;
+		const VkVertexInputAttributeDescription* attributes;
+		uint32_t attributeCount;
+		const VkDescriptorSetLayout* setLayouts;
+		uint32_t setLayoutCount;
+		const VkPushConstantRange* pushConstantRange;
+		bool blending;
+	};
+	// Pipelines are queued during startup and compiled together on worker threads
+	std::vector<PipelineDescription> queuedPipelines;
 	VkShaderModule createShaderModule(const char* shaderFilename);
-	bool createPipeline(const char* vertexShaderFilename, const char* fragmentShaderFilename, VkVertexInputBindingDescription* binding);
-	void cleanupPipeline();
+	void queuePipeline(VulkanPipeline* pipeline, const char* vertexShaderFilename, const char* fragmentShaderFilename, VkVertexInputBindingDescription* binding,
+		const VkVertexInputAttributeDescription* attributes, uint32_t attributeCount, const VkDescriptorSetLayout* setLayouts, uint32_t setLayoutCount,
+		const VkPushConstantRange* pushConstantRange, bool blending);
+	void createQueuedPipelines();
+	bool createPipeline(const PipelineDescription& description, VkShaderModule vertexShaderModule, VkShaderModule fragmentShaderModule);
+	bool createComputePipeline(VulkanPipeline* pipeline, const char* shaderFilename, VkDescriptorSetLayout setLayout, const VkPushConstantRange* pushConstantRange);
+	void cleanupPipeline(VulkanPipeline* pipeline);
+
+	// PIPELINE CACHE
+	// Kept on disk between runs, only reused by the same gpu and driver version
+	VkPipelineCache pipelineCache;
+	void loadPipelineCache();
+	void savePipelineCache();
 
 	// UTILS
 	// BUFFER
-	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags memoryProperties);
-	bool createBuffer(VkBuffer* buffer, VkDeviceMemory* memory, uint64_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties);
+	bool createBuffer(VkBuffer* buffer, VulkanAllocation* allocation, uint64_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties,
+		VulkanAllocator::Category category);
 	void uploadDataToBuffer(VulkanBuffer* buffer, void* data, size_t size);
-	void cleanupBuffer(VkBuffer* buffer, VkDeviceMemory* memory);
+	void cleanupBuffer(VkBuffer* buffer, VulkanAllocation* allocation);
 
 	// IMAGE
-	void createImage(VulkanImage* image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, uint32_t arrayLayers = 1);
+	void createImage(VulkanImage* image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, uint32_t arrayLayers = 1, uint32_t mipLevels = 1);
 	void uploadDataToImage(const TextureArray& uploadInfo);
 	void cleanupImage(VulkanImage* image);
 
+	// BINDLESS TEXTURES
+	// With descriptor indexing the chunk shaders look textures up in one large table (set 1). It is partially
+	// bound and updated after bind, so adding a texture writes a single entry while frames are in flight and
+	// nothing else is rebuilt. Set 0 then only holds the uniform buffer. Without descriptor indexing,
+	// binding 1 of set 0 is the block texture array.
+	static const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+	bool bindlessTextures = false;
+	uint32_t bindlessTextureCapacity = 0;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+	VkDescriptorSetLayout textureTableLayout = VK_NULL_HANDLE;
+	VkDescriptorPool textureTablePool = VK_NULL_HANDLE;
+	VkDescriptorSet textureTable = VK_NULL_HANDLE;
+	std::vector<VkImageView> textureLayerViews; // One per layer of the block texture array
+	std::vector<VulkanImage> registeredTextures;
+	uint32_t textureCount = 0; // Entries written, texture index - 1
+	VkDescriptorSetLayout chunkSetLayouts[2];
+	uint32_t chunkSetLayoutCount = 0;
+	bool checkDescriptorIndexing(const char** deviceExtensions, uint32_t& deviceExtensionCount);
+	void createTextureTable();
+	void writeTextureTableEntry(uint32_t index, VkImageView view);
+	void bindTextureTable(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
+	void cleanupTextureTable();
+
 	// CREATES
 	void createSampler();
 	//void createTextureImage(TextureArray& uploadInfo, const char* path);
@@ -201,7 +343,149 @@ private:
 	void renderInCommand(VkCommandBuffer commandBuffer, uint32_t frameIndex);
 	// CHUNK
 	void uploadChunkMesh(Chunk* chunk);
+	void uploadChunkIndices(Chunk* chunk);
+	// Replaced chunk buffers may still be read by frames in flight,
+	// they are destroyed once the fence of the retiring frame index is waited on again
+	std::vector<VulkanBuffer> retiredBuffers[MAX_FRAMES_IN_FLIGHT];
+	void retireBuffer(VkBuffer* buffer, VulkanAllocation* allocation, uint32_t frameIndex);
+	void retireChunkBuffers(Chunk* chunk, uint32_t frameIndex);
+	void releaseRetiredBuffers(uint32_t frameIndex);
+
+	// FRAME TIMING
+	// Latency from reading the input to queueing the present and to the GPU finishing the frame.
+	// The GPU side is seen through the fence, checked every frame, so it is late by up to one frame.
+	// Without a present timing extension the time the image reaches the screen is not known.
+	struct FrameTiming {
+		uint64_t inputCounter;
+		uint64_t presentCounter;
+		uint64_t completeCounter;
+		bool pending; // Submitted, the fence was not seen signaled yet
+	};
+	static const uint32_t FRAME_TIMING_HISTORY = 240;
+	FrameTiming frameTimings[MAX_FRAMES_IN_FLIGHT];
+	// Finished frames, oldest is overwritten first
+	std::vector<FrameTiming> frameTimingHistory;
+	uint32_t frameTimingHistoryIndex = 0;
+	void pollFrameTimings();
+	void finishFrameTiming(uint32_t frameIndex, uint64_t completeCounter);
+
+	// REGIONS
+	// Optional (F4): the chunks of a CHUNK_REGION_SIZE x CHUNK_REGION_SIZE area share one vertex and
+	// index buffer and one uniform slot, so a region is bound once and its chunks only issue draws.
+	// A region is culled as a whole before its chunks are. A changed chunk gets a new range behind the
+	// used part of the buffers, so ranges frames in flight still draw from are never written, and the
+	// buffers are only repacked once they are full.
+	static const int CHUNK_REGION_SIZE = 4;
+	struct ChunkRegion {
+		struct Member {
+			Chunk* chunk;
+			int chunkX, chunkZ;
+			int32_t vertexOffset;
+			uint32_t firstIndex;
+			bool visible;
+			bool verticesChanged;
+			bool indicesChanged;
+		};
+		std::vector<Member> chunks; // Loaded this frame, sorted by coordinates
+		std::vector<Member> packed; // Ranges in the buffers, vertex positions are relative to the region
+		VulkanBuffer vertices;
+		VulkanBuffer indices;
+		size_t vertexCount, vertexCapacity; // Used and allocated, ranges of replaced chunks stay used until a repack
+		size_t indexCount, indexCapacity;
+		glm::vec3 position;
+		glm::mat4 modelMatrix;
+		glm::vec3 center;
+		float radius;
+	};
+	std::unordered_map<std::pair<int, int>, ChunkRegion, pair_hash> chunkRegions;
+	bool chunkRegionMode = false;
+	void setChunkRegionMode(bool enabled);
+	void collectRegionDraws(uint32_t frameIndex);
+	void packRegion(ChunkRegion& region, uint32_t frameIndex);
+	void cleanupRegions();
+
+	// Chunks that passed culling this frame, nearest first (grouped by region in region mode).
+	// Opaque and cutout faces are drawn front to back, translucent faces back to front after the far terrain.
+	struct ChunkDraw {
+		Chunk* chunk;
+		ChunkRegion* region; // nullptr if the chunk has its own buffers
+		VkBuffer vertexBuffer;
+		VkBuffer indexBuffer;
+		int32_t vertexOffset;
+		uint32_t firstIndex;
+		VkDescriptorSet* descriptorSet;
+		uint32_t dynamicOffset;
+		uint8_t visibleFaces;
+		float distance;
+		float regionDistance;
+	};
+	std::vector<ChunkDraw> chunkDraws;
+	// Last bound buffers and uniform slot, consecutive draws of a region skip the binds
+	struct ChunkBinding {
+		VkBuffer vertexBuffer;
+		VkBuffer indexBuffer;
+		VkDescriptorSet* descriptorSet;
+		uint32_t dynamicOffset;
+	};
+	ChunkBinding boundChunk;
+	void collectChunkDraws(uint32_t frameIndex);
+	// View distance and frustum test, re-sorts the translucent faces if the camera moved far enough
+	bool cullChunk(int chunkX, int chunkZ, Chunk* chunk, bool& resorted);
+	void addChunkDraw(Chunk* chunk, ChunkRegion* region, VkBuffer vertexBuffer, VkBuffer indexBuffer, int32_t vertexOffset, uint32_t firstIndex);
 	void renderChunk(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void renderTranslucentChunks(VkCommandBuffer commandBuffer);
+	void bindChunk(VkCommandBuffer commandBuffer, const ChunkDraw& draw, VkPipelineLayout pipelineLayout);
+	// Draws the runs of visible directions of a layer, binds the chunk only if there is anything
+	void drawChunkFaces(VkCommandBuffer commandBuffer, const ChunkDraw& draw, Block::RenderLayer layer, VkPipelineLayout pipelineLayout);
+
+	// GPU MESHER
+	// Chunks are meshed in two passes recorded before the render pass of a frame. The count pass counts the faces
+	// of every mesh range, its counters are read once the fence of the frame index was waited on anyway. The next
+	// frame with that index creates exactly sized device local buffers and the emit pass writes the faces into them,
+	// they are drawn in the same frame. The input is a PaletteChunk per chunk, a few KB instead of a whole mesh.
+	static const uint32_t MAX_GPU_MESH_JOBS = 32; // Chunks per pass and frame
+	struct GpuMeshJob {
+		WorldManager::GpuMeshRequest request;
+		uint32_t meshRanges[Chunk::MESH_RANGE_COUNT + 1];
+		VkDeviceSize readbackOffset; // Vertices and then indices in the readback buffer
+	};
+	struct GpuMeshSlot {
+		VulkanBuffer input; // Emit inputs, then count inputs
+		VulkanBuffer counters; // Emit counters, then count counters, MESH_RANGE_COUNT per job
+		VkDescriptorSet countSet;
+		VkDescriptorSet emitSets[MAX_GPU_MESH_JOBS];
+		std::vector<GpuMeshJob> counting; // Counted by this frame index, emitted when it comes round again
+		std::vector<GpuMeshJob> validating; // Emitted and copied into the readback buffer
+		VulkanBuffer readback;
+		VkDeviceSize readbackSize;
+	};
+	bool gpuMesher = false;
+	GpuMeshSlot gpuMeshSlots[MAX_FRAMES_IN_FLIGHT];
+	std::deque<WorldManager::GpuMeshRequest> gpuMeshQueue; // Waiting for a free job
+	VkDescriptorSetLayout gpuMeshCountLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout gpuMeshEmitLayout = VK_NULL_HANDLE;
+	VkDescriptorPool gpuMeshPool = VK_NULL_HANDLE;
+	VulkanPipeline gpuMeshCountPipeline = {};
+	VulkanPipeline gpuMeshEmitPipeline = {};
+	uint32_t gpuMeshCount = 0;
+	uint32_t failedGpuMeshComparisons = 0;
+	void createGpuMesher();
+	void recordGpuMeshing(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void collectGpuMeshValidation(uint32_t frameIndex);
+	void cleanupGpuMesher();
+
+	// FAR TERRAIN
+	// Every frame in flight has its own host visible copy of each level, rewritten when the level changed
+	struct FarTerrainBuffers {
+		VulkanBuffer vertices;
+		VulkanBuffer indices;
+		uint32_t indexCount;
+		uint32_t version;
+	};
+	FarTerrainBuffers farTerrainBuffers[MAX_FRAMES_IN_FLIGHT][FarTerrain::LEVEL_COUNT];
+	void createFarTerrain();
+	void renderFarTerrain(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void cleanupFarTerrain();
 };
 
 #endif // VULKAN_H
\ No newline at end of file
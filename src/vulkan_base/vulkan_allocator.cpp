@@ -0,0 +1,354 @@
+#include "../vulkan_allocator.h"
+#include "../logger.h"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+const VkDeviceSize MAX_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+// Without VK_EXT_memory_budget the process aims to stay below this share of a heap
+const VkDeviceSize FALLBACK_BUDGET_PERCENT = 80;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+void VulkanAllocator::init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudget) {
+	this->device = device;
+	this->physicalDevice = physicalDevice;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	if (memoryBudget) {
+		getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+	}
+
+	// Small heaps (integrated gpus, the host visible BAR) get smaller blocks
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+		blockSizes[i] = std::min(MAX_BLOCK_SIZE, memoryProperties.memoryHeaps[i].size / 8);
+		heapBlockBytes[i] = 0;
+		heapAllocationBytes[i] = 0;
+	}
+	for (uint32_t i = 0; i < CATEGORY_COUNT; i++) {
+		categories[i] = {};
+	}
+
+	LOG_INFO("Memory budget: ", getMemoryProperties2 ? "VK_EXT_memory_budget" : "fixed share of the heaps");
+}
+
+void VulkanAllocator::cleanup() {
+	for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+		for (Pool& pool : pools[type]) {
+			for (Block& block : pool.blocks) {
+				if (block.memory != VK_NULL_HANDLE) {
+					if (block.allocationCount > 0) {
+						LOG_WARNING("Memory block freed with ", block.allocationCount, " live allocations");
+					}
+					freeMemory(type, block.memory, block.size, block.mapped);
+				}
+			}
+			pool.blocks.clear();
+		}
+	}
+}
+
+uint32_t VulkanAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		// CHECK IF REQUIRED MEMORY TYPE IS ALLOWED AND THE PROPERTIES ARE STATISFIED
+		if ((typeFilter & (1 << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	// NO MATCHING AVAILABLE MEMORY TYPE FOUND
+	return UINT32_MAX;
+}
+
+bool VulkanAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, Category category, VulkanAllocation* allocation) {
+	uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+	if (memoryType == UINT32_MAX) {
+		LOG_ERROR("No memory type for ", getCategoryName(category));
+		return false;
+	}
+	uint32_t heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+	VkDeviceSize blockSize = blockSizes[heap];
+
+	*allocation = {};
+	allocation->memoryType = memoryType;
+	allocation->size = requirements.size;
+	allocation->linear = linear;
+	allocation->category = uint8_t(category);
+
+	if (requirements.size > blockSize / 2) {
+		// DEDICATED
+		checkBudget(heap, requirements.size);
+		if (!allocateMemory(memoryType, requirements.size, &allocation->memory, &allocation->mapped)) {
+			return false;
+		}
+		allocation->block = DEDICATED_BLOCK;
+		dedicatedCount++;
+	}
+	else {
+		// SUB-ALLOCATE, FIRST BLOCK THAT FITS
+		Pool& pool = pools[memoryType][linear ? 1 : 0];
+		uint32_t blockIndex = UINT32_MAX;
+		uint32_t freeSlot = UINT32_MAX;
+		for (uint32_t i = 0; i < pool.blocks.size() && blockIndex == UINT32_MAX; i++) {
+			Block& block = pool.blocks[i];
+			if (block.memory == VK_NULL_HANDLE) {
+				freeSlot = std::min(freeSlot, i);
+			}
+			else if (allocateFromBlock(block, requirements.size, requirements.alignment, &allocation->offset)) {
+				blockIndex = i;
+			}
+		}
+
+		if (blockIndex == UINT32_MAX) {
+			Block block = {};
+			block.size = blockSize;
+			checkBudget(heap, blockSize);
+			if (!allocateMemory(memoryType, blockSize, &block.memory, &block.mapped)) {
+				return false;
+			}
+			block.freeRanges[0] = blockSize;
+
+			if (freeSlot == UINT32_MAX) {
+				freeSlot = uint32_t(pool.blocks.size());
+				pool.blocks.push_back(block);
+			}
+			else {
+				pool.blocks[freeSlot] = block;
+			}
+			blockIndex = freeSlot;
+			allocateFromBlock(pool.blocks[blockIndex], requirements.size, requirements.alignment, &allocation->offset);
+		}
+
+		Block& block = pool.blocks[blockIndex];
+		block.usedBytes += requirements.size;
+		block.allocationCount++;
+		allocation->block = blockIndex;
+		allocation->memory = block.memory;
+		if (block.mapped) {
+			allocation->mapped = (uint8_t*)block.mapped + allocation->offset;
+		}
+	}
+
+	heapAllocationBytes[heap] += requirements.size;
+	categories[category].bytes += requirements.size;
+	categories[category].allocationCount++;
+	return true;
+}
+
+void VulkanAllocator::free(VulkanAllocation* allocation) {
+	if (allocation->memory == VK_NULL_HANDLE) {
+		return;
+	}
+	uint32_t heap = memoryProperties.memoryTypes[allocation->memoryType].heapIndex;
+	heapAllocationBytes[heap] -= allocation->size;
+	categories[allocation->category].bytes -= allocation->size;
+	categories[allocation->category].allocationCount--;
+
+	if (allocation->block == DEDICATED_BLOCK) {
+		freeMemory(allocation->memoryType, allocation->memory, allocation->size, allocation->mapped);
+		dedicatedCount--;
+		*allocation = {};
+		return;
+	}
+
+	Pool& pool = pools[allocation->memoryType][allocation->linear ? 1 : 0];
+	Block& block = pool.blocks[allocation->block];
+	block.usedBytes -= allocation->size;
+	block.allocationCount--;
+
+	// Give the range back and merge it with the free neighbors
+	VkDeviceSize offset = allocation->offset;
+	VkDeviceSize size = allocation->size;
+	auto next = block.freeRanges.lower_bound(offset);
+	if (next != block.freeRanges.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			block.freeRanges.erase(previous);
+		}
+	}
+	if (next != block.freeRanges.end() && offset + size == next->first) {
+		size += next->second;
+		block.freeRanges.erase(next);
+	}
+	block.freeRanges[offset] = size;
+
+	// Keep one empty block per pool around, chunk meshes come and go all the time
+	if (block.allocationCount == 0) {
+		bool otherEmpty = false;
+		for (const Block& other : pool.blocks) {
+			otherEmpty |= &other != &block && other.memory != VK_NULL_HANDLE && other.allocationCount == 0;
+		}
+		if (otherEmpty) {
+			freeMemory(allocation->memoryType, block.memory, block.size, block.mapped);
+			block = {};
+		}
+	}
+
+	*allocation = {};
+}
+
+bool VulkanAllocator::allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+	if (block.size - block.usedBytes < size) {
+		return false;
+	}
+
+	// BEST FIT
+	auto best = block.freeRanges.end();
+	VkDeviceSize bestWaste = 0;
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+		VkDeviceSize alignedOffset = alignUp(it->first, alignment);
+		if (alignedOffset + size > it->first + it->second) {
+			continue;
+		}
+		VkDeviceSize waste = it->second - size;
+		if (best == block.freeRanges.end() || waste < bestWaste) {
+			best = it;
+			bestWaste = waste;
+			if (waste == 0) {
+				break;
+			}
+		}
+	}
+	if (best == block.freeRanges.end()) {
+		return false;
+	}
+
+	// SPLIT, the alignment padding stays free and merges back once the allocation is freed
+	VkDeviceSize rangeOffset = best->first;
+	VkDeviceSize rangeEnd = best->first + best->second;
+	VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+	block.freeRanges.erase(best);
+	if (alignedOffset > rangeOffset) {
+		block.freeRanges[rangeOffset] = alignedOffset - rangeOffset;
+	}
+	if (alignedOffset + size < rangeEnd) {
+		block.freeRanges[alignedOffset + size] = rangeEnd - (alignedOffset + size);
+	}
+	*offset = alignedOffset;
+	return true;
+}
+
+bool VulkanAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory* memory, void** mapped) {
+	VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryType;
+	if (vkAllocateMemory(device, &allocateInfo, 0, memory) != VK_SUCCESS) {
+		LOG_ERROR("Failed to allocate ", size, " bytes of device memory");
+		*memory = VK_NULL_HANDLE;
+		return false;
+	}
+
+	// Mapped once for its whole lifetime, sub-allocations can't map the shared memory themselves
+	*mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		vkMapMemory(device, *memory, 0, VK_WHOLE_SIZE, 0, mapped);
+	}
+
+	heapBlockBytes[memoryProperties.memoryTypes[memoryType].heapIndex] += size;
+	return true;
+}
+
+void VulkanAllocator::freeMemory(uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, void* mapped) {
+	if (mapped) {
+		vkUnmapMemory(device, memory);
+	}
+	vkFreeMemory(device, memory, 0);
+	heapBlockBytes[memoryProperties.memoryTypes[memoryType].heapIndex] -= size;
+}
+
+void VulkanAllocator::getHeapBudgets(VkDeviceSize* budgets, VkDeviceSize* usages) {
+	if (getMemoryProperties2) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+		VkPhysicalDeviceMemoryProperties2KHR properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR };
+		properties.pNext = &budgetProperties;
+		getMemoryProperties2(physicalDevice, &properties);
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+			budgets[i] = budgetProperties.heapBudget[i];
+			usages[i] = budgetProperties.heapUsage[i];
+		}
+		return;
+	}
+
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+		budgets[i] = memoryProperties.memoryHeaps[i].size * FALLBACK_BUDGET_PERCENT / 100;
+		usages[i] = heapBlockBytes[i];
+	}
+}
+
+void VulkanAllocator::checkBudget(uint32_t heap, VkDeviceSize size) {
+	if (budgetWarned) {
+		return;
+	}
+	VkDeviceSize budgets[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize usages[VK_MAX_MEMORY_HEAPS];
+	getHeapBudgets(budgets, usages);
+	if (usages[heap] + size > budgets[heap]) {
+		LOG_WARNING("Heap ", heap, " is over its memory budget (", usages[heap] + size, " of ", budgets[heap], " bytes)");
+		logStatistics();
+		budgetWarned = true;
+	}
+}
+
+VulkanAllocator::Statistics VulkanAllocator::getStatistics() {
+	Statistics statistics = {};
+	for (uint32_t i = 0; i < CATEGORY_COUNT; i++) {
+		statistics.categories[i] = categories[i];
+	}
+
+	VkDeviceSize budgets[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize usages[VK_MAX_MEMORY_HEAPS];
+	getHeapBudgets(budgets, usages);
+	statistics.heapCount = memoryProperties.memoryHeapCount;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+		HeapStatistics& heap = statistics.heaps[i];
+		heap.size = memoryProperties.memoryHeaps[i].size;
+		heap.budget = budgets[i];
+		heap.usage = usages[i];
+		heap.blockBytes = heapBlockBytes[i];
+		heap.allocationBytes = heapAllocationBytes[i];
+	}
+
+	for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+		for (const Pool& pool : pools[type]) {
+			for (const Block& block : pool.blocks) {
+				statistics.blockCount += block.memory != VK_NULL_HANDLE ? 1 : 0;
+			}
+		}
+	}
+	statistics.dedicatedCount = dedicatedCount;
+	statistics.driverBudget = getMemoryProperties2 != nullptr;
+	return statistics;
+}
+
+void VulkanAllocator::logStatistics() {
+	Statistics statistics = getStatistics();
+	LOG_INFO("GPU memory: ", statistics.blockCount, " blocks, ", statistics.dedicatedCount, " dedicated allocations");
+	for (uint32_t i = 0; i < statistics.heapCount; i++) {
+		const HeapStatistics& heap = statistics.heaps[i];
+		LOG_INFO("Heap ", i, ": ", heap.allocationBytes, " bytes used of ", heap.blockBytes, " allocated | usage ", heap.usage,
+			" of budget ", heap.budget, " (size ", heap.size, ")");
+	}
+	for (uint32_t i = 0; i < CATEGORY_COUNT; i++) {
+		LOG_INFO(getCategoryName(Category(i)), ": ", statistics.categories[i].bytes, " bytes in ", statistics.categories[i].allocationCount, " allocations");
+	}
+}
+
+const char* VulkanAllocator::getCategoryName(Category category) {
+	switch (category) {
+	case CATEGORY_CHUNK_MESH: return "Chunk meshes";
+	case CATEGORY_UNIFORM: return "Uniform buffers";
+	case CATEGORY_TEXTURE: return "Textures";
+	case CATEGORY_RENDER_TARGET: return "Render targets";
+	case CATEGORY_STAGING: return "Staging buffers";
+	case CATEGORY_FAR_TERRAIN: return "Far terrain";
+	default: return "Unknown";
+	}
+}
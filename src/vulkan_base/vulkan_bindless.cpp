@@ -0,0 +1,234 @@
+#include "../vulkan_base.h"
+#include "../game_engine/texturepack.h"
+#include <stb/stb_image.h>
+#include <cstring>
+
+// CHECK FOR DESCRIPTOR INDEXING, ADDS THE DEVICE EXTENSIONS IT NEEDS BEFORE 1.2
+bool Vulkan::checkDescriptorIndexing(const char** deviceExtensions, uint32_t& deviceExtensionCount) {
+	bindlessTextures = false;
+	descriptorIndexingFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+	if (!settings.bindless) {
+		LOG_INFO("Bindless textures are disabled");
+		return false;
+	}
+
+	// Core in 1.2, otherwise the extension (which needs maintenance3) and the properties2 queries
+	bool core = instanceApiVersion >= VK_API_VERSION_1_2 && context->physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2;
+	if (!core) {
+		if (!physicalDeviceProperties2) {
+			LOG_INFO("No descriptor indexing (needs Vulkan 1.2 or VK_KHR_get_physical_device_properties2), using the texture array");
+			return false;
+		}
+		uint32_t extensionPropertyCount = 0;
+		VKA(vkEnumerateDeviceExtensionProperties(context->physicalDevice, 0, &extensionPropertyCount, 0));
+		std::vector<VkExtensionProperties> extensionProperties(extensionPropertyCount);
+		VKA(vkEnumerateDeviceExtensionProperties(context->physicalDevice, 0, &extensionPropertyCount, extensionProperties.data()));
+		bool descriptorIndexing = false;
+		bool maintenance3 = false;
+		for (const VkExtensionProperties& extension : extensionProperties) {
+			if (strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0) {
+				descriptorIndexing = true;
+			}
+			else if (strcmp(extension.extensionName, VK_KHR_MAINTENANCE3_EXTENSION_NAME) == 0) {
+				maintenance3 = true;
+			}
+		}
+		if (!descriptorIndexing || !maintenance3) {
+			LOG_INFO("No descriptor indexing on this device, using the texture array");
+			return false;
+		}
+	}
+
+	PFN_vkGetPhysicalDeviceFeatures2 pfnGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(context->instance,
+		core ? "vkGetPhysicalDeviceFeatures2" : "vkGetPhysicalDeviceFeatures2KHR");
+	PFN_vkGetPhysicalDeviceProperties2 pfnGetPhysicalDeviceProperties2 = (PFN_vkGetPhysicalDeviceProperties2)vkGetInstanceProcAddr(context->instance,
+		core ? "vkGetPhysicalDeviceProperties2" : "vkGetPhysicalDeviceProperties2KHR");
+	if (!pfnGetPhysicalDeviceFeatures2 || !pfnGetPhysicalDeviceProperties2) {
+		LOG_WARNING("Could not load the properties2 queries, using the texture array");
+		return false;
+	}
+
+	// FEATURES THE TEXTURE TABLE NEEDS
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+	VkPhysicalDeviceFeatures2 features2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	features2.pNext = &supportedFeatures;
+	pfnGetPhysicalDeviceFeatures2(context->physicalDevice, &features2);
+	if (!supportedFeatures.shaderSampledImageArrayNonUniformIndexing || !supportedFeatures.runtimeDescriptorArray
+		|| !supportedFeatures.descriptorBindingPartiallyBound || !supportedFeatures.descriptorBindingSampledImageUpdateAfterBind
+		|| !supportedFeatures.descriptorBindingUpdateUnusedWhilePending) {
+		LOG_INFO("The device lacks descriptor indexing features for bindless textures, using the texture array");
+		return false;
+	}
+
+	// TABLE SIZE, WITHIN THE UPDATE AFTER BIND LIMITS
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT };
+	VkPhysicalDeviceProperties2 properties2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	properties2.pNext = &indexingProperties;
+	pfnGetPhysicalDeviceProperties2(context->physicalDevice, &properties2);
+	bindlessTextureCapacity = std::min({ MAX_BINDLESS_TEXTURES,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+	if (bindlessTextureCapacity == 0) {
+		LOG_INFO("No update after bind textures on this device, using the texture array");
+		return false;
+	}
+
+	if (!core) {
+		deviceExtensions[deviceExtensionCount++] = VK_KHR_MAINTENANCE3_EXTENSION_NAME;
+		deviceExtensions[deviceExtensionCount++] = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+	}
+
+	// Enable only what is used, chained into the device create info
+	descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	bindlessTextures = true;
+	LOG_INFO("Bindless textures (", core ? "Vulkan 1.2" : "VK_EXT_descriptor_indexing", "), table of ", bindlessTextureCapacity, " textures");
+	return true;
+}
+
+// CREATE THE TEXTURE TABLE AND ENTER THE BLOCK TEXTURES
+void Vulkan::createTextureTable() {
+	chunkSetLayouts[0] = descriptorSetLayout;
+	chunkSetLayoutCount = 1;
+	if (!bindlessTextures) {
+		return;
+	}
+
+	// SET LAYOUT, ONE ARRAY OF bindlessTextureCapacity ENTRIES, PARTIALLY BOUND AND WRITTEN WHILE IT IS BOUND
+	{
+		VkDescriptorSetLayoutBinding binding = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindlessTextureCapacity, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+		VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+			| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT };
+		bindingFlagsInfo.bindingCount = 1;
+		bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		createInfo.pNext = &bindingFlagsInfo;
+		createInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+		createInfo.bindingCount = 1;
+		createInfo.pBindings = &binding;
+		VKA(vkCreateDescriptorSetLayout(context->device, &createInfo, 0, &textureTableLayout));
+	}
+
+	// OWN POOL, UPDATE AFTER BIND SETS CAN NOT COME FROM THE REGULAR ONE
+	{
+		VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindlessTextureCapacity };
+		VkDescriptorPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		createInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+		createInfo.maxSets = 1;
+		createInfo.poolSizeCount = 1;
+		createInfo.pPoolSizes = &poolSize;
+		VKA(vkCreateDescriptorPool(context->device, &createInfo, 0, &textureTablePool));
+
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = textureTablePool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &textureTableLayout;
+		VKA(vkAllocateDescriptorSets(context->device, &allocateInfo, &textureTable));
+	}
+
+	// ONE ENTRY PER BLOCK TEXTURE, A VIEW OF ITS LAYER IN THE TEXTURE ARRAY
+	textureCount = 0;
+	uint32_t layerCount = std::min(textureArray.layerCount, bindlessTextureCapacity);
+	textureLayerViews.resize(layerCount);
+	for (uint32_t layer = 0; layer < layerCount; layer++) {
+		VkImageViewCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		createInfo.image = textureArray.image.image;
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		createInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		createInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, textureArray.mipLevels, layer, 1 };
+		VKA(vkCreateImageView(context->device, &createInfo, 0, &textureLayerViews[layer]));
+		writeTextureTableEntry(textureCount++, textureLayerViews[layer]);
+	}
+
+	chunkSetLayouts[1] = textureTableLayout;
+	chunkSetLayoutCount = 2;
+}
+
+void Vulkan::writeTextureTableEntry(uint32_t index, VkImageView view) {
+	VkDescriptorImageInfo imageInfo = { sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet descriptorWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	descriptorWrite.dstSet = textureTable;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = index;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.pImageInfo = &imageInfo;
+	VK(vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0, nullptr));
+}
+
+void Vulkan::bindTextureTable(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) {
+	if (!bindlessTextures) {
+		return;
+	}
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureTable, 0, nullptr);
+}
+
+// LOAD A TEXTURE AND WRITE IT INTO THE NEXT FREE ENTRY, NOTHING ELSE IS REBUILT
+uint32_t Vulkan::registerTexture(const char* path) {
+	if (!bindlessTextures) {
+		LOG_WARNING("Textures can only be registered at runtime with bindless textures: ", path);
+		return 0;
+	}
+	if (textureCount >= bindlessTextureCapacity) {
+		LOG_WARNING("The texture table is full, could not register ", path);
+		return 0;
+	}
+
+	int width = 0, height = 0, channels = 0;
+	stbi_uc* pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		LOG_WARNING("Could not load the texture ", path);
+		return 0;
+	}
+	uint32_t mipLevels = TexturePack::getMipLevelCount(uint32_t(width), uint32_t(height));
+
+	// Level 0 is uploaded, the rest of the chain is blitted
+	VulkanImage image;
+	createImage(&image, uint32_t(width), uint32_t(height), VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 1, mipLevels);
+	TextureArray uploadInfo = {};
+	uploadInfo.image = image;
+	uploadInfo.data = pixels;
+	uploadInfo.size = size_t(width) * height * 4;
+	uploadInfo.width = uint32_t(width);
+	uploadInfo.height = uint32_t(height);
+	uploadInfo.layerCount = 1;
+	uploadInfo.mipLevels = mipLevels;
+	uploadInfo.uploadedLevels = 1;
+	uploadInfo.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	uploadInfo.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	uploadDataToImage(uploadInfo);
+	stbi_image_free(pixels);
+
+	registeredTextures.push_back(image);
+	writeTextureTableEntry(textureCount++, image.view);
+	LOG_INFO("Registered texture ", path, " as texture ", textureCount);
+	return textureCount; // Texture indices start at 1
+}
+
+void Vulkan::cleanupTextureTable() {
+	for (VkImageView view : textureLayerViews) {
+		VK(vkDestroyImageView(context->device, view, 0));
+	}
+	textureLayerViews.clear();
+	for (VulkanImage& image : registeredTextures) {
+		cleanupImage(&image);
+	}
+	registeredTextures.clear();
+	textureCount = 0;
+
+	if (textureTablePool) {
+		VK(vkDestroyDescriptorPool(context->device, textureTablePool, 0));
+		textureTablePool = VK_NULL_HANDLE;
+		textureTable = VK_NULL_HANDLE;
+	}
+	if (textureTableLayout) {
+		VK(vkDestroyDescriptorSetLayout(context->device, textureTableLayout, 0));
+		textureTableLayout = VK_NULL_HANDLE;
+	}
+}
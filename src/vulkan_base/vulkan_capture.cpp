@@ -0,0 +1,109 @@
+#include "../vulkan_base.h"
+
+void Vulkan::requestCapture(const std::string& path, const std::string& goldenPath) {
+	captureRequested = true;
+	capturePath = path;
+	captureGoldenPath = goldenPath;
+}
+
+// COPY THE RENDERED IMAGE INTO THE READBACK BUFFER OF THIS FRAME INDEX
+void Vulkan::recordCapture(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex) {
+	captureRequested = false;
+	CaptureSlot& slot = captureSlots[frameIndex];
+
+	if (!swapchain.transferSource) {
+		LOG_WARNING("The surface does not allow copies of its images, no capture");
+		return;
+	}
+	bool bgra = false;
+	switch (swapchain.format) {
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		bgra = true;
+		break;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		break;
+	default:
+		LOG_WARNING("Captures of swapchain format ", swapchain.format, " are not supported");
+		return;
+	}
+
+	// GROWS WITH THE WINDOW, CACHED MEMORY IS FASTER TO READ FROM IF THERE IS ANY
+	VkDeviceSize size = VkDeviceSize(swapchain.width) * swapchain.height * 4;
+	if (slot.size < size) {
+		if (slot.size > 0) {
+			cleanupBuffer(&slot.buffer.buffer, &slot.buffer.allocation);
+		}
+		VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		if (allocator.findMemoryType(UINT32_MAX, memoryProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != UINT32_MAX) {
+			memoryProperties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
+		createBuffer(&slot.buffer.buffer, &slot.buffer.allocation, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties, VulkanAllocator::CATEGORY_STAGING);
+		slot.size = size;
+	}
+
+	// THE RENDER PASS LEFT THE IMAGE READY TO PRESENT (HEADLESS: READY TO COPY)
+	VkImageLayout finalLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = finalLayout;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = swapchain.images[imageIndex];
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { swapchain.width, swapchain.height, 1 };
+	vkCmdCopyImageToBuffer(commandBuffer, swapchain.images[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &region);
+
+	// BACK FOR THE PRESENT, THE HOST READS THE BUFFER AFTER THE FENCE
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = finalLayout;
+	VkBufferMemoryBarrier bufferBarrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = slot.buffer.buffer;
+	bufferBarrier.size = size;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+		0, 0, 1, &bufferBarrier, 1, &barrier);
+
+	slot.pending = true;
+	slot.frame.path = capturePath;
+	slot.frame.goldenPath = captureGoldenPath;
+	slot.frame.width = swapchain.width;
+	slot.frame.height = swapchain.height;
+	slot.frame.bgra = bgra;
+}
+
+// HAND A FINISHED COPY TO THE FRAME WRITER (THE FENCE OF THIS FRAME INDEX WAS WAITED ON)
+void Vulkan::collectCapture(uint32_t frameIndex) {
+	CaptureSlot& slot = captureSlots[frameIndex];
+	if (!slot.pending) {
+		return;
+	}
+	slot.pending = false;
+
+	const uint8_t* pixels = (const uint8_t*)slot.buffer.allocation.mapped;
+	FrameWriter::Frame frame = slot.frame;
+	frame.pixels.assign(pixels, pixels + size_t(frame.width) * frame.height * 4);
+	frameWriter.write(std::move(frame));
+}
+
+void Vulkan::cleanupCaptures() {
+	for (CaptureSlot& slot : captureSlots) {
+		if (slot.size > 0) {
+			cleanupBuffer(&slot.buffer.buffer, &slot.buffer.allocation);
+			slot.size = 0;
+		}
+		slot.pending = false;
+	}
+}
@@ -1,7 +1,14 @@
 #include "../vulkan_base.h"
+#include "../game_engine/texturepack.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+namespace {
+
+const char* textureCachePath = "../cache/textures.bin";
+
+}
+
 void Vulkan::createSampler() {
 
 	VkSamplerCreateInfo createInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
@@ -22,63 +29,60 @@ void Vulkan::createSampler() {
 }
 
 void Vulkan::createTextureArray() {
-	int width = 0, height = 0, channels = 0;
-	uint8_t* data = nullptr;
-
-	uint32_t layerCount = paths.size();  // Each path represents a texture, so each texture is a layer
-
-	// Load the first image to get the width, height, and channels
-	data = stbi_load(paths[0], &width, &height, &channels, 4);  // Load as RGBA
-	if (!data) {
-		LOG_ERROR("Could not load image data for the first texture!");
+	// Decoded textures with their mip chains, mapped from the cache when it is up to date
+	TexturePack texturePack;
+	if (!texturePack.load(paths, textureCachePath)) {
+		LOG_ERROR("Could not load the block textures!");
 		return;
 	}
-	stbi_image_free(data);  // Free the temporary data, we just wanted the size
-
-	// Create the texture array image (with the correct number of layers)
-	textureArray.images.resize(layerCount);
-	for (int i = 0; i < layerCount; i++) {
-		textureArray.images[i] = new VulkanImage;
-		createImage(textureArray.images[i], width, height, VK_FORMAT_R8G8B8A8_UNORM,
-			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, layerCount);
-	}
-	
-
-	// Loop through each image and upload it as a layer in the array
+	uint32_t width = texturePack.getWidth();
+	uint32_t height = texturePack.getHeight();
+	uint32_t layerCount = texturePack.getLayerCount();  // Each path represents a texture, so each texture is a layer
+	uint32_t mipLevels = texturePack.getMipLevels();
+	LOG_INFO("Loaded ", layerCount, " textures ", texturePack.isFromCache() ? "from the cache" : "from the texture files");
+
+	// One image, every texture is a layer of it
+	createImage(&textureArray.image, width, height, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, layerCount, mipLevels);
+
+	// Upload all layers and levels in one submission
+	textureArray.data = texturePack.getData();
+	textureArray.size = texturePack.getSize();
+	textureArray.width = width;
+	textureArray.height = height;
+	textureArray.layerCount = layerCount;
+	textureArray.mipLevels = mipLevels;
+	textureArray.uploadedLevels = mipLevels;
+	textureArray.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	textureArray.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	uploadDataToImage(textureArray);
+	textureArray.data = nullptr;
+
+	mipmapLevels = float(mipLevels);
+
+	// Average colors stand in for the textures on the far terrain
+	std::vector<glm::vec3> averageColors(layerCount, glm::vec3(0.5f));
+	size_t layerSize = size_t(width) * height * 4;
 	for (uint32_t layer = 0; layer < layerCount; ++layer) {
-		// Load the image data for this layer
-		data = stbi_load(paths[layer], &width, &height, &channels, 4);
-		if (!data) {
-			LOG_ERROR("Could not load image data for layer ", layer);
-			continue;
+		const uint8_t* data = texturePack.getData() + layerSize * layer;
+		glm::vec3 colorSum(0.0f);
+		for (uint32_t pixel = 0; pixel < width * height; pixel++) {
+			colorSum += glm::vec3(data[pixel * 4], data[pixel * 4 + 1], data[pixel * 4 + 2]);
 		}
-
-		// Prepare the upload info for this layer
-		textureArray.data = data;
-		textureArray.size = width * height * 4;  // Each pixel is 4 bytes (RGBA)
-		textureArray.width = width;
-		textureArray.height = height;
-		textureArray.layerCount = layerCount;  // Total layers in the array
-		textureArray.arrayLayer = layer;  // Upload to the current layer
-		textureArray.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-		textureArray.dstAccessMask = VK_ACCESS_SHADER_READ_BIT; //VK_ACCESS_SHADER_READ_BIT //VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-
-		// Upload the data for this layer
-		uploadDataToImage(textureArray);
-
-		// Free the loaded image data for this layer
-		stbi_image_free(data);
+		averageColors[layer] = colorSum / (255.0f * width * height);
 	}
+
+	farTerrain.setTextureColors(averageColors);
 }
 
 void Vulkan::createDescriptorPool() {
 	VkDescriptorPoolSize poolSizes[] = {
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, FRAMES_IN_FLIGHT * 1000},
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, FRAMES_IN_FLIGHT * 1000}
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MAX_FRAMES_IN_FLIGHT * 1000},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_FRAMES_IN_FLIGHT * 1000}
 	};
 
 	VkDescriptorPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-	createInfo.maxSets = FRAMES_IN_FLIGHT * 1000;
+	createInfo.maxSets = MAX_FRAMES_IN_FLIGHT * 1000;
 	createInfo.poolSizeCount = ARRAY_COUNT(poolSizes);
 	createInfo.pPoolSizes = poolSizes;
 	VKA(vkCreateDescriptorPool(context->device, &createInfo, nullptr, &descriptorPool));
@@ -89,9 +93,10 @@ void Vulkan::createUniformBuffers() {
 	uint64_t minUniformAlignment = context->physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
 	maxUniformSize = context->physicalDeviceProperties.limits.maxUniformBufferRange;
 	singleElementSize = ALIGN_UP_POW2(sizeof(UniformBufferObject), minUniformAlignment);
-	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		for (uint32_t j = 0; j < UNIFORM_BUFFER_COUNT; j++) {
-			createBuffer(&uniformBuffers[j][i].buffer, &uniformBuffers[j][i].memory, maxUniformSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			createBuffer(&uniformBuffers[j][i].buffer, &uniformBuffers[j][i].allocation, maxUniformSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VulkanAllocator::CATEGORY_UNIFORM);
 		}
 		
 	}
@@ -101,15 +106,16 @@ void Vulkan::createDescriptorSets() {
 
 	VkDescriptorSetLayoutBinding bindings[] = {
 			{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr},
-			{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureArray.layerCount, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // &sampler
+			{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}, // &sampler
 	};
 
+	// Bindless: the textures are in the texture table (set 1), set 0 only holds the uniform buffer
 	VkDescriptorSetLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-	createInfo.bindingCount = ARRAY_COUNT(bindings);
+	createInfo.bindingCount = bindlessTextures ? 1 : ARRAY_COUNT(bindings);
 	createInfo.pBindings = bindings;
 	VKA(vkCreateDescriptorSetLayout(context->device, &createInfo, 0, &descriptorSetLayout));
 	// BUFFER INFO
-	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		for (uint32_t j = 0; j < UNIFORM_BUFFER_COUNT; j++) {
 			VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
 			allocateInfo.descriptorPool = descriptorPool;
@@ -119,10 +125,7 @@ void Vulkan::createDescriptorSets() {
 
 			VkDescriptorBufferInfo bufferInfo = { uniformBuffers[j][i].buffer, 0, singleElementSize };
 
-			std::vector<VkDescriptorImageInfo> imageInfos(textureArray.layerCount);
-			for (uint32_t i = 0; i < textureArray.layerCount; i++) {
-				imageInfos[i] = { sampler, textureArray.images[i]->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-			}
+			VkDescriptorImageInfo imageInfo = { sampler, textureArray.image.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
 
 			VkWriteDescriptorSet descriptorWrites[2];
 
@@ -137,10 +140,10 @@ void Vulkan::createDescriptorSets() {
 			descriptorWrites[1].dstSet = descriptorSets[j][i];
 			descriptorWrites[1].dstBinding = 1;
 			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorCount = textureArray.layerCount; //1
+			descriptorWrites[1].descriptorCount = 1;
 			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].pImageInfo = imageInfos.data();
-			VK(vkUpdateDescriptorSets(context->device, ARRAY_COUNT(descriptorWrites), descriptorWrites, 0, nullptr));
+			descriptorWrites[1].pImageInfo = &imageInfo;
+			VK(vkUpdateDescriptorSets(context->device, bindlessTextures ? 1 : ARRAY_COUNT(descriptorWrites), descriptorWrites, 0, nullptr));
 		}
 	}
 }
@@ -172,6 +175,18 @@ void Vulkan::createVextexInputAttributes() {
 	vertexAttributeDescriptions[3].format = VK_FORMAT_R32_SINT;
 	vertexAttributeDescriptions[3].offset = offsetof(Vertex, texIndex);
 
+	// LIGHT ATTRIBUTE
+	vertexAttributeDescriptions[4].binding = 0;
+	vertexAttributeDescriptions[4].location = 4;
+	vertexAttributeDescriptions[4].format = VK_FORMAT_R32G32_SFLOAT;
+	vertexAttributeDescriptions[4].offset = offsetof(Vertex, light);
+
+	// AMBIENT OCCLUSION ATTRIBUTE
+	vertexAttributeDescriptions[5].binding = 0;
+	vertexAttributeDescriptions[5].location = 5;
+	vertexAttributeDescriptions[5].format = VK_FORMAT_R32_SFLOAT;
+	vertexAttributeDescriptions[5].offset = offsetof(Vertex, ao);
+
 	// BINDING DESCRIPTION
 	vertexInputBinding.binding = 0;
 	vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
@@ -182,14 +197,14 @@ void Vulkan::createVextexInputAttributes() {
 void Vulkan::createFencesAndSemaphores() {
 
 	// CREATE FENCES
-	for (uint32_t i = 0; i < ARRAY_COUNT(fences); i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		VkFenceCreateInfo createInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
 		createInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 		VKA(vkCreateFence(context->device, &createInfo, 0, &fences[i]));
 	}
 
 	// SEMAPHORES FOR SYNCHRONISATION (GPU -> GPU)
-	for (uint32_t i = 0; i < ARRAY_COUNT(acquireSemaphores); i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 		VKA(vkCreateSemaphore(context->device, &createInfo, 0, &acquireSemaphores[i]));
 		VKA(vkCreateSemaphore(context->device, &createInfo, 0, &releaseSemaphores[i]));
@@ -200,7 +215,7 @@ void Vulkan::createFencesAndSemaphores() {
 
 void Vulkan::createAndAllocateCommands() {
 	// CREATE COMMAN POOLS
-	for (uint32_t i = 0; i < ARRAY_COUNT(commandPools); i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		VkCommandPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
 		createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 		createInfo.queueFamilyIndex = context->graphicsQueue.familyIndex;
@@ -208,7 +223,7 @@ void Vulkan::createAndAllocateCommands() {
 	}
 
 	// ALLOCATE COMMAND BUFFERS
-	for (uint32_t i = 0; i < ARRAY_COUNT(commandPools); i++) {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
 		VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
 		allocateInfo.commandPool = commandPools[i];
 		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
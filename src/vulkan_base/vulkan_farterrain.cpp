@@ -0,0 +1,95 @@
+#include "../vulkan_base.h"
+#include <cstring>
+
+void Vulkan::createFarTerrain() {
+
+	// ATTRIBUTES
+	// POSITION ATTRIBUTE
+	farTerrainAttributeDescriptions[0].binding = 0;
+	farTerrainAttributeDescriptions[0].location = 0;
+	farTerrainAttributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	farTerrainAttributeDescriptions[0].offset = offsetof(FarTerrain::FarVertex, position);
+
+	// NORMAL ATTRIBUTE
+	farTerrainAttributeDescriptions[1].binding = 0;
+	farTerrainAttributeDescriptions[1].location = 1;
+	farTerrainAttributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	farTerrainAttributeDescriptions[1].offset = offsetof(FarTerrain::FarVertex, normal);
+
+	// COLOR ATTRIBUTE
+	farTerrainAttributeDescriptions[2].binding = 0;
+	farTerrainAttributeDescriptions[2].location = 2;
+	farTerrainAttributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
+	farTerrainAttributeDescriptions[2].offset = offsetof(FarTerrain::FarVertex, color);
+
+	// BINDING DESCRIPTION
+	farTerrainInputBinding.binding = 0;
+	farTerrainInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	farTerrainInputBinding.stride = sizeof(FarTerrain::FarVertex);
+
+	// PIPELINE (no descriptors, the camera comes in as push constants)
+	farTerrainPushConstantRange = { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(FarTerrainPushConstants) };
+	queuePipeline(&farTerrainPipeline, "../shaders/farterrain_vert.spv", "../shaders/farterrain_frag.spv", &farTerrainInputBinding,
+		farTerrainAttributeDescriptions, ARRAY_COUNT(farTerrainAttributeDescriptions), nullptr, 0, &farTerrainPushConstantRange, false);
+
+	// BUFFERS (sized for a full level without a hole)
+	VkDeviceSize vertexBufferSize = sizeof(FarTerrain::FarVertex) * FarTerrain::GRID_VERTICES * FarTerrain::GRID_VERTICES;
+	VkDeviceSize indexBufferSize = sizeof(uint32_t) * FarTerrain::GRID_CELLS * FarTerrain::GRID_CELLS * 6;
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		for (uint32_t level = 0; level < FarTerrain::LEVEL_COUNT; level++) {
+			FarTerrainBuffers& buffers = farTerrainBuffers[i][level];
+			createBuffer(&buffers.vertices.buffer, &buffers.vertices.allocation, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VulkanAllocator::CATEGORY_FAR_TERRAIN);
+			createBuffer(&buffers.indices.buffer, &buffers.indices.allocation, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VulkanAllocator::CATEGORY_FAR_TERRAIN);
+			buffers.indexCount = 0;
+			buffers.version = 0;
+		}
+	}
+}
+
+void Vulkan::renderFarTerrain(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, farTerrainPipeline.pipeline);
+
+	// Fades into the sky color towards the edge of the outermost level
+	FarTerrainPushConstants constants = {};
+	constants.viewProj = cameraManager.camera.viewProj;
+	constants.cameraPosition = glm::vec4(cameraManager.camera.cameraPosition, 1.0f);
+	constants.fog = glm::vec4(farTerrain.getRange() * 0.4f, farTerrain.getRange(), 0.0f, 0.0f);
+	vkCmdPushConstants(commandBuffer, farTerrainPipeline.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+	for (uint32_t i = 0; i < FarTerrain::LEVEL_COUNT; i++) {
+		const FarTerrain::Level& level = farTerrain.getLevel(i);
+		FarTerrainBuffers& buffers = farTerrainBuffers[frameIndex][i];
+
+		// The fence of this frame index was waited on, the GPU is done with these buffers
+		if (buffers.version != level.version) {
+			memcpy(buffers.vertices.allocation.mapped, level.vertices.data(), sizeof(FarTerrain::FarVertex) * level.vertices.size());
+			if (!level.indices.empty()) {
+				memcpy(buffers.indices.allocation.mapped, level.indices.data(), sizeof(uint32_t) * level.indices.size());
+			}
+
+			buffers.indexCount = level.indices.size();
+			buffers.version = level.version;
+		}
+
+		if (buffers.indexCount == 0) {
+			continue;
+		}
+
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffers.vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, buffers.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(commandBuffer, buffers.indexCount, 1, 0, 0, 0);
+	}
+}
+
+void Vulkan::cleanupFarTerrain() {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		for (uint32_t level = 0; level < FarTerrain::LEVEL_COUNT; level++) {
+			cleanupBuffer(&farTerrainBuffers[i][level].vertices.buffer, &farTerrainBuffers[i][level].vertices.allocation);
+			cleanupBuffer(&farTerrainBuffers[i][level].indices.buffer, &farTerrainBuffers[i][level].indices.allocation);
+		}
+	}
+	cleanupPipeline(&farTerrainPipeline);
+}
@@ -0,0 +1,370 @@
+#include "../vulkan_base.h"
+#include "../game_engine/chunkmesher.h"
+#include <cstring>
+
+namespace {
+
+// Same layout as the push constants of shaders/chunkmesh_comp.glsl
+struct GpuMeshPushConstants {
+	uint32_t inputOffset;
+	uint32_t counterOffset;
+	uint32_t rangeStarts[Chunk::MESH_RANGE_COUNT];
+};
+
+// One invocation per voxel, then one per border column for the skirts
+const uint32_t GPU_MESH_LOCAL_SIZE = 64;
+const uint32_t GPU_MESH_INVOCATIONS = CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z + 4 * CHUNK_SIZE_X;
+const uint32_t GPU_MESH_GROUPS = (GPU_MESH_INVOCATIONS + GPU_MESH_LOCAL_SIZE - 1) / GPU_MESH_LOCAL_SIZE;
+
+static_assert(sizeof(Vertex) == 12 * sizeof(uint32_t), "The shader writes vertices as 12 uints");
+static_assert(Chunk::MESH_RANGE_COUNT == 16 && CHUNK_SIZE_X == 16 && CHUNK_SIZE_Z == 16 && CHUNK_SIZE_Y == 64,
+	"The shader is written for 16x64x16 chunks and their mesh ranges");
+
+}
+
+// CREATE THE COMPUTE PIPELINES AND THE PER FRAME INPUT AND COUNTER BUFFERS
+void Vulkan::createGpuMesher() {
+	if (!settings.gpuMesher) {
+		return;
+	}
+
+	// Recorded into the frame's command buffer, so the graphics queue has to run compute too
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &queueFamilyCount, 0);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (!(queueFamilies[context->graphicsQueue.familyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+		LOG_WARNING("The graphics queue can't run compute shaders, chunks are meshed on the CPU");
+		return;
+	}
+
+	// DESCRIPTOR SET LAYOUTS, INPUT AND COUNTERS (COUNT PASS) PLUS VERTICES AND INDICES (EMIT PASS)
+	VkDescriptorSetLayoutBinding bindings[4] = {};
+	for (uint32_t i = 0; i < ARRAY_COUNT(bindings); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+	VKA(vkCreateDescriptorSetLayout(context->device, &layoutInfo, 0, &gpuMeshCountLayout));
+	layoutInfo.bindingCount = 4;
+	VKA(vkCreateDescriptorSetLayout(context->device, &layoutInfo, 0, &gpuMeshEmitLayout));
+
+	// PIPELINES
+	VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuMeshPushConstants) };
+	if (!createComputePipeline(&gpuMeshCountPipeline, "../shaders/chunkmesh_count_comp.spv", gpuMeshCountLayout, &pushConstantRange)
+		|| !createComputePipeline(&gpuMeshEmitPipeline, "../shaders/chunkmesh_emit_comp.spv", gpuMeshEmitLayout, &pushConstantRange)) {
+		LOG_WARNING("GPU mesher shaders are missing, chunks are meshed on the CPU");
+		cleanupGpuMesher();
+		return;
+	}
+
+	// DESCRIPTOR POOL, ONE COUNT SET AND AN EMIT SET PER JOB FOR EVERY FRAME IN FLIGHT
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, settings.framesInFlight * (2 + 4 * MAX_GPU_MESH_JOBS) };
+	VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.maxSets = settings.framesInFlight * (1 + MAX_GPU_MESH_JOBS);
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	VKA(vkCreateDescriptorPool(context->device, &poolInfo, 0, &gpuMeshPool));
+
+	// BUFFERS, THE HOST WRITES THE INPUTS AND READS THE COUNTERS
+	VkDeviceSize inputSize = VkDeviceSize(2) * MAX_GPU_MESH_JOBS * PaletteChunk::SIZE * sizeof(uint32_t);
+	VkDeviceSize counterSize = VkDeviceSize(2) * MAX_GPU_MESH_JOBS * Chunk::MESH_RANGE_COUNT * sizeof(uint32_t);
+	VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	VkMemoryPropertyFlags counterMemory = hostMemory;
+	if (allocator.findMemoryType(UINT32_MAX, hostMemory | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != UINT32_MAX) {
+		counterMemory |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	}
+
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		GpuMeshSlot& slot = gpuMeshSlots[i];
+		createBuffer(&slot.input.buffer, &slot.input.allocation, inputSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory,
+			VulkanAllocator::CATEGORY_STAGING);
+		createBuffer(&slot.counters.buffer, &slot.counters.allocation, counterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			counterMemory, VulkanAllocator::CATEGORY_STAGING);
+		slot.readback = {};
+		slot.readbackSize = 0;
+
+		VkDescriptorSetLayout setLayouts[1 + MAX_GPU_MESH_JOBS];
+		setLayouts[0] = gpuMeshCountLayout;
+		for (uint32_t job = 0; job < MAX_GPU_MESH_JOBS; job++) {
+			setLayouts[1 + job] = gpuMeshEmitLayout;
+		}
+		VkDescriptorSet sets[1 + MAX_GPU_MESH_JOBS];
+		VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = gpuMeshPool;
+		allocateInfo.descriptorSetCount = ARRAY_COUNT(setLayouts);
+		allocateInfo.pSetLayouts = setLayouts;
+		VKA(vkAllocateDescriptorSets(context->device, &allocateInfo, sets));
+		slot.countSet = sets[0];
+		std::copy_n(sets + 1, MAX_GPU_MESH_JOBS, slot.emitSets);
+
+		// Input and counters never change, the emit sets get the chunk buffers every frame
+		VkDescriptorBufferInfo bufferInfos[2] = {
+			{ slot.input.buffer, 0, VK_WHOLE_SIZE },
+			{ slot.counters.buffer, 0, VK_WHOLE_SIZE }
+		};
+		std::vector<VkWriteDescriptorSet> writes;
+		for (VkDescriptorSet set : sets) {
+			for (uint32_t binding = 0; binding < 2; binding++) {
+				VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+				write.dstSet = set;
+				write.dstBinding = binding;
+				write.descriptorCount = 1;
+				write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				write.pBufferInfo = &bufferInfos[binding];
+				writes.push_back(write);
+			}
+		}
+		VK(vkUpdateDescriptorSets(context->device, uint32_t(writes.size()), writes.data(), 0, 0));
+	}
+
+	// Regions pack the meshes on the CPU, they keep the CPU mesher
+	gpuMesher = true;
+	worldManager.setGpuMeshing(!chunkRegionMode, settings.validateGpuMesher);
+	LOG_INFO("Full detail chunks are meshed on the GPU", settings.validateGpuMesher ? ", every mesh is compared with the CPU mesher" : "");
+	if (!settings.validateGpuMesher) {
+		LOG_WARNING("The GPU mesher is experimental, run --validate-gpu-mesher to compare its meshes with the CPU mesher");
+	}
+}
+
+// SIZE AND EMIT THE MESHES COUNTED BY THIS FRAME INDEX, COUNT THE NEXT ONES
+void Vulkan::recordGpuMeshing(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+	if (!gpuMesher) {
+		return;
+	}
+	GpuMeshSlot& slot = gpuMeshSlots[frameIndex];
+	const uint32_t* counters = (const uint32_t*)slot.counters.allocation.mapped;
+
+	// EXACTLY SIZED BUFFERS FROM THE COUNTS, JOBS OF CHUNKS THAT WERE REMESHED OR UNLOADED IN BETWEEN ARE DROPPED
+	std::vector<GpuMeshJob> emitting;
+	emitting.swap(slot.counting);
+	size_t emitCount = 0;
+	for (size_t i = 0; i < emitting.size(); i++) {
+		GpuMeshJob& job = emitting[i];
+		Chunk* chunk = worldManager.findChunk(job.request.chunkX, job.request.chunkZ);
+		if (!chunk || chunk->meshVersion != job.request.meshVersion) {
+			continue;
+		}
+
+		const uint32_t* counts = counters + (MAX_GPU_MESH_JOBS + i) * Chunk::MESH_RANGE_COUNT;
+		job.meshRanges[0] = 0;
+		for (int range = 0; range < Chunk::MESH_RANGE_COUNT; range++) {
+			job.meshRanges[range + 1] = job.meshRanges[range] + counts[range] * 6;
+		}
+		uint32_t quadCount = job.meshRanges[Chunk::MESH_RANGE_COUNT] / 6;
+
+		// Frames in flight may still draw the old mesh
+		VkBufferUsageFlags readbackUsage = job.request.validate ? VK_BUFFER_USAGE_TRANSFER_SRC_BIT : 0;
+		retireChunkBuffers(chunk, frameIndex);
+		createBuffer(&chunk->vertexBuffer, &chunk->vertexBufferAllocation, sizeof(Vertex) * std::max(quadCount * 4, 1u),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | readbackUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			VulkanAllocator::CATEGORY_CHUNK_MESH);
+		createBuffer(&chunk->indexBuffer, &chunk->indexBufferAllocation, sizeof(uint32_t) * std::max(quadCount * 6, 1u),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | readbackUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			VulkanAllocator::CATEGORY_CHUNK_MESH);
+		chunk->setGpuMesh(job.meshRanges);
+		chunk->vertexAndIndexBufferUploaded = true;
+
+		// The emit pass below fills them before the render pass draws the chunk
+		if (quadCount > 0) {
+			VkDescriptorBufferInfo bufferInfos[2] = {
+				{ chunk->vertexBuffer, 0, VK_WHOLE_SIZE },
+				{ chunk->indexBuffer, 0, VK_WHOLE_SIZE }
+			};
+			VkWriteDescriptorSet writes[2];
+			for (uint32_t j = 0; j < 2; j++) {
+				writes[j] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+				writes[j].dstSet = slot.emitSets[emitCount];
+				writes[j].dstBinding = 2 + j;
+				writes[j].descriptorCount = 1;
+				writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[j].pBufferInfo = &bufferInfos[j];
+			}
+			VK(vkUpdateDescriptorSets(context->device, ARRAY_COUNT(writes), writes, 0, 0));
+		}
+		gpuMeshCount++;
+
+		// The input is copied to the emit half below, counts are read from the old index first
+		if (emitCount != i) {
+			emitting[emitCount] = std::move(job);
+		}
+		emitCount++;
+	}
+	emitting.resize(emitCount);
+
+	// NEW REQUESTS, UP TO ONE PASS
+	worldManager.takeGpuMeshRequests(gpuMeshQueue);
+	while (slot.counting.size() < MAX_GPU_MESH_JOBS && !gpuMeshQueue.empty()) {
+		WorldManager::GpuMeshRequest& request = gpuMeshQueue.front();
+		Chunk* chunk = worldManager.findChunk(request.chunkX, request.chunkZ);
+		if (chunk && chunk->meshVersion == request.meshVersion) {
+			slot.counting.push_back({ std::move(request) });
+		}
+		gpuMeshQueue.pop_front();
+	}
+
+	if (emitting.empty() && slot.counting.empty()) {
+		return;
+	}
+
+	// INPUTS, THE EMIT HALF FIRST
+	uint32_t* input = (uint32_t*)slot.input.allocation.mapped;
+	for (size_t i = 0; i < emitting.size(); i++) {
+		memcpy(input + i * PaletteChunk::SIZE, emitting[i].request.input.getData().data(), PaletteChunk::SIZE * sizeof(uint32_t));
+	}
+	for (size_t i = 0; i < slot.counting.size(); i++) {
+		memcpy(input + (MAX_GPU_MESH_JOBS + i) * PaletteChunk::SIZE, slot.counting[i].request.input.getData().data(), PaletteChunk::SIZE * sizeof(uint32_t));
+	}
+
+	// CLEAR THE COUNTERS
+	vkCmdFillBuffer(commandBuffer, slot.counters.buffer, 0, VK_WHOLE_SIZE, 0);
+	VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, 0, 0, 0);
+
+	// COUNT PASS
+	GpuMeshPushConstants pushConstants = {};
+	if (!slot.counting.empty()) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuMeshCountPipeline.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuMeshCountPipeline.pipelineLayout, 0, 1, &slot.countSet, 0, 0);
+		for (uint32_t i = 0; i < slot.counting.size(); i++) {
+			pushConstants.inputOffset = (MAX_GPU_MESH_JOBS + i) * PaletteChunk::SIZE;
+			pushConstants.counterOffset = (MAX_GPU_MESH_JOBS + i) * Chunk::MESH_RANGE_COUNT;
+			vkCmdPushConstants(commandBuffer, gpuMeshCountPipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, GPU_MESH_GROUPS, 1, 1);
+		}
+	}
+
+	// EMIT PASS, THE COUNTERS HAND OUT THE FACES INSIDE EVERY RANGE
+	if (!emitting.empty()) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuMeshEmitPipeline.pipeline);
+		for (uint32_t i = 0; i < emitting.size(); i++) {
+			const GpuMeshJob& job = emitting[i];
+			if (job.meshRanges[Chunk::MESH_RANGE_COUNT] == 0) {
+				continue;
+			}
+			pushConstants.inputOffset = i * PaletteChunk::SIZE;
+			pushConstants.counterOffset = i * Chunk::MESH_RANGE_COUNT;
+			for (int range = 0; range < Chunk::MESH_RANGE_COUNT; range++) {
+				pushConstants.rangeStarts[range] = job.meshRanges[range] / 6;
+			}
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuMeshEmitPipeline.pipelineLayout, 0, 1, &slot.emitSets[i], 0, 0);
+			vkCmdPushConstants(commandBuffer, gpuMeshEmitPipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, GPU_MESH_GROUPS, 1, 1);
+		}
+	}
+
+	// MESHES ARE DRAWN IN THIS FRAME, THE COUNTS ARE READ AFTER THE FENCE
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_HOST_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, 0, 0, 0);
+
+	// VALIDATION, COPY THE MESHES OUT AND COMPARE THEM ONCE THE FENCE WAS WAITED ON
+	VkDeviceSize readbackSize = 0;
+	for (GpuMeshJob& job : emitting) {
+		if (job.request.validate) {
+			job.readbackOffset = readbackSize;
+			uint32_t indexCount = job.meshRanges[Chunk::MESH_RANGE_COUNT];
+			readbackSize += sizeof(Vertex) * (indexCount / 6 * 4) + sizeof(uint32_t) * indexCount;
+		}
+	}
+	if (readbackSize == 0) {
+		for (GpuMeshJob& job : emitting) {
+			if (job.request.validate) {
+				slot.validating.push_back(std::move(job));
+			}
+		}
+		return;
+	}
+	if (slot.readbackSize < readbackSize) {
+		if (slot.readbackSize > 0) {
+			cleanupBuffer(&slot.readback.buffer, &slot.readback.allocation);
+		}
+		VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		if (allocator.findMemoryType(UINT32_MAX, memoryProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != UINT32_MAX) {
+			memoryProperties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
+		createBuffer(&slot.readback.buffer, &slot.readback.allocation, readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties,
+			VulkanAllocator::CATEGORY_STAGING);
+		slot.readbackSize = readbackSize;
+	}
+	for (GpuMeshJob& job : emitting) {
+		if (!job.request.validate) {
+			continue;
+		}
+		uint32_t indexCount = job.meshRanges[Chunk::MESH_RANGE_COUNT];
+		if (indexCount > 0) {
+			Chunk* chunk = worldManager.findChunk(job.request.chunkX, job.request.chunkZ);
+			VkDeviceSize vertexSize = sizeof(Vertex) * (indexCount / 6 * 4);
+			VkBufferCopy vertexCopy = { 0, job.readbackOffset, vertexSize };
+			VkBufferCopy indexCopy = { 0, job.readbackOffset + vertexSize, sizeof(uint32_t) * indexCount };
+			vkCmdCopyBuffer(commandBuffer, chunk->vertexBuffer, slot.readback.buffer, 1, &vertexCopy);
+			vkCmdCopyBuffer(commandBuffer, chunk->indexBuffer, slot.readback.buffer, 1, &indexCopy);
+		}
+		slot.validating.push_back(std::move(job));
+	}
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, 0, 0, 0);
+}
+
+// COMPARE THE MESHES READ BACK BY THIS FRAME INDEX (ITS FENCE WAS WAITED ON)
+void Vulkan::collectGpuMeshValidation(uint32_t frameIndex) {
+	GpuMeshSlot& slot = gpuMeshSlots[frameIndex];
+	for (const GpuMeshJob& job : slot.validating) {
+		const uint8_t* data = slot.readbackSize > 0 ? (const uint8_t*)slot.readback.allocation.mapped + job.readbackOffset : nullptr;
+		uint32_t indexCount = job.meshRanges[Chunk::MESH_RANGE_COUNT];
+		const Vertex* vertices = (const Vertex*)data;
+		const uint32_t* indices = data ? (const uint32_t*)(data + sizeof(Vertex) * (indexCount / 6 * 4)) : nullptr;
+
+		std::string difference;
+		const WorldManager::GpuMeshRequest& request = job.request;
+		if (!ChunkMesher::compareMeshes(request.referenceVertices, request.referenceIndices, request.referenceRanges, vertices, indices,
+			job.meshRanges, difference)) {
+			failedGpuMeshComparisons++;
+			LOG_ERROR("GPU mesh of chunk (", request.chunkX, ", ", request.chunkZ, ") differs from the CPU mesh: ", difference);
+		}
+	}
+	slot.validating.clear();
+}
+
+void Vulkan::cleanupGpuMesher() {
+	if (gpuMesher) {
+		for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+			GpuMeshSlot& slot = gpuMeshSlots[i];
+			cleanupBuffer(&slot.input.buffer, &slot.input.allocation);
+			cleanupBuffer(&slot.counters.buffer, &slot.counters.allocation);
+			if (slot.readbackSize > 0) {
+				cleanupBuffer(&slot.readback.buffer, &slot.readback.allocation);
+				slot.readbackSize = 0;
+			}
+			slot.counting.clear();
+			slot.validating.clear();
+		}
+		gpuMeshQueue.clear();
+		worldManager.setGpuMeshing(false, false);
+
+		LOG_INFO("GPU mesher built ", gpuMeshCount, " chunk meshes");
+		if (settings.validateGpuMesher && failedGpuMeshComparisons > 0) {
+			LOG_ERROR(failedGpuMeshComparisons, " GPU meshes differ from the CPU mesher");
+		}
+	}
+
+	VK(vkDestroyDescriptorPool(context->device, gpuMeshPool, 0));
+	VK(vkDestroyDescriptorSetLayout(context->device, gpuMeshEmitLayout, 0));
+	VK(vkDestroyDescriptorSetLayout(context->device, gpuMeshCountLayout, 0));
+	cleanupPipeline(&gpuMeshEmitPipeline);
+	cleanupPipeline(&gpuMeshCountPipeline);
+	gpuMeshPool = VK_NULL_HANDLE;
+	gpuMeshEmitLayout = VK_NULL_HANDLE;
+	gpuMeshCountLayout = VK_NULL_HANDLE;
+	gpuMeshEmitPipeline = {};
+	gpuMeshCountPipeline = {};
+	gpuMesher = false;
+}
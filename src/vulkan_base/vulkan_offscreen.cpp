@@ -0,0 +1,37 @@
+#include "../vulkan_base.h"
+
+// CREATE OFFSCREEN COLOR IMAGES IN PLACE OF THE SWAPCHAIN
+bool Vulkan::createOffscreenTarget() {
+	if (settings.width == 0 || settings.height == 0) {
+		LOG_ERROR("Invalid offscreen size ", settings.width, "x", settings.height);
+		return false;
+	}
+
+	VulkanSwapchain result = {};
+	result.swapchain = VK_NULL_HANDLE;
+	result.format = VK_FORMAT_B8G8R8A8_UNORM; // Same as most window surfaces
+	result.width = settings.width;
+	result.height = settings.height;
+	result.transferSource = true;
+
+	// TRANSFER SRC, SO THE FRAMES CAN BE COPIED OUT
+	offscreenImages.resize(settings.framesInFlight);
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		createImage(&offscreenImages[i], result.width, result.height, result.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		result.images.push_back(offscreenImages[i].image);
+		result.imageViews.push_back(offscreenImages[i].view);
+	}
+
+	LOG_INFO("Rendering headless into ", settings.framesInFlight, " offscreen images of ", result.width, "x", result.height);
+	swapchain = result;
+	return true;
+}
+
+void Vulkan::cleanupOffscreenTarget() {
+	for (uint32_t i = 0; i < offscreenImages.size(); i++) {
+		cleanupImage(&offscreenImages[i]);
+	}
+	offscreenImages.clear();
+	swapchain.images.clear();
+	swapchain.imageViews.clear();
+}
@@ -1,4 +1,6 @@
 #include "../vulkan_base.h"
+#include "../game_engine/threadpool.h"
+#include <string>
 
 VkShaderModule Vulkan::createShaderModule(const char* shaderFilename) {
 	VkShaderModule result = {};
@@ -30,11 +32,49 @@ VkShaderModule Vulkan::createShaderModule(const char* shaderFilename) {
 	return result;
 }
 
-bool Vulkan::createPipeline(const char* vertexShaderFilename, const char* fragmentShaderFilename, VkVertexInputBindingDescription* binding) {
+void Vulkan::queuePipeline(VulkanPipeline* pipeline, const char* vertexShaderFilename, const char* fragmentShaderFilename, VkVertexInputBindingDescription* binding,
+	const VkVertexInputAttributeDescription* attributes, uint32_t attributeCount, const VkDescriptorSetLayout* setLayouts, uint32_t setLayoutCount,
+	const VkPushConstantRange* pushConstantRange, bool blending) {
+	queuedPipelines.push_back({ pipeline, vertexShaderFilename, fragmentShaderFilename, binding, attributes, attributeCount, setLayouts, setLayoutCount,
+		pushConstantRange, blending });
+}
+
+void Vulkan::createQueuedPipelines() {
+	if (queuedPipelines.empty()) {
+		return;
+	}
 
-	// CREATE SHADER MODULES
-	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderFilename);
-	VkShaderModule fragmentShaderModule = createShaderModule(fragmentShaderFilename);
+	// CREATE SHADER MODULES, EACH FILE ONLY ONCE
+	std::unordered_map<std::string, VkShaderModule> shaderModules;
+	for (const PipelineDescription& description : queuedPipelines) {
+		for (const char* filename : { description.vertexShaderFilename, description.fragmentShaderFilename }) {
+			if (shaderModules.find(filename) == shaderModules.end()) {
+				shaderModules[filename] = createShaderModule(filename);
+			}
+		}
+	}
+
+	// COMPILE IN PARALLEL, THE DEVICE AND THE PIPELINE CACHE ARE THREAD SAFE
+	uint32_t start = SDL_GetTicks();
+	{
+		// One pipeline per thread, the calling thread takes one too
+		ThreadPool threadPool(unsigned(std::max<size_t>(queuedPipelines.size(), 2) - 1));
+		threadPool.parallelFor(queuedPipelines.size(), [&](size_t i) {
+			const PipelineDescription& description = queuedPipelines[i];
+			createPipeline(description, shaderModules.at(description.vertexShaderFilename), shaderModules.at(description.fragmentShaderFilename));
+		});
+	}
+	LOG_INFO("Created ", queuedPipelines.size(), " pipelines in ", SDL_GetTicks() - start, " ms");
+
+	// MODULES CAN BE DESTROYED AFTER PIPELINE CREATION
+	for (auto& shaderModule : shaderModules) {
+		VK(vkDestroyShaderModule(context->device, shaderModule.second, 0));
+	}
+	queuedPipelines.clear();
+}
+
+bool Vulkan::createPipeline(const PipelineDescription& description, VkShaderModule vertexShaderModule, VkShaderModule fragmentShaderModule) {
+	VulkanPipeline* pipeline = description.pipeline;
 
 	// 2 SHADER PIPELINES
 	VkPipelineShaderStageCreateInfo shaderStages[2];
@@ -57,10 +97,10 @@ bool Vulkan::createPipeline(const char* vertexShaderFilename, const char* fragme
 	VkPipelineVertexInputStateCreateInfo vertexInputState = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
 
 	// VERTEX INPUT STATE
-	vertexInputState.vertexBindingDescriptionCount = binding ? 1 : 0;
-	vertexInputState.pVertexBindingDescriptions = binding;
-	vertexInputState.vertexAttributeDescriptionCount = ARRAY_COUNT(vertexAttributeDescriptions);
-	vertexInputState.pVertexAttributeDescriptions = vertexAttributeDescriptions;
+	vertexInputState.vertexBindingDescriptionCount = description.binding ? 1 : 0;
+	vertexInputState.pVertexBindingDescriptions = description.binding;
+	vertexInputState.vertexAttributeDescriptionCount = description.attributeCount;
+	vertexInputState.pVertexAttributeDescriptions = description.attributes;
 
 	// INPUT ASSEMBLY
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
@@ -88,7 +128,8 @@ bool Vulkan::createPipeline(const char* vertexShaderFilename, const char* fragme
 	// DEPTH STENCIL STATE
 	VkPipelineDepthStencilStateCreateInfo depthStencilState = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
 	depthStencilState.depthTestEnable = VK_TRUE;
-	depthStencilState.depthWriteEnable = VK_TRUE;
+	// Blended geometry is drawn last and must not hide what lies behind it
+	depthStencilState.depthWriteEnable = description.blending ? VK_FALSE : VK_TRUE;
 	depthStencilState.depthCompareOp = VK_COMPARE_OP_GREATER; // GREATER OR EQUAL ?
 	depthStencilState.minDepthBounds = 0.0f;
 	depthStencilState.maxDepthBounds = 1.0f;
@@ -96,7 +137,7 @@ bool Vulkan::createPipeline(const char* vertexShaderFilename, const char* fragme
 	// COLOR BLEND
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
 	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_TRUE;
+	colorBlendAttachment.blendEnable = description.blending ? VK_TRUE : VK_FALSE;
 	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
@@ -118,9 +159,11 @@ bool Vulkan::createPipeline(const char* vertexShaderFilename, const char* fragme
 	// CREATE PIPELINE LAYOUT
 	{
 		VkPipelineLayoutCreateInfo createInfo = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-		createInfo.setLayoutCount = 1;
-		createInfo.pSetLayouts = &descriptorSetLayout;
-		VKA(vkCreatePipelineLayout(context->device, &createInfo, 0, &pipeline.pipelineLayout));
+		createInfo.setLayoutCount = description.setLayoutCount;
+		createInfo.pSetLayouts = description.setLayouts;
+		createInfo.pushConstantRangeCount = description.pushConstantRange ? 1 : 0;
+		createInfo.pPushConstantRanges = description.pushConstantRange;
+		VKA(vkCreatePipelineLayout(context->device, &createInfo, 0, &pipeline->pipelineLayout));
 	}
 
 	// CREATE GRAPHIC PIPELINES
@@ -136,21 +179,49 @@ bool Vulkan::createPipeline(const char* vertexShaderFilename, const char* fragme
 		createInfo.pDepthStencilState = &depthStencilState;
 		createInfo.pColorBlendState = &colorBlendState;
 		createInfo.pDynamicState = &dynamicState;
-		createInfo.layout = pipeline.pipelineLayout;
+		createInfo.layout = pipeline->pipelineLayout;
 		createInfo.renderPass = renderPass;
 		createInfo.subpass = 0;
 
 
-		VKA(vkCreateGraphicsPipelines(context->device, 0, 1, &createInfo, 0, &pipeline.pipeline));
+		VKA(vkCreateGraphicsPipelines(context->device, pipelineCache, 1, &createInfo, 0, &pipeline->pipeline));
+	}
+
+	return true;
+}
+
+bool Vulkan::createComputePipeline(VulkanPipeline* pipeline, const char* shaderFilename, VkDescriptorSetLayout setLayout, const VkPushConstantRange* pushConstantRange) {
+	VkShaderModule shaderModule = createShaderModule(shaderFilename);
+	if (shaderModule == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	// CREATE PIPELINE LAYOUT
+	{
+		VkPipelineLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+		createInfo.setLayoutCount = 1;
+		createInfo.pSetLayouts = &setLayout;
+		createInfo.pushConstantRangeCount = pushConstantRange ? 1 : 0;
+		createInfo.pPushConstantRanges = pushConstantRange;
+		VKA(vkCreatePipelineLayout(context->device, &createInfo, 0, &pipeline->pipelineLayout));
+	}
+
+	// CREATE COMPUTE PIPELINE
+	{
+		VkComputePipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+		createInfo.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+		createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		createInfo.stage.module = shaderModule;
+		createInfo.stage.pName = "main";
+		createInfo.layout = pipeline->pipelineLayout;
+		VKA(vkCreateComputePipelines(context->device, pipelineCache, 1, &createInfo, 0, &pipeline->pipeline));
 	}
 
-	// MODULE CAN BE DESTROYED AFTER PIPELINE CREATION
-	VK(vkDestroyShaderModule(context->device, vertexShaderModule, 0));
-	VK(vkDestroyShaderModule(context->device, fragmentShaderModule, 0));
+	VK(vkDestroyShaderModule(context->device, shaderModule, 0));
 	return true;
 }
 
-void Vulkan::cleanupPipeline() {
-	VK(vkDestroyPipeline(context->device, pipeline.pipeline, 0));
-	VK(vkDestroyPipelineLayout(context->device, pipeline.pipelineLayout, 0));
+void Vulkan::cleanupPipeline(VulkanPipeline* pipeline) {
+	VK(vkDestroyPipeline(context->device, pipeline->pipeline, 0));
+	VK(vkDestroyPipelineLayout(context->device, pipeline->pipelineLayout, 0));
 }
\ No newline at end of file
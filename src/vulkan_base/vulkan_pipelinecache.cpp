@@ -0,0 +1,125 @@
+#include "../vulkan_base.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char* pipelineCacheDirectory = "../cache";
+const char* pipelineCachePath = "../cache/pipelines.bin";
+
+const char PIPELINE_CACHE_MAGIC[4] = { 'V', 'K', 'P', 'C' };
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// Written in front of the driver's cache data. The driver checks its own header too,
+// but a few drivers have crashed on data from an older version instead of rejecting it.
+struct PipelineCacheFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+uint64_t hashData(const std::vector<char>& data) {
+	// FNV-1a, catches truncated or partly written files
+	uint64_t hash = 14695981039346656037ull;
+	for (char byte : data) {
+		hash = (hash ^ uint8_t(byte)) * 1099511628211ull;
+	}
+	return hash;
+}
+
+PipelineCacheFileHeader makeHeader(const VkPhysicalDeviceProperties& properties) {
+	PipelineCacheFileHeader header = {};
+	memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = properties.vendorID;
+	header.deviceID = properties.deviceID;
+	header.driverVersion = properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
+
+}
+
+void Vulkan::loadPipelineCache() {
+	std::vector<char> data;
+	std::error_code error;
+
+	std::ifstream file(pipelineCachePath, std::ios::binary);
+	if (file) {
+		PipelineCacheFileHeader expected = makeHeader(context->physicalDeviceProperties);
+		PipelineCacheFileHeader header = {};
+		file.read((char*)&header, sizeof(header));
+
+		if (!file || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version) {
+			LOG_WARNING("Ignoring invalid pipeline cache ", pipelineCachePath);
+		}
+		else if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID || header.driverVersion != expected.driverVersion
+			|| memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			LOG_INFO("Pipeline cache is from another gpu or driver, rebuilding it");
+		}
+		else if (header.dataSize != std::filesystem::file_size(pipelineCachePath, error) - sizeof(header)) {
+			LOG_WARNING("Ignoring damaged pipeline cache ", pipelineCachePath);
+		}
+		else {
+			data.resize(header.dataSize);
+			file.read(data.data(), data.size());
+			if (!file || hashData(data) != header.dataHash) {
+				LOG_WARNING("Ignoring damaged pipeline cache ", pipelineCachePath);
+				data.clear();
+			}
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+	if (vkCreatePipelineCache(context->device, &createInfo, 0, &pipelineCache) != VK_SUCCESS) {
+		// Still better than nothing, pipelines are compiled from scratch
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		VKA(vkCreatePipelineCache(context->device, &createInfo, 0, &pipelineCache));
+		data.clear();
+	}
+	if (!data.empty()) {
+		LOG_INFO("Loaded ", data.size(), " bytes of pipeline cache");
+	}
+}
+
+void Vulkan::savePipelineCache() {
+	size_t dataSize = 0;
+	VKA(vkGetPipelineCacheData(context->device, pipelineCache, &dataSize, 0));
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(context->device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+		LOG_WARNING("Could not read the pipeline cache data");
+		return;
+	}
+	data.resize(dataSize);
+
+	PipelineCacheFileHeader header = makeHeader(context->physicalDeviceProperties);
+	header.dataSize = data.size();
+	header.dataHash = hashData(data);
+
+	// Written next to the old cache and renamed over it, a crash while saving keeps the old one
+	std::error_code error;
+	std::filesystem::create_directories(pipelineCacheDirectory, error);
+	std::string temporaryPath = std::string(pipelineCachePath) + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write(data.data(), data.size());
+		if (!file) {
+			LOG_WARNING("Could not write the pipeline cache ", temporaryPath);
+			return;
+		}
+	}
+	std::filesystem::rename(temporaryPath, pipelineCachePath, error);
+	if (error) {
+		LOG_WARNING("Could not replace the pipeline cache ", pipelineCachePath, ": ", error.message());
+	}
+}
@@ -0,0 +1,201 @@
+#include "../vulkan_base.h"
+#include <cstring>
+
+void Vulkan::setChunkRegionMode(bool enabled) {
+	if (enabled == chunkRegionMode) {
+		return;
+	}
+	chunkRegionMode = enabled;
+
+	// Everything is uploaded again in the other layout
+	VKA(vkDeviceWaitIdle(context->device));
+	for (auto& chunkPair : worldManager.getChunks()) {
+		worldManager.cleanupBuffers(allocator, chunkPair.second.get());
+		chunkPair.second->vertexAndIndexBufferUploaded = false;
+	}
+	cleanupRegions();
+
+	// Regions pack the meshes on the CPU, GPU meshes only live in the chunk buffers that were just destroyed
+	if (gpuMesher) {
+		worldManager.setGpuMeshing(!enabled, settings.validateGpuMesher);
+		if (enabled) {
+			worldManager.remeshAllChunks();
+		}
+	}
+
+	LOG_INFO(enabled ? "Chunk regions enabled" : "Chunk regions disabled");
+}
+
+void Vulkan::collectRegionDraws(uint32_t frameIndex) {
+	glm::vec3 cameraPosition = cameraManager.camera.cameraPosition;
+	int cameraChunkX = floorDiv(int(floor(cameraPosition.x)), CHUNK_SIZE_X);
+	int cameraChunkZ = floorDiv(int(floor(cameraPosition.z)), CHUNK_SIZE_Z);
+
+	// SORT CHUNKS INTO REGIONS
+	for (auto& regionPair : chunkRegions) {
+		regionPair.second.chunks.clear();
+	}
+	for (auto& chunkPair : worldManager.getChunks()) {
+		int chunkX = chunkPair.first.first;
+		int chunkZ = chunkPair.first.second;
+		std::pair<int, int> key(floorDiv(chunkX, CHUNK_REGION_SIZE), floorDiv(chunkZ, CHUNK_REGION_SIZE));
+
+		auto regionIt = chunkRegions.find(key);
+		if (regionIt == chunkRegions.end()) {
+			ChunkRegion region = {};
+			glm::vec3 size(CHUNK_REGION_SIZE * CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_REGION_SIZE * CHUNK_SIZE_Z);
+			region.position = glm::vec3(key.first * size.x, 0.0f, key.second * size.z);
+			region.modelMatrix = glm::translate(glm::mat4(1.0f), region.position);
+			region.center = region.position + size * 0.5f;
+			region.radius = glm::length(size) * 0.5f;
+			regionIt = chunkRegions.emplace(key, region).first;
+		}
+		regionIt->second.chunks.push_back({ chunkPair.second.get(), chunkX, chunkZ, 0, 0, false, false, false });
+	}
+
+	for (auto regionIt = chunkRegions.begin(); regionIt != chunkRegions.end(); ) {
+		ChunkRegion& region = regionIt->second;
+		if (region.chunks.empty()) {
+			retireBuffer(&region.vertices.buffer, &region.vertices.allocation, frameIndex);
+			retireBuffer(&region.indices.buffer, &region.indices.allocation, frameIndex);
+			regionIt = chunkRegions.erase(regionIt);
+			continue;
+		}
+		int regionChunkX = regionIt->first.first * CHUNK_REGION_SIZE;
+		int regionChunkZ = regionIt->first.second * CHUNK_REGION_SIZE;
+		++regionIt;
+
+		// REGION CULLING
+		int distanceX = std::max(0, std::max(regionChunkX - cameraChunkX, cameraChunkX - (regionChunkX + CHUNK_REGION_SIZE - 1)));
+		int distanceZ = std::max(0, std::max(regionChunkZ - cameraChunkZ, cameraChunkZ - (regionChunkZ + CHUNK_REGION_SIZE - 1)));
+		if (std::max(distanceX, distanceZ) > int(viewDistance)) {
+			continue;
+		}
+		if (!cameraManager.isSphereInFrustum(cameraManager.frustum, region.center, region.radius)) {
+			continue;
+		}
+
+		// CHUNK CULLING
+		auto before = [](const ChunkRegion::Member& a, const ChunkRegion::Member& b) {
+			return a.chunkX != b.chunkX ? a.chunkX < b.chunkX : a.chunkZ < b.chunkZ;
+		};
+		std::sort(region.chunks.begin(), region.chunks.end(), before);
+		bool changed = false;
+		bool anyVisible = false;
+		size_t packedIndex = 0;
+		for (ChunkRegion::Member& member : region.chunks) {
+			// Both are sorted, an unchanged chunk keeps its ranges from the last pack
+			while (packedIndex < region.packed.size() && before(region.packed[packedIndex], member)) {
+				packedIndex++;
+			}
+			const ChunkRegion::Member* packed = nullptr;
+			if (packedIndex < region.packed.size() && !before(member, region.packed[packedIndex]) && region.packed[packedIndex].chunk == member.chunk) {
+				packed = &region.packed[packedIndex];
+				member.vertexOffset = packed->vertexOffset;
+				member.firstIndex = packed->firstIndex;
+			}
+
+			bool resorted;
+			member.visible = cullChunk(member.chunkX, member.chunkZ, member.chunk, resorted);
+			member.verticesChanged = !packed || !member.chunk->vertexAndIndexBufferUploaded;
+			member.indicesChanged = member.verticesChanged || resorted;
+			changed |= member.indicesChanged;
+			anyVisible |= member.visible;
+		}
+		if (!anyVisible) {
+			continue;
+		}
+
+		if (changed) {
+			packRegion(region, frameIndex);
+		}
+
+		for (const ChunkRegion::Member& member : region.chunks) {
+			if (member.visible) {
+				addChunkDraw(member.chunk, &region, region.vertices.buffer, region.indices.buffer, member.vertexOffset, member.firstIndex);
+			}
+		}
+	}
+}
+
+void Vulkan::packRegion(ChunkRegion& region, uint32_t frameIndex) {
+	size_t liveVertices = 0, liveIndices = 0;
+	size_t changedVertices = 0, changedIndices = 0;
+	for (const ChunkRegion::Member& member : region.chunks) {
+		size_t vertexCount = member.chunk->getVertices().size();
+		size_t indexCount = member.chunk->getIndices().size();
+		liveVertices += vertexCount;
+		liveIndices += indexCount;
+		changedVertices += member.verticesChanged ? vertexCount : 0;
+		changedIndices += member.indicesChanged ? indexCount : 0;
+	}
+
+	// FULL BUFFERS ARE REPACKED WITH ROOM TO GROW, frames in flight may still draw from the old ones
+	if (region.vertexCount + changedVertices > region.vertexCapacity) {
+		retireBuffer(&region.vertices.buffer, &region.vertices.allocation, frameIndex);
+		region.vertexCount = 0;
+		region.vertexCapacity = liveVertices * 2;
+		if (region.vertexCapacity > 0) {
+			createBuffer(&region.vertices.buffer, &region.vertices.allocation, sizeof(Vertex) * region.vertexCapacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VulkanAllocator::CATEGORY_CHUNK_MESH);
+		}
+		for (ChunkRegion::Member& member : region.chunks) {
+			member.verticesChanged = true;
+		}
+	}
+	if (region.indexCount + changedIndices > region.indexCapacity) {
+		retireBuffer(&region.indices.buffer, &region.indices.allocation, frameIndex);
+		region.indexCount = 0;
+		region.indexCapacity = liveIndices * 2;
+		if (region.indexCapacity > 0) {
+			createBuffer(&region.indices.buffer, &region.indices.allocation, sizeof(uint32_t) * region.indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VulkanAllocator::CATEGORY_CHUNK_MESH);
+		}
+		for (ChunkRegion::Member& member : region.chunks) {
+			member.indicesChanged = true;
+		}
+	}
+
+	// ONLY CHANGED CHUNKS ARE WRITTEN
+	for (ChunkRegion::Member& member : region.chunks) {
+		const std::vector<Vertex>& vertices = member.chunk->getVertices();
+		if (member.verticesChanged && !vertices.empty()) {
+			member.vertexOffset = int32_t(region.vertexCount);
+			region.vertexCount += vertices.size();
+
+			// Moved from chunk to region space
+			glm::vec3 offset = member.chunk->position - region.position;
+			Vertex* target = (Vertex*)region.vertices.allocation.mapped + member.vertexOffset;
+			for (const Vertex& vertex : vertices) {
+				*target = vertex;
+				target->position += offset;
+				target++;
+			}
+		}
+
+		const std::vector<uint32_t>& indices = member.chunk->getIndices();
+		if (member.indicesChanged && !indices.empty()) {
+			member.firstIndex = uint32_t(region.indexCount);
+			region.indexCount += indices.size();
+
+			// Stay chunk local, the draws add the vertex offset
+			memcpy((uint32_t*)region.indices.allocation.mapped + member.firstIndex, indices.data(), sizeof(uint32_t) * indices.size());
+		}
+
+		member.chunk->vertexAndIndexBufferUploaded = true;
+	}
+	region.packed = region.chunks;
+}
+
+void Vulkan::cleanupRegions() {
+	for (auto& regionPair : chunkRegions) {
+		ChunkRegion& region = regionPair.second;
+		if (region.vertices.buffer != VK_NULL_HANDLE) {
+			cleanupBuffer(&region.vertices.buffer, &region.vertices.allocation);
+		}
+		if (region.indices.buffer != VK_NULL_HANDLE) {
+			cleanupBuffer(&region.indices.buffer, &region.indices.allocation);
+		}
+	}
+	chunkRegions.clear();
+}
@@ -1,6 +1,7 @@
 #include "../vulkan_base.h"
+#include <cstring>
 
-void Vulkan::renderVulkan() {
+void Vulkan::renderVulkan(uint64_t inputCounter) {
 	static float time = 0.0f;
 	time += 0.01f;
 
@@ -10,10 +11,20 @@ void Vulkan::renderVulkan() {
 	// WAIT UNTIL GPU IS DONE TO RESET THE COMMAND POOL
 	// WAIT FOR FENCES
 	VKA(vkWaitForFences(context->device, 1, &fences[frameIndex], VK_TRUE, UINT64_MAX));
+	pollFrameTimings();
+	collectCapture(frameIndex);
+	collectGpuMeshValidation(frameIndex);
+	releaseRetiredBuffers(frameIndex);
 	// RESET FENCE
 
-	// CREATE RENDERABLE IMAGE
-	VkResult result = VK(vkAcquireNextImageKHR(context->device, swapchain.swapchain, UINT64_MAX, acquireSemaphores[frameIndex], 0, &imageIndex));
+	// CREATE RENDERABLE IMAGE (HEADLESS: THE OFFSCREEN IMAGE OF THIS FRAME, ITS FENCE WAS JUST WAITED ON)
+	VkResult result = VK_SUCCESS;
+	if (settings.headless) {
+		imageIndex = frameIndex;
+	}
+	else {
+		result = VK(vkAcquireNextImageKHR(context->device, swapchain.swapchain, UINT64_MAX, acquireSemaphores[frameIndex], 0, &imageIndex));
+	}
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) { // SIZE DOESNT MATCH THE WINDOW
 		// SWAPCHAIN IS OUT OF DATE
 		recreateSwapchain();
@@ -40,6 +51,9 @@ void Vulkan::renderVulkan() {
 		VkCommandBuffer commandBuffer = commandBuffers[frameIndex];
 		VKA(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
+		// Chunk meshes of this frame are written before the render pass
+		recordGpuMeshing(commandBuffer, frameIndex);
+
 		// RESIZE SCALES WITH PIPELINE
 		VkViewport viewport = { 0.0f, 0.0f, (float)swapchain.width, (float)swapchain.height, 0.0f, 1.0f };
 		VkRect2D scissor = { {0, 0}, {swapchain.width, swapchain.height} };
@@ -66,11 +80,16 @@ void Vulkan::renderVulkan() {
 
 		// BIND TO PIPELINE
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+		bindTextureTable(commandBuffer, pipeline.pipelineLayout);
 		renderInCommand(commandBuffer, frameIndex); // RENDER HERE
 
 		// END RENDER PASS
 		vkCmdEndRenderPass(commandBuffer);
 
+		if (captureRequested) {
+			recordCapture(commandBuffer, frameIndex, imageIndex);
+		}
+
 		// END COMMAND BUFFER
 		VKA(vkEndCommandBuffer(commandBuffer));
 	}
@@ -79,13 +98,21 @@ void Vulkan::renderVulkan() {
 	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[frameIndex];
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = settings.headless ? 0 : 1;
 	submitInfo.pWaitSemaphores = &acquireSemaphores[frameIndex];
 	VkPipelineStageFlags waitMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	submitInfo.pWaitDstStageMask = &waitMask;
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = settings.headless ? 0 : 1;
 	submitInfo.pSignalSemaphores = &releaseSemaphores[frameIndex];
 	VKA(vkQueueSubmit(context->graphicsQueue.queue, 1, &submitInfo, fences[frameIndex]));
+	frameTimings[frameIndex] = { inputCounter, 0, 0, true };
+
+	// NOTHING TO PRESENT, THE SUBMIT STANDS IN FOR THE PRESENT IN THE TIMINGS
+	if (settings.headless) {
+		frameTimings[frameIndex].presentCounter = SDL_GetPerformanceCounter();
+		frameIndex = (frameIndex + 1) % settings.framesInFlight;
+		return;
+	}
 
 	// PRESENT THE IMAGE WITH SWAPCHAIN
 	VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
@@ -95,6 +122,7 @@ void Vulkan::renderVulkan() {
 	presentInfo.waitSemaphoreCount = 1;
 	presentInfo.pWaitSemaphores = &releaseSemaphores[frameIndex];
 	result = VK(vkQueuePresentKHR(context->graphicsQueue.queue, &presentInfo));
+	frameTimings[frameIndex].presentCounter = SDL_GetPerformanceCounter();
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) { // SIZE DOESNT MATCH THE WINDOW
 		// SWAPCHAIN IS OUT OF DATE
 		recreateSwapchain();
@@ -103,11 +131,13 @@ void Vulkan::renderVulkan() {
 		ASSERT_VULKAN(result);
 	}
 
-	frameIndex = (frameIndex + 1) % FRAMES_IN_FLIGHT;
+	frameIndex = (frameIndex + 1) % settings.framesInFlight;
 }
 
 void Vulkan::renderInCommand(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
 	renderChunk(commandBuffer, frameIndex);
+	renderFarTerrain(commandBuffer, frameIndex);
+	renderTranslucentChunks(commandBuffer);
 }
 
 // CHANGE FRUSTUM FOR CHUNKS ???
@@ -117,24 +147,36 @@ void Vulkan::renderChunk(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
 	uint32_t dynamicOffset = 0; // singleElementSize for each more chunk
 	uint32_t currentModel = 0;
 
-	VkDeviceMemory uboMemory = uniformBuffers[0][frameIndex].memory;
+	void* uboData = uniformBuffers[0][frameIndex].allocation.mapped;
 	VkDescriptorSet* descriptorSet = &descriptorSets[0][frameIndex];
 
 	cameraManager.extractFrustum(cameraManager.camera.viewProj);
 
-	for (auto& chunkPair : worldManager.getChunks()) {
-		
-		auto chunk = chunkPair.second;
-
-		// FRUSTUM CULLING (DONT LOAD UNSEEN CHUNKS)
-		if (cameraManager.isSphereInFrustum(cameraManager.frustum, chunk->chunkCenter, chunk->chunkRadius)) {
-			if (!chunk->vertexAndIndexBufferUploaded) {
-				uploadChunkMesh(chunk.get());
-				chunk->vertexAndIndexBufferUploaded = true;
-			}
+	chunkDraws.clear();
+	if (chunkRegionMode) {
+		collectRegionDraws(frameIndex);
+	}
+	else {
+		collectChunkDraws(frameIndex);
+	}
 
-			glm::mat4 modelViewProj = cameraManager.camera.viewProj * chunk->modelMatrix;
-			glm::mat4 modelView = cameraManager.camera.view * chunk->modelMatrix;
+	// Front to back, so the depth test rejects hidden fragments before shading
+	std::sort(chunkDraws.begin(), chunkDraws.end(), [](const ChunkDraw& a, const ChunkDraw& b) {
+		return a.regionDistance != b.regionDistance ? a.regionDistance < b.regionDistance : a.distance < b.distance;
+	});
+
+	boundChunk = {};
+	const ChunkDraw* previous = nullptr;
+	for (ChunkDraw& draw : chunkDraws) {
+		// Chunks of a region share the uniform slot of the region
+		if (draw.region && previous && previous->region == draw.region) {
+			draw.descriptorSet = previous->descriptorSet;
+			draw.dynamicOffset = previous->dynamicOffset;
+		}
+		else {
+			const glm::mat4& modelMatrix = draw.region ? draw.region->modelMatrix : draw.chunk->modelMatrix;
+			glm::mat4 modelViewProj = cameraManager.camera.viewProj * modelMatrix;
+			glm::mat4 modelView = cameraManager.camera.view * modelMatrix;
 
 			UniformBufferObject ubo = {};
 			ubo.modelView = modelView;
@@ -143,34 +185,324 @@ void Vulkan::renderChunk(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
 			dynamicOffset = currentModel * singleElementSize;
 
 			if (dynamicOffset + sizeof(UniformBufferObject) > maxUniformSize) {
-				uboMemory = uniformBuffers[1][frameIndex].memory;
+				uboData = uniformBuffers[1][frameIndex].allocation.mapped;
 				descriptorSet = &descriptorSets[1][frameIndex];
 
 				dynamicOffset = 0;
 				currentModel = 0;
 			}
 
-			void* data;
-			VK(vkMapMemory(context->device, uboMemory, dynamicOffset, sizeof(ubo), 0, &data));
-			memcpy(data, &ubo, sizeof(ubo));
-			VK(vkUnmapMemory(context->device, uboMemory));
-
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &chunk->vertexBuffer, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, chunk->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipelineLayout, 0, 1, descriptorSet, 1, &dynamicOffset);
-			vkCmdDrawIndexed(commandBuffer, chunk->getIndices().size(), 1, 0, 0, 0);
+			memcpy((char*)uboData + dynamicOffset, &ubo, sizeof(ubo));
 
+			draw.descriptorSet = descriptorSet;
+			draw.dynamicOffset = dynamicOffset;
 			currentModel++;
 		}
-		
+		previous = &draw;
+
+		drawChunkFaces(commandBuffer, draw, Block::LAYER_OPAQUE, pipeline.pipelineLayout);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, cutoutPipeline.pipeline);
+	bindTextureTable(commandBuffer, cutoutPipeline.pipelineLayout);
+	boundChunk = {};
+	for (const ChunkDraw& draw : chunkDraws) {
+		drawChunkFaces(commandBuffer, draw, Block::LAYER_CUTOUT, cutoutPipeline.pipelineLayout);
+	}
+}
+
+void Vulkan::collectChunkDraws(uint32_t frameIndex) {
+	for (auto& chunkPair : worldManager.getChunks()) {
+		Chunk* chunk = chunkPair.second.get();
+		bool resorted;
+		if (!cullChunk(chunkPair.first.first, chunkPair.first.second, chunk, resorted)) {
+			continue;
+		}
+
+		if (!chunk->vertexAndIndexBufferUploaded) {
+			// A GPU mesh only lives in its buffers, the chunk waits for its remesh
+			if (chunk->gpuMeshed) {
+				continue;
+			}
+			retireChunkBuffers(chunk, frameIndex);
+			uploadChunkMesh(chunk);
+			chunk->vertexAndIndexBufferUploaded = true;
+		}
+		else if (resorted) {
+			retireBuffer(&chunk->indexBuffer, &chunk->indexBufferAllocation, frameIndex);
+			uploadChunkIndices(chunk);
+		}
+
+		addChunkDraw(chunk, nullptr, chunk->vertexBuffer, chunk->indexBuffer, 0, 0);
+	}
+}
+
+bool Vulkan::cullChunk(int chunkX, int chunkZ, Chunk* chunk, bool& resorted) {
+	glm::vec3 cameraPosition = cameraManager.camera.cameraPosition;
+	resorted = false;
+
+	// Chunks kept loaded past the view distance are covered by the far terrain
+	int cameraChunkX = floorDiv(int(floor(cameraPosition.x)), CHUNK_SIZE_X);
+	int cameraChunkZ = floorDiv(int(floor(cameraPosition.z)), CHUNK_SIZE_Z);
+	if (std::max(abs(chunkX - cameraChunkX), abs(chunkZ - cameraChunkZ)) > int(viewDistance)) {
+		return false;
+	}
+
+	// FRUSTUM CULLING (DONT LOAD UNSEEN CHUNKS)
+	if (!cameraManager.isSphereInFrustum(cameraManager.frustum, chunk->chunkCenter, chunk->chunkRadius)) {
+		return false;
+	}
+
+	// Sort order only changes when the camera crossed a face plane,
+	// far away chunks need a larger move before that gets visible
+	float distance = glm::length(chunk->chunkCenter - cameraPosition);
+	if (chunk->needsTranslucentSort(cameraPosition, 1.0f + distance * 0.1f)) {
+		chunk->sortTranslucentFaces(cameraPosition);
+		resorted = true;
+	}
+	return true;
+}
+
+void Vulkan::addChunkDraw(Chunk* chunk, ChunkRegion* region, VkBuffer vertexBuffer, VkBuffer indexBuffer, int32_t vertexOffset, uint32_t firstIndex) {
+	glm::vec3 cameraPosition = cameraManager.camera.cameraPosition;
+	uint8_t visibleFaces = chunk->getVisibleFaceMask(cameraPosition);
+
+	// Chunks without an index in any visible direction would only take a uniform slot
+	bool hasIndices = chunk->hasTranslucentFaces();
+	for (int direction = 0; direction < Chunk::FACE_DIRECTION_COUNT && !hasIndices; direction++) {
+		if (!(visibleFaces & (1 << direction))) {
+			continue;
+		}
+		for (Block::RenderLayer layer : { Block::LAYER_OPAQUE, Block::LAYER_CUTOUT }) {
+			int range = Chunk::faceRange(layer, direction);
+			hasIndices |= chunk->getMeshRangeStart(range + 1) > chunk->getMeshRangeStart(range);
+		}
+	}
+	if (!hasIndices) {
+		return;
+	}
+
+	ChunkDraw draw = {};
+	draw.chunk = chunk;
+	draw.region = region;
+	draw.vertexBuffer = vertexBuffer;
+	draw.indexBuffer = indexBuffer;
+	draw.vertexOffset = vertexOffset;
+	draw.firstIndex = firstIndex;
+	draw.visibleFaces = visibleFaces;
+	draw.distance = glm::length(chunk->chunkCenter - cameraPosition);
+	draw.regionDistance = region ? glm::length(region->center - cameraPosition) : draw.distance;
+	chunkDraws.push_back(draw);
+}
+
+void Vulkan::renderTranslucentChunks(VkCommandBuffer commandBuffer) {
+	glm::vec3 cameraPosition = cameraManager.camera.cameraPosition;
+	bool pipelineBound = false;
+
+	// Back to front, chunk by chunk and section by section
+	for (auto it = chunkDraws.rbegin(); it != chunkDraws.rend(); ++it) {
+		const ChunkDraw& draw = *it;
+		Chunk* chunk = draw.chunk;
+		if (!chunk->hasTranslucentFaces()) {
+			continue;
+		}
+		if (!pipelineBound) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, translucentPipeline.pipeline);
+			bindTextureTable(commandBuffer, translucentPipeline.pipelineLayout);
+			pipelineBound = true;
+			boundChunk = {};
+		}
+		bindChunk(commandBuffer, draw, translucentPipeline.pipelineLayout);
+
+		int sections[CHUNK_SECTION_COUNT];
+		float sectionDistances[CHUNK_SECTION_COUNT];
+		for (int section = 0; section < CHUNK_SECTION_COUNT; section++) {
+			sections[section] = section;
+			sectionDistances[section] = fabs(chunk->position.y + (section + 0.5f) * CHUNK_SECTION_HEIGHT - cameraPosition.y);
+		}
+		std::sort(sections, sections + CHUNK_SECTION_COUNT, [&](int a, int b) { return sectionDistances[a] > sectionDistances[b]; });
+
+		for (int section : sections) {
+			uint32_t first = chunk->getMeshRangeStart(Chunk::translucentRange(section));
+			uint32_t count = chunk->getMeshRangeStart(Chunk::translucentRange(section) + 1) - first;
+			if (count > 0) {
+				vkCmdDrawIndexed(commandBuffer, count, 1, draw.firstIndex + first, draw.vertexOffset, 0);
+			}
+		}
 	}
-	
+}
+
+void Vulkan::bindChunk(VkCommandBuffer commandBuffer, const ChunkDraw& draw, VkPipelineLayout pipelineLayout) {
+	if (boundChunk.vertexBuffer != draw.vertexBuffer) {
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, offsets);
+		boundChunk.vertexBuffer = draw.vertexBuffer;
+	}
+	if (boundChunk.indexBuffer != draw.indexBuffer) {
+		vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		boundChunk.indexBuffer = draw.indexBuffer;
+	}
+	if (boundChunk.descriptorSet != draw.descriptorSet || boundChunk.dynamicOffset != draw.dynamicOffset) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, draw.descriptorSet, 1, &draw.dynamicOffset);
+		boundChunk.descriptorSet = draw.descriptorSet;
+		boundChunk.dynamicOffset = draw.dynamicOffset;
+	}
+}
+
+void Vulkan::drawChunkFaces(VkCommandBuffer commandBuffer, const ChunkDraw& draw, Block::RenderLayer layer, VkPipelineLayout pipelineLayout) {
+	// Faces are grouped by direction, only draw the runs of directions that can face the camera
+	uint32_t drawRanges[Chunk::FACE_DIRECTION_COUNT][2];
+	uint32_t drawRangeCount = 0;
+	for (int direction = 0; direction < Chunk::FACE_DIRECTION_COUNT; direction++) {
+		int range = Chunk::faceRange(layer, direction);
+		uint32_t first = draw.chunk->getMeshRangeStart(range);
+		uint32_t count = draw.chunk->getMeshRangeStart(range + 1) - first;
+		if (!(draw.visibleFaces & (1 << direction)) || count == 0) {
+			continue;
+		}
+		if (drawRangeCount > 0 && drawRanges[drawRangeCount - 1][0] + drawRanges[drawRangeCount - 1][1] == first) {
+			drawRanges[drawRangeCount - 1][1] += count;
+		}
+		else {
+			drawRanges[drawRangeCount][0] = first;
+			drawRanges[drawRangeCount][1] = count;
+			drawRangeCount++;
+		}
+	}
+	if (drawRangeCount == 0) {
+		return;
+	}
+
+	bindChunk(commandBuffer, draw, pipelineLayout);
+	for (uint32_t range = 0; range < drawRangeCount; range++) {
+		vkCmdDrawIndexed(commandBuffer, drawRanges[range][1], 1, draw.firstIndex + drawRanges[range][0], draw.vertexOffset, 0);
+	}
+}
+
+void Vulkan::retireBuffer(VkBuffer* buffer, VulkanAllocation* allocation, uint32_t frameIndex) {
+	if (*buffer != VK_NULL_HANDLE) {
+		retiredBuffers[frameIndex].push_back({ *buffer, *allocation });
+		*buffer = VK_NULL_HANDLE;
+		*allocation = {};
+	}
+}
+
+void Vulkan::retireChunkBuffers(Chunk* chunk, uint32_t frameIndex) {
+	retireBuffer(&chunk->vertexBuffer, &chunk->vertexBufferAllocation, frameIndex);
+	retireBuffer(&chunk->indexBuffer, &chunk->indexBufferAllocation, frameIndex);
+}
+
+void Vulkan::releaseRetiredBuffers(uint32_t frameIndex) {
+	for (VulkanBuffer& buffer : retiredBuffers[frameIndex]) {
+		cleanupBuffer(&buffer.buffer, &buffer.allocation);
+	}
+	retiredBuffers[frameIndex].clear();
 }
 
 void Vulkan::updateVulkan(float delta) {
 	cameraManager.updateCamera(delta, swapchain.width, swapchain.height);
 	worldManager.generateChunksAround(cameraManager.camera.cameraPosition, viewDistance);
+	worldManager.updateLod(cameraManager.camera.cameraPosition);
+	farTerrain.update(cameraManager.camera.cameraPosition, viewDistance);
 	worldManager.processChunkQueue(5); // Chunks per frame
-	worldManager.unloadDistantChunks(cameraManager.camera.cameraPosition, viewDistance, context->device);
-}
\ No newline at end of file
+	worldManager.unloadDistantChunks(cameraManager.camera.cameraPosition, viewDistance, allocator);
+	worldManager.tickAutosave(delta);
+
+	// F3 RAYCAST BENCHMARK FROM THE CAMERA
+	if (debugKeyPressed(SDL_SCANCODE_F3)) {
+		worldManager.benchmarkRaycast(cameraManager.camera.cameraPosition, 100000, 64.0f);
+	}
+
+	// F4 TOGGLES REGION BATCHED CHUNK DRAWS
+	if (debugKeyPressed(SDL_SCANCODE_F4)) {
+		setChunkRegionMode(!chunkRegionMode);
+	}
+
+	// F5 LOGS GPU MEMORY STATISTICS
+	if (debugKeyPressed(SDL_SCANCODE_F5)) {
+		allocator.logStatistics();
+	}
+
+	// F6 LOGS FRAME TIMES AND LATENCY
+	if (debugKeyPressed(SDL_SCANCODE_F6)) {
+		logFrameTimings();
+	}
+
+	// F7 CAPTURES A SCREENSHOT
+	if (debugKeyPressed(SDL_SCANCODE_F7)) {
+		requestCapture("../captures/screenshot_" + std::to_string(screenshotCount++) + ".png");
+	}
+}
+
+bool Vulkan::debugKeyPressed(SDL_Scancode key) {
+	bool down = SDL_GetKeyboardState(0)[key];
+	bool pressed = down && !debugKeysDown[key];
+	debugKeysDown[key] = down;
+	return pressed;
+}
+
+void Vulkan::pollFrameTimings() {
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		if (frameTimings[i].pending && vkGetFenceStatus(context->device, fences[i]) == VK_SUCCESS) {
+			finishFrameTiming(i, SDL_GetPerformanceCounter());
+		}
+	}
+}
+
+void Vulkan::finishFrameTiming(uint32_t frameIndex, uint64_t completeCounter) {
+	FrameTiming& timing = frameTimings[frameIndex];
+	timing.completeCounter = completeCounter;
+	timing.pending = false;
+
+	if (frameTimingHistory.size() < FRAME_TIMING_HISTORY) {
+		frameTimingHistory.push_back(timing);
+	}
+	else {
+		frameTimingHistory[frameTimingHistoryIndex] = timing;
+		frameTimingHistoryIndex = (frameTimingHistoryIndex + 1) % FRAME_TIMING_HISTORY;
+	}
+
+	if (settings.logLatency) {
+		double counterToMs = 1000.0 / SDL_GetPerformanceFrequency();
+		LOG_INFO("Frame latency: input to present ", (timing.presentCounter - timing.inputCounter) * counterToMs,
+			" ms, input to gpu done ", (timing.completeCounter - timing.inputCounter) * counterToMs, " ms");
+	}
+}
+
+void Vulkan::finishFrames() {
+	VKA(vkDeviceWaitIdle(context->device));
+	pollFrameTimings();
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		collectCapture(i);
+		collectGpuMeshValidation(i);
+	}
+}
+
+void Vulkan::logFrameTimings() {
+	if (frameTimingHistory.size() < 2) {
+		LOG_INFO("Not enough frames for timings yet");
+		return;
+	}
+
+	double counterToMs = 1000.0 / SDL_GetPerformanceFrequency();
+	uint64_t firstInput = UINT64_MAX;
+	uint64_t lastInput = 0;
+	double presentSum = 0.0, presentMax = 0.0;
+	double completeSum = 0.0, completeMax = 0.0;
+	for (const FrameTiming& timing : frameTimingHistory) {
+		double present = (timing.presentCounter - timing.inputCounter) * counterToMs;
+		double complete = (timing.completeCounter - timing.inputCounter) * counterToMs;
+		presentSum += present;
+		completeSum += complete;
+		presentMax = std::max(presentMax, present);
+		completeMax = std::max(completeMax, complete);
+		firstInput = std::min(firstInput, timing.inputCounter);
+		lastInput = std::max(lastInput, timing.inputCounter);
+	}
+
+	double count = double(frameTimingHistory.size());
+	LOG_INFO("Last ", frameTimingHistory.size(), " frames (", getPresentModeName(settings.presentMode), ", ", settings.framesInFlight, " in flight): ",
+		(lastInput - firstInput) * counterToMs / (count - 1.0), " ms per frame");
+	LOG_INFO("Input to present: average ", presentSum / count, " ms, max ", presentMax, " ms");
+	LOG_INFO("Input to gpu done: average ", completeSum / count, " ms, max ", completeMax, " ms");
+}
@@ -10,7 +10,8 @@ bool Vulkan::createRenderPass(VkFormat format) {
 	attachmentDescriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	attachmentDescriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	attachmentDescriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachmentDescriptions[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Headless frames are not presented, they stay ready to be copied out
+	attachmentDescriptions[0].finalLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	attachmentDescriptions[1] = {};
 	attachmentDescriptions[1].format = VK_FORMAT_D32_SFLOAT;
@@ -1,4 +1,6 @@
 #include "../vulkan_base.h"
+#include <algorithm>
+#include <cstring>
 
 bool Vulkan::createSwapchain(VkImageUsageFlags usage, VulkanSwapchain* oldSwapchain) {
 	VulkanSwapchain result = {};
@@ -39,11 +41,42 @@ bool Vulkan::createSwapchain(VkImageUsageFlags usage, VulkanSwapchain* oldSwapch
 		surfaceCapabilities.maxImageCount = 8;
 	}
 
+	// PRESENT MODE
+	/*
+	* VK_PRESENT_MODE_IMMEDIATE_KHR -> LOAD AS MANY FRAMES AS POSSIBLE
+	* VK_PRESENT_MODE_MAILBOX_KHR -> SET FRAME RATES; LOAD NEXT FRAMES ALREADY IF AT MAX FPS (VSYNC)
+	* VK_PRESENT_MODE_FIFO_KHR -> VSYNC ON WITH WAIT(100% funktioniert)
+	* VK_PRESENT_MODE_FIFO_RELAXED_KHR -> VYSNC ON WITHOUT WAIT (MAYBE SCREEN TEARING)
+	*/
+	uint32_t numPresentModes = 0;
+	VKA(vkGetPhysicalDeviceSurfacePresentModesKHR(context->physicalDevice, surface, &numPresentModes, 0));
+	std::vector<VkPresentModeKHR> presentModes(numPresentModes);
+	VKA(vkGetPhysicalDeviceSurfacePresentModesKHR(context->physicalDevice, surface, &numPresentModes, presentModes.data()));
+	if (std::find(presentModes.begin(), presentModes.end(), settings.presentMode) == presentModes.end()) {
+		// FIFO IS ALWAYS SUPPORTED
+		LOG_WARNING("Present mode ", getPresentModeName(settings.presentMode), " is not supported, using fifo");
+		settings.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	}
+
+	// ONE IMAGE MORE THAN FRAMES IN FLIGHT, SO A FINISHED FRAME NEVER WAITS FOR AN IMAGE THE DISPLAY STILL HOLDS
+	// MAILBOX NEEDS A THIRD IMAGE TO REPLACE THE QUEUED ONE WHILE ANOTHER IS ON SCREEN
+	uint32_t imageCount = std::max(settings.framesInFlight + 1, surfaceCapabilities.minImageCount);
+	if (settings.presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		imageCount = std::max(imageCount, 3u);
+	}
+	imageCount = std::min(imageCount, surfaceCapabilities.maxImageCount);
+
+	// TRANSFER SRC FOR CAPTURES, IF THE SURFACE ALLOWS IT
+	result.transferSource = (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+	if (result.transferSource) {
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+
 	// CREATE SWAPCHAIN
 	VkSwapchainCreateInfoKHR createInfo = {};
 	createInfo.surface = surface;
 	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	createInfo.minImageCount = 3; // MINIMUM
+	createInfo.minImageCount = imageCount;
 	createInfo.imageFormat = format;
 	createInfo.imageColorSpace = colorSpace;
 	createInfo.imageExtent = surfaceCapabilities.currentExtent;
@@ -52,18 +85,16 @@ bool Vulkan::createSwapchain(VkImageUsageFlags usage, VulkanSwapchain* oldSwapch
 	createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	createInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	/*
-	* VK_PRESENT_MODE_IMMEDIATE_KHR -> LOAD AS MANY FRAMES AS POSSIBLE
-	* VK_PRESENT_MODE_MAILBOX_KHR -> SET FRAME RATES; LOAD NEXT FRAMES ALREADY IF AT MAX FPS (VSYNC)
-	* VK_PRESENT_MODE_FIFO_KHR -> VSYNC ON WITH WAIT(100% funktioniert)
-	* VK_PRESENT_MODE_FIFO_RELAXED_KHR -> VYSNC ON WITHOUT WAIT (MAYBE SCREEN TEARING)
-	*/
-	createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	createInfo.presentMode = settings.presentMode;
 	createInfo.oldSwapchain = oldSwapchain ? oldSwapchain->swapchain : 0;
 
 	// CREATE SWAPCHAIN
 	VKA(vkCreateSwapchainKHR(context->device, &createInfo, 0, &result.swapchain));
 
+	if (!oldSwapchain) {
+		LOG_INFO("Swapchain with ", imageCount, " images, present mode ", getPresentModeName(settings.presentMode), ", ", settings.framesInFlight, " frames in flight");
+	}
+
 	// SET VALUES
 	result.format = format;
 	result.width = surfaceCapabilities.currentExtent.width;
@@ -129,3 +160,36 @@ void Vulkan::cleanupSwapchain(VulkanSwapchain* swapchain) {
 	VK(vkDestroySwapchainKHR(context->device, swapchain->swapchain, 0));
 }
 
+
+namespace {
+
+const struct {
+	VkPresentModeKHR mode;
+	const char* name;
+} presentModeNames[] = {
+	{VK_PRESENT_MODE_FIFO_KHR, "fifo"},
+	{VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo-relaxed"},
+	{VK_PRESENT_MODE_MAILBOX_KHR, "mailbox"},
+	{VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate"},
+};
+
+}
+
+bool Vulkan::parsePresentMode(const char* name, VkPresentModeKHR* mode) {
+	for (const auto& entry : presentModeNames) {
+		if (strcmp(entry.name, name) == 0) {
+			*mode = entry.mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* Vulkan::getPresentModeName(VkPresentModeKHR mode) {
+	for (const auto& entry : presentModeNames) {
+		if (entry.mode == mode) {
+			return entry.name;
+		}
+	}
+	return "unknown";
+}
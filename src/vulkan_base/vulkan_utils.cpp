@@ -1,28 +1,8 @@
 #include "../vulkan_base.h"
+#include <cstring>
 
-uint32_t Vulkan::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags memoryProperties) {
-
-	// GET DEVICE MEMORY PROPERTIES
-	VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
-	VK(vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &deviceMemoryProperties));
-
-	for (uint32_t i = 0; i < deviceMemoryProperties.memoryTypeCount; i++) {
-		// CHECK IF REQUIRED MEMORY TYPE IS ALLOWED
-		if ((typeFilter & (1 << i)) != 0) {
-			// CHECK IF REQUIRED PROPERTIES ARE STATISFIED
-			if ((deviceMemoryProperties.memoryTypes[i].propertyFlags & memoryProperties) == memoryProperties) {
-				// RETURN THIS MEMORY TYPE INDEX
-				return i;
-			}
-		}
-	}
-
-	// NO MATCHING AVAILABLE MEMORY TYPE FOUND
-	assert(false);
-	return UINT32_MAX;
-}
-
-bool Vulkan::createBuffer(VkBuffer* buffer, VkDeviceMemory* memory, uint64_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
+bool Vulkan::createBuffer(VkBuffer* buffer, VulkanAllocation* allocation, uint64_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties,
+	VulkanAllocator::Category category) {
 
 	// CREATE BUFFER
 	VkBufferCreateInfo createInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
@@ -34,20 +14,14 @@ bool Vulkan::createBuffer(VkBuffer* buffer, VkDeviceMemory* memory, uint64_t siz
 	VkMemoryRequirements memoryRequirements;
 	VK(vkGetBufferMemoryRequirements(context->device, *buffer, &memoryRequirements));
 
-	// GET MEMORY INDEX
-	uint32_t memoryIndex = findMemoryType(memoryRequirements.memoryTypeBits, memoryProperties);
-	assert(memoryIndex != UINT32_MAX);
-
-	// ALLOCATE INFO
-	VkMemoryAllocateInfo allocateInfo = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-	allocateInfo.allocationSize = memoryRequirements.size;
-	allocateInfo.memoryTypeIndex = memoryIndex;
-
 	// ALLOCATE MEMORY
-	VKA(vkAllocateMemory(context->device, &allocateInfo, 0, memory));
+	if (!allocator.allocate(memoryRequirements, memoryProperties, true, category, allocation)) {
+		assert(false);
+		return false;
+	}
 
 	// BIND TO BUFFER
-	VKA(vkBindBufferMemory(context->device, *buffer, *memory, 0));
+	VKA(vkBindBufferMemory(context->device, *buffer, allocation->memory, allocation->offset));
 
 	return true;
 }
@@ -55,10 +29,7 @@ bool Vulkan::createBuffer(VkBuffer* buffer, VkDeviceMemory* memory, uint64_t siz
 // UPLOAD DATA TO BUFFER
 void Vulkan::uploadDataToBuffer(VulkanBuffer* buffer, void* data, size_t size) {
 #if 0
-	void* mapped;
-	VKA(vkMapMemory(context->device, buffer->memory, 0, size, 0, &mapped));
-	memcpy(mapped, data, size);
-	VK(vkUnmapMemory(context->device, buffer->memory));
+	memcpy(buffer->allocation.mapped, data, size);
 #else
 	// UPLOAD WITH STAGING BUFFER
 	VulkanQueue* queue = &context->graphicsQueue;
@@ -67,11 +38,9 @@ void Vulkan::uploadDataToBuffer(VulkanBuffer* buffer, void* data, size_t size) {
 	VulkanBuffer stagingBuffer;
 
 	// CREATE AND MAP THE BUFFER
-	createBuffer(&stagingBuffer.buffer, &stagingBuffer.memory, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	void* mapped;
-	VKA(vkMapMemory(context->device, stagingBuffer.memory, 0, size, 0, &mapped));
-	memcpy(mapped, data, size);
-	VK(vkUnmapMemory(context->device, stagingBuffer.memory));
+	createBuffer(&stagingBuffer.buffer, &stagingBuffer.allocation, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VulkanAllocator::CATEGORY_STAGING);
+	memcpy(stagingBuffer.allocation.mapped, data, size);
 
 	// CREATE COMMAND QUEUE
 	{
@@ -106,18 +75,17 @@ void Vulkan::uploadDataToBuffer(VulkanBuffer* buffer, void* data, size_t size) {
 	VKA(vkQueueWaitIdle(queue->queue));
 
 	VK(vkDestroyCommandPool(context->device, commandPool, 0));
-	cleanupBuffer(&stagingBuffer.buffer, &stagingBuffer.memory);
+	cleanupBuffer(&stagingBuffer.buffer, &stagingBuffer.allocation);
 
 #endif
 }
 
-void Vulkan::cleanupBuffer(VkBuffer* buffer, VkDeviceMemory* memory) {
+void Vulkan::cleanupBuffer(VkBuffer* buffer, VulkanAllocation* allocation) {
 	VK(vkDestroyBuffer(context->device, *buffer, 0));
-	// ASSUMES THAT THE BUFFER OWNS IT OWN MEMORY BLOCK
-	VK(vkFreeMemory(context->device, *memory, 0));
+	allocator.free(allocation);
 }
 
-void Vulkan::createImage(VulkanImage* image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, uint32_t arrayLayers) {
+void Vulkan::createImage(VulkanImage* image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, uint32_t arrayLayers, uint32_t mipLevels) {
 
 	// CREATE IMAGE
 	{
@@ -126,7 +94,7 @@ void Vulkan::createImage(VulkanImage* image, uint32_t width, uint32_t height, Vk
 		createInfo.extent.width = width;
 		createInfo.extent.height = height;
 		createInfo.extent.depth = 1;
-		createInfo.mipLevels = 1;
+		createInfo.mipLevels = mipLevels;
 		createInfo.arrayLayers = arrayLayers;
 		createInfo.format = format;
 		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -139,14 +107,15 @@ void Vulkan::createImage(VulkanImage* image, uint32_t width, uint32_t height, Vk
 		VKA(vkCreateImage(context->device, &createInfo, 0, &image->image));
 	}
 
-	// MAP MEMORY
+	// ALLOCATE MEMORY
 	VkMemoryRequirements memoryRequirments;
 	VK(vkGetImageMemoryRequirements(context->device, image->image, &memoryRequirments));
-	VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-	allocateInfo.allocationSize = memoryRequirments.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(memoryRequirments.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VKA(vkAllocateMemory(context->device, &allocateInfo, 0, &image->memory));
-	VKA(vkBindImageMemory(context->device, image->image, image->memory, 0));
+	VulkanAllocator::Category category = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT))
+		? VulkanAllocator::CATEGORY_RENDER_TARGET : VulkanAllocator::CATEGORY_TEXTURE;
+	if (!allocator.allocate(memoryRequirments, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, category, &image->allocation)) {
+		assert(false);
+	}
+	VKA(vkBindImageMemory(context->device, image->image, image->allocation.memory, image->allocation.offset));
 
 	// CHECK FOR DEPTH BUFFER OR NOT
 	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -161,9 +130,9 @@ void Vulkan::createImage(VulkanImage* image, uint32_t width, uint32_t height, Vk
 		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
 		createInfo.format = format;
 		createInfo.subresourceRange.aspectMask = aspect;
-		createInfo.subresourceRange.levelCount = 1;
+		createInfo.subresourceRange.levelCount = mipLevels;
 		createInfo.subresourceRange.baseArrayLayer = 0;
-		createInfo.subresourceRange.layerCount = 1;
+		createInfo.subresourceRange.layerCount = arrayLayers;
 		VKA(vkCreateImageView(context->device, &createInfo, 0, &image->view));
 	}
 }
@@ -176,11 +145,9 @@ void Vulkan::uploadDataToImage(const TextureArray& uploadInfo) {
 	VulkanBuffer stagingBuffer;
 
 	// CREATE AND MAP THE BUFFER
-	createBuffer(&stagingBuffer.buffer, &stagingBuffer.memory, uploadInfo.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	void* mapped;
-	VKA(vkMapMemory(context->device, stagingBuffer.memory, 0, uploadInfo.size, 0, &mapped));
-	memcpy(mapped, uploadInfo.data, uploadInfo.size);
-	VK(vkUnmapMemory(context->device, stagingBuffer.memory));
+	createBuffer(&stagingBuffer.buffer, &stagingBuffer.allocation, uploadInfo.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VulkanAllocator::CATEGORY_STAGING);
+	memcpy(stagingBuffer.allocation.mapped, uploadInfo.data, uploadInfo.size);
 
 	// CREATE COMMAND QUEUE
 	{
@@ -203,16 +170,18 @@ void Vulkan::uploadDataToImage(const TextureArray& uploadInfo) {
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	VKA(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
-	// IMAGE BARRIER 1
+	VkImage image = uploadInfo.image.image;
+
+	// IMAGE BARRIER 1, ALL LEVELS TO TRANSFER DST
 	{
 		VkImageMemoryBarrier imageBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
 		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageBarrier.image = uploadInfo.images[uploadInfo.arrayLayer]->image;
+		imageBarrier.image = image;
 		imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageBarrier.subresourceRange.levelCount = 1;
+		imageBarrier.subresourceRange.levelCount = uploadInfo.mipLevels;
 		imageBarrier.subresourceRange.baseArrayLayer = 0;
 		imageBarrier.subresourceRange.layerCount = uploadInfo.layerCount;
 		imageBarrier.srcAccessMask = 0;
@@ -220,29 +189,70 @@ void Vulkan::uploadDataToImage(const TextureArray& uploadInfo) {
 		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &imageBarrier);
 	}
 
-	VkBufferImageCopy region = {};
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.layerCount = 1;
-	region.imageExtent = { uploadInfo.width, uploadInfo.height, 1 };
-	VK(vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, uploadInfo.images[uploadInfo.arrayLayer]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region));
+	// ALL LAYERS OF ALL UPLOADED LEVELS IN ONE COPY
+	std::vector<VkBufferImageCopy> regions(uploadInfo.uploadedLevels);
+	VkDeviceSize bufferOffset = 0;
+	for (uint32_t level = 0; level < uploadInfo.uploadedLevels; level++) {
+		uint32_t levelWidth = std::max(uploadInfo.width >> level, 1u);
+		uint32_t levelHeight = std::max(uploadInfo.height >> level, 1u);
+		regions[level] = {};
+		regions[level].bufferOffset = bufferOffset;
+		regions[level].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, uploadInfo.layerCount };
+		regions[level].imageExtent = { levelWidth, levelHeight, 1 };
+		bufferOffset += VkDeviceSize(levelWidth) * levelHeight * 4 * uploadInfo.layerCount;
+	}
+	VK(vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(regions.size()), regions.data()));
 
-	// IMAGE BARRIER 2
-	{
+	// REST OF THE MIP CHAIN, EVERY LEVEL IS BLITTED FROM THE ONE ABOVE IT
+	int32_t mipWidth = int32_t(uploadInfo.width);
+	int32_t mipHeight = int32_t(uploadInfo.height);
+	for (uint32_t level = 0; level < uploadInfo.mipLevels; level++) {
+		// The finished level: source of the next blit, then sampled
 		VkImageMemoryBarrier imageBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageBarrier.newLayout = uploadInfo.finalLayout;
 		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		imageBarrier.image = uploadInfo.images[uploadInfo.arrayLayer]->image;
+		imageBarrier.image = image;
 		imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBarrier.subresourceRange.baseMipLevel = level;
 		imageBarrier.subresourceRange.levelCount = 1;
 		imageBarrier.subresourceRange.baseArrayLayer = 0;
 		imageBarrier.subresourceRange.layerCount = uploadInfo.layerCount;
+
+		if (level + 1 == uploadInfo.mipLevels || level + 1 < uploadInfo.uploadedLevels) {
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageBarrier.newLayout = uploadInfo.finalLayout;
+			imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageBarrier.dstAccessMask = uploadInfo.dstAccessMask;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, 0, 0, 0, 1, &imageBarrier);
+			mipWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+			mipHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+			continue;
+		}
+
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageBarrier.dstAccessMask = VK_ACCESS_NONE;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, 0, 0, 0, 1, &imageBarrier);
-	}
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &imageBarrier);
+
+		int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+		int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+		VkImageBlit blit = {};
+		blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, uploadInfo.layerCount };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level + 1, 0, uploadInfo.layerCount };
+		blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.newLayout = uploadInfo.finalLayout;
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.dstAccessMask = uploadInfo.dstAccessMask;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, 0, 0, 0, 1, &imageBarrier);
 
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
 
 	VKA(vkEndCommandBuffer(commandBuffer));
 
@@ -253,40 +263,39 @@ void Vulkan::uploadDataToImage(const TextureArray& uploadInfo) {
 	VKA(vkQueueWaitIdle(queue->queue));
 
 	VK(vkDestroyCommandPool(context->device, commandPool, 0));
-	cleanupBuffer(&stagingBuffer.buffer, &stagingBuffer.memory);
+	cleanupBuffer(&stagingBuffer.buffer, &stagingBuffer.allocation);
 }
 
 void Vulkan::cleanupImage(VulkanImage* image) {
 	VK(vkDestroyImageView(context->device, image->view, 0));
 	VK(vkDestroyImage(context->device, image->image, 0));
-	VK(vkFreeMemory(context->device, image->memory, 0));
+	allocator.free(&image->allocation);
 }
 
 void Vulkan::uploadChunkMesh(Chunk* chunk) {
 	VkDeviceSize vertexBufferSize = sizeof(chunk->getVertices()[0]) * chunk->getVertices().size();
-	VkDeviceSize indexBufferSize = sizeof(chunk->getIndices()[0]) * chunk->getIndices().size();
 
 	if (vertexBufferSize == 0) {
 		vertexBufferSize = 1;
 		LOG_INFO("VERTEX BUFFER SIZE IS 0");
 	}
-	if (indexBufferSize == 0) {
-		indexBufferSize = 1;
-		LOG_INFO("INDEX BUFFER SIZE IS 0");
-	}
 
-	createBuffer(&chunk->vertexBuffer, &chunk->vertexBufferMemory, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	createBuffer(&chunk->vertexBuffer, &chunk->vertexBufferAllocation, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VulkanAllocator::CATEGORY_CHUNK_MESH);
+	memcpy(chunk->vertexBufferAllocation.mapped, chunk->getVertices().data(), (size_t)vertexBufferSize);
 
-	void* vertexData;
-	vkMapMemory(context->device, chunk->vertexBufferMemory, 0, vertexBufferSize, 0, &vertexData);
-	memcpy(vertexData, chunk->getVertices().data(), (size_t)vertexBufferSize);
-	vkUnmapMemory(context->device, chunk->vertexBufferMemory);
+	uploadChunkIndices(chunk);
+}
 
+void Vulkan::uploadChunkIndices(Chunk* chunk) {
+	VkDeviceSize indexBufferSize = sizeof(chunk->getIndices()[0]) * chunk->getIndices().size();
 
-	createBuffer(&chunk->indexBuffer, &chunk->indexBufferMemory, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (indexBufferSize == 0) {
+		indexBufferSize = 1;
+		LOG_INFO("INDEX BUFFER SIZE IS 0");
+	}
 
-	void* indexData;
-	vkMapMemory(context->device, chunk->indexBufferMemory, 0, indexBufferSize, 0, &indexData);
-	memcpy(indexData, chunk->getIndices().data(), (size_t)indexBufferSize);
-	vkUnmapMemory(context->device, chunk->indexBufferMemory);
+	createBuffer(&chunk->indexBuffer, &chunk->indexBufferAllocation, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VulkanAllocator::CATEGORY_CHUNK_MESH);
+	memcpy(chunk->indexBufferAllocation.mapped, chunk->getIndices().data(), (size_t)indexBufferSize);
 }
\ No newline at end of file